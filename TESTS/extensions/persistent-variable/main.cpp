@@ -100,6 +100,30 @@ void test_case_array_types()
 
 }
 
+void test_case_cached()
+{
+    PersistentVariable<uint32_t> test_cached(10, "test_cached", 0, true);
+    TEST_ASSERT_EQUAL(10, test_cached.get());
+
+    /** Loaded once, every further read comes from RAM */
+    for(int i = 0; i < 5; i++) {
+        TEST_ASSERT_EQUAL(10, (uint32_t) test_cached);
+    }
+    TEST_ASSERT_EQUAL(5, test_cached.hit_count());
+
+    uint32_t flash_writes = test_cached.flash_write_count();
+    test_cached = 10;
+    TEST_ASSERT_EQUAL(flash_writes, test_cached.flash_write_count());
+    TEST_ASSERT_EQUAL(1, test_cached.skipped_write_count());
+
+    test_cached = 11;
+    TEST_ASSERT_EQUAL(flash_writes + 1, test_cached.flash_write_count());
+
+    /** Reload from KVStore after an invalidation */
+    test_cached.invalidate();
+    TEST_ASSERT_EQUAL(11, test_cached.get());
+}
+
 void test_case_string_types()
 {
 // TODO
@@ -139,6 +163,7 @@ Case cases[] = {
     Case("primitive types", test_case_primitive_types, greentea_failure_handler),
     Case("struct types", test_case_struct_types, greentea_failure_handler),
     Case("array types", test_case_array_types, greentea_failure_handler),
+    Case("cached", test_case_cached, greentea_failure_handler),
     Case("string types", test_case_string_types, greentea_failure_handler),
     Case("irq test", test_case_interrupt, greentea_failure_handler)
 };
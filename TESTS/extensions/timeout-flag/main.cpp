@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2013-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "greentea-client/test_env.h"
+#include "unity/unity.h"
+#include "utest/utest.h"
+
+#include "TimeoutFlag.h"
+#include "EventQueueFlag.h"
+
+#include "rtos/Kernel.h"
+
+using namespace utest::v1;
+using namespace std::chrono_literals;
+
+template<typename T>
+void test_case_expires(T &flag)
+{
+    flag.start(20ms);
+    TEST_ASSERT_FALSE(flag.is_set());
+
+    rtos::Kernel::Clock::time_point start = rtos::Kernel::Clock::now();
+    TEST_ASSERT_TRUE(flag.wait_for(1s));
+    rtos::Kernel::Clock::duration elapsed = rtos::Kernel::Clock::now() - start;
+
+    /** Never early, at most a couple of ticks late */
+    TEST_ASSERT_TRUE(flag.is_set());
+    TEST_ASSERT_TRUE(elapsed >= 20ms);
+    TEST_ASSERT_TRUE(elapsed <= 25ms);
+}
+
+template<typename T>
+void test_case_stopped(T &flag)
+{
+    flag.start(500ms);
+    flag.stop();
+    TEST_ASSERT_FALSE(flag.wait_for(1s));
+    TEST_ASSERT_FALSE(flag.is_set());
+}
+
+template<typename T>
+void test_case_restarted(T &flag)
+{
+    /** The stop() must not end the wait of the next start() early */
+    flag.start(500ms);
+    flag.stop();
+    test_case_expires(flag);
+}
+
+void test_case_volatile_bool()
+{
+    TimeoutFlag flag;
+    test_case_expires(flag);
+    test_case_stopped(flag);
+    test_case_restarted(flag);
+}
+
+#if defined(MBED_CONF_RTOS_PRESENT)
+void test_case_event_flags()
+{
+    BasicTimeoutFlag<ep::EventFlagsFlag> flag;
+    test_case_expires(flag);
+    test_case_stopped(flag);
+    test_case_restarted(flag);
+}
+#endif
+
+static volatile bool queue_callback_done = false;
+
+void on_queue_timeout()
+{
+    queue_callback_done = true;
+}
+
+void test_case_event_queue()
+{
+    events::EventQueue queue;
+    BasicTimeoutFlag<ep::EventQueueFlag> flag(ep::default_timer_wheel(), &queue, mbed::callback(on_queue_timeout));
+    test_case_expires(flag);
+    TEST_ASSERT_TRUE(queue_callback_done);
+    test_case_stopped(flag);
+    test_case_restarted(flag);
+}
+
+utest::v1::status_t greentea_failure_handler(const Case *const source, const failure_t reason)
+{
+    greentea_case_failure_abort_handler(source, reason);
+    return STATUS_CONTINUE;
+}
+
+Case cases[] = {
+    Case("volatile bool", test_case_volatile_bool, greentea_failure_handler),
+#if defined(MBED_CONF_RTOS_PRESENT)
+    Case("event flags", test_case_event_flags, greentea_failure_handler),
+#endif
+    Case("event queue", test_case_event_queue, greentea_failure_handler)
+};
+
+utest::v1::status_t greentea_test_setup(const size_t number_of_cases)
+{
+    GREENTEA_SETUP(20, "default_auto");
+    return greentea_test_setup_handler(number_of_cases);
+}
+
+Specification specification(greentea_test_setup, cases, greentea_test_teardown_handler);
+
+int main()
+{
+    Harness::run(specification);
+}
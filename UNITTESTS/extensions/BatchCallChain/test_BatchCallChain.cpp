@@ -0,0 +1,250 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/BatchCallChain.h"
+
+#include <chrono>
+#include <string>
+#include <stdio.h>
+
+/**
+ * Test for BatchCallChain extension
+ */
+class TestBatchCallChain : public testing::Test {
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+public:
+
+    struct sample_t {
+        int x;
+        int y;
+        int z;
+    };
+
+    class Accumulator {
+    public:
+        Accumulator() : calls(0), sum(0) { }
+
+        void on_batch(mbed::Span<const sample_t> samples) {
+            calls++;
+            for(const sample_t &s : samples) {
+                sum += s.x + s.y + s.z;
+            }
+        }
+
+        void on_sample(sample_t s) {
+            calls++;
+            sum += s.x + s.y + s.z;
+        }
+
+        int calls;
+        int sum;
+    };
+
+    /** Appends its tag to a trace for each sample */
+    class Recorder {
+    public:
+        Recorder(char tag, std::string &trace) : tag(tag), trace(trace) { }
+
+        void on_sample(sample_t) {
+            trace += tag;
+        }
+
+        char tag;
+        std::string &trace;
+    };
+
+    /** Detaches itself on its first sample */
+    class SelfDetacher {
+    public:
+        SelfDetacher(ep::BatchCallChain<sample_t> &chain) : chain(chain), calls(0) { }
+
+        void on_sample(sample_t) {
+            calls++;
+            chain.detach(mbed::callback(this, &SelfDetacher::on_sample));
+        }
+
+        ep::BatchCallChain<sample_t> &chain;
+        int calls;
+    };
+
+    void fill(sample_t *samples, int n) {
+        for(int i = 0; i < n; i++) {
+            samples[i].x = i;
+            samples[i].y = 2 * i;
+            samples[i].z = 3 * i;
+        }
+    }
+};
+
+/** Batch subscribers get the span once, per-sample subscribers get every sample */
+TEST_F(TestBatchCallChain, batch_and_per_sample)
+{
+    sample_t fifo[32];
+    fill(fifo, 32);
+
+    Accumulator batch, per_sample;
+    ep::BatchCallChain<sample_t> chain;
+    chain.attach(mbed::callback(&batch, &Accumulator::on_batch));
+    chain.attach(mbed::callback(&per_sample, &Accumulator::on_sample));
+    chain.call(mbed::make_const_Span(fifo));
+
+    // sum over i of 6i for i in [0, 32)
+    EXPECT_EQ(1, batch.calls);
+    EXPECT_EQ(2976, batch.sum);
+    EXPECT_EQ(32, per_sample.calls);
+    EXPECT_EQ(2976, per_sample.sum);
+
+    chain.call(fifo[1]);
+    EXPECT_EQ(2, batch.calls);
+    EXPECT_EQ(33, per_sample.calls);
+}
+
+/** Duplicates are ignored and detach works for both kinds of subscriber */
+TEST_F(TestBatchCallChain, detach)
+{
+    sample_t fifo[4];
+    fill(fifo, 4);
+
+    Accumulator batch, per_sample;
+    ep::BatchCallChain<sample_t> chain;
+    chain.attach(mbed::callback(&batch, &Accumulator::on_batch));
+    chain.attach(mbed::callback(&per_sample, &Accumulator::on_sample));
+    chain.attach(mbed::callback(&per_sample, &Accumulator::on_sample));
+    chain.call(mbed::make_const_Span(fifo));
+    EXPECT_EQ(4, per_sample.calls);
+
+    chain.detach(mbed::callback(&per_sample, &Accumulator::on_sample));
+    chain.detach(mbed::callback(&batch, &Accumulator::on_batch));
+    chain.call(mbed::make_const_Span(fifo));
+    EXPECT_EQ(1, batch.calls);
+    EXPECT_EQ(4, per_sample.calls);
+}
+
+/** Per-sample subscribers run in the same order as the links of a CallChain */
+TEST_F(TestBatchCallChain, per_sample_order_matches_callchain)
+{
+    std::string expected, actual;
+    Recorder reference[3] = { Recorder('a', expected), Recorder('b', expected), Recorder('c', expected) };
+    Recorder recorders[3] = { Recorder('a', actual), Recorder('b', actual), Recorder('c', actual) };
+
+    ep::CallChain<sample_t> callchain;
+    ep::BatchCallChain<sample_t> chain;
+    for(int i = 0; i < 3; i++) {
+        callchain.attach(mbed::callback(&reference[i], &Recorder::on_sample));
+        chain.attach(mbed::callback(&recorders[i], &Recorder::on_sample));
+    }
+
+    sample_t sample = { 1, 2, 3 };
+    callchain.call(sample);
+    chain.call(sample);
+    EXPECT_EQ(expected, actual);
+}
+
+/** A per-sample subscriber can detach itself part way through a batch */
+TEST_F(TestBatchCallChain, per_sample_detach_during_call)
+{
+    sample_t fifo[4];
+    fill(fifo, 4);
+
+    ep::BatchCallChain<sample_t> chain;
+    SelfDetacher detacher(chain);
+    Accumulator other;
+    chain.attach(mbed::callback(&detacher, &SelfDetacher::on_sample));
+    chain.attach(mbed::callback(&other, &Accumulator::on_sample));
+
+    /** The detached subscriber is not called for the rest of the batch */
+    chain.call(mbed::make_const_Span(fifo));
+    EXPECT_EQ(1, detacher.calls);
+    EXPECT_EQ(4, other.calls);
+
+    chain.call(mbed::make_const_Span(fifo));
+    EXPECT_EQ(1, detacher.calls);
+    EXPECT_EQ(8, other.calls);
+}
+
+/** Per-sample subscribers can be owned by a Subscription */
+TEST_F(TestBatchCallChain, per_sample_subscription)
+{
+    sample_t fifo[4];
+    fill(fifo, 4);
+
+    Accumulator per_sample;
+    ep::BatchCallChain<sample_t> chain;
+    {
+        ep::Subscription sub = chain.attach(mbed::callback(&per_sample, &Accumulator::on_sample));
+        EXPECT_FALSE(chain.attach(mbed::callback(&per_sample, &Accumulator::on_sample)).is_valid());
+        chain.call(mbed::make_const_Span(fifo));
+        EXPECT_EQ(4, per_sample.calls);
+    }
+
+    chain.call(mbed::make_const_Span(fifo));
+    EXPECT_EQ(4, per_sample.calls);
+}
+
+/**
+ * Host benchmark of a 32-sample FIFO drain: one CallChain call per sample
+ * vs one BatchCallChain call per FIFO. Results are printed, not asserted.
+ */
+TEST_F(TestBatchCallChain, benchmark_fifo_drain)
+{
+    const int iterations = 20000;
+    sample_t fifo[32];
+    fill(fifo, 32);
+
+    Accumulator subscribers[4];
+    ep::CallChain<sample_t> per_sample_chain;
+    ep::BatchCallChain<sample_t> batch_chain;
+    for(int i = 0; i < 4; i++) {
+        per_sample_chain.attach(mbed::callback(&subscribers[i], &Accumulator::on_sample));
+        batch_chain.attach(mbed::callback(&subscribers[i], &Accumulator::on_batch));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; i++) {
+        for(int s = 0; s < 32; s++) {
+            per_sample_chain.call(fifo[s]);
+        }
+    }
+    auto mid = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; i++) {
+        batch_chain.call(mbed::make_const_Span(fifo));
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double per_sample_ns = std::chrono::duration<double, std::nano>(mid - start).count() / (iterations * 32);
+    double batch_ns = std::chrono::duration<double, std::nano>(end - mid).count() / (iterations * 32);
+    printf("4 subscribers, 32-sample FIFO: %.1f ns/sample per-sample, %.1f ns/sample batched\n",
+            per_sample_ns, batch_ns);
+
+    EXPECT_EQ(iterations * 33, subscribers[0].calls);
+}
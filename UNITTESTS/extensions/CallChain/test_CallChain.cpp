@@ -268,3 +268,99 @@ TEST_F(TestCallChain, general_test)
 
 }
 
+
+/** Subscriptions detach their callback when destroyed */
+TEST_F(TestCallChain, subscription_scope)
+{
+	BitFlag flags[2];
+	mbed::Span<BitFlag, 2> flag_list(flags);
+	ep::CallChain<> callchain;
+	callchain.attach(mbed::callback(&flags[0], &BitFlag::set_bit));
+	{
+		ep::Subscription sub = callchain.attach(mbed::callback(&flags[1], &BitFlag::set_bit));
+		EXPECT_TRUE(sub.is_active());
+		callchain.call();
+		assert_matching_flags("11", flag_list);
+	}
+
+	reset_flags(flags);
+	callchain.call();
+	assert_matching_flags("01", flag_list);
+}
+
+/** Subscriptions can be moved, and are orphaned by other forms of detach */
+TEST_F(TestCallChain, subscription_move)
+{
+	BitFlag flags[2];
+	mbed::Span<BitFlag, 2> flag_list(flags);
+	ep::CallChain<> callchain;
+	ep::Subscription outer;
+	{
+		ep::Subscription inner = callchain.attach(mbed::callback(&flags[0], &BitFlag::set_bit));
+		outer = std::move(inner);
+		EXPECT_FALSE(inner.is_active());
+	}
+	callchain.call();
+	assert_matching_flags("01", flag_list);
+
+	// Duplicate attach does not produce an active subscription
+	ep::Subscription duplicate = callchain.attach(mbed::callback(&flags[0], &BitFlag::set_bit));
+	EXPECT_FALSE(duplicate.is_active());
+
+	callchain.detach(mbed::callback(&flags[0], &BitFlag::set_bit));
+	EXPECT_FALSE(outer.is_active());
+
+	ep::Subscription other = callchain.attach(mbed::callback(&flags[1], &BitFlag::set_bit));
+	callchain.detach_all();
+	EXPECT_FALSE(other.is_active());
+}
+
+/** A token can only be converted into one Subscription */
+TEST_F(TestCallChain, subscription_token_single_owner)
+{
+	BitFlag flags[2];
+	mbed::Span<BitFlag, 2> flag_list(flags);
+	ep::CallChain<> callchain;
+
+	ep::SubscriptionToken token = callchain.attach(mbed::callback(&flags[0], &BitFlag::set_bit));
+	EXPECT_TRUE(token.is_valid());
+	ep::Subscription first(std::move(token));
+	EXPECT_FALSE(token.is_valid());
+	ep::Subscription second(std::move(token));
+	EXPECT_TRUE(first.is_active());
+	EXPECT_FALSE(second.is_active());
+
+	first.reset();
+	callchain.call();
+	assert_matching_flags("00", flag_list);
+}
+
+/** Subscriptions can be destroyed while the chain is dispatching */
+TEST_F(TestCallChain, subscription_reset_during_call)
+{
+	BitFlag flags[2];
+	mbed::Span<BitFlag, 2> flag_list(flags);
+	ep::CallChain<> callchain;
+	ep::Subscription subs[2];
+
+	struct Unsubscriber {
+		ep::Subscription *subs;
+		int calls;
+		void run(void) {
+			calls++;
+			subs[0].reset();
+			subs[1].reset();
+		}
+	} unsubscriber = { subs, 0 };
+
+	callchain.attach(mbed::callback(&unsubscriber, &Unsubscriber::run));
+	subs[0] = callchain.attach(mbed::callback(&flags[0], &BitFlag::set_bit));
+	subs[1] = callchain.attach(mbed::callback(&flags[1], &BitFlag::set_bit));
+
+	callchain.call();
+	reset_flags(flags);
+	callchain.call();
+
+	assert_matching_flags("00", flag_list);
+	EXPECT_EQ(2, unsubscriber.calls);
+}
@@ -0,0 +1,135 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/ChunkedPersistentArray.h"
+#include "extensions/PersistentArray.h"
+
+#include "kvstore_global_api_stub.h"
+
+#include <stdio.h>
+
+/**
+ * Test for ChunkedPersistentArray extension
+ */
+class TestChunkedPersistentArray : public testing::Test {
+
+    virtual void SetUp()
+    {
+        kv_reset("/kv/");
+        kvstore_stub::reset_stats();
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+public:
+
+    static const ptrdiff_t ENTRIES = 256;
+
+    typedef ep::ChunkedPersistentArray<uint16_t, ENTRIES> table_t;
+
+};
+
+TEST_F(TestChunkedPersistentArray, single_element_update_writes_one_chunk)
+{
+    table_t table((uint16_t) 0, "cal");
+
+    EXPECT_EQ(0, table.set(37, 1234));
+    EXPECT_EQ(1u, table.flash_write_count());
+    EXPECT_EQ(16 * sizeof(uint16_t), table.bytes_written());
+    EXPECT_EQ(1234, table.get(37));
+
+    /** Same value again writes nothing */
+    EXPECT_EQ(0, table.set(37, 1234));
+    EXPECT_EQ(1u, table.flash_write_count());
+    EXPECT_EQ(1u, table.skipped_write_count());
+}
+
+TEST_F(TestChunkedPersistentArray, range_update_writes_touched_chunks)
+{
+    table_t table((uint16_t) 0, "cal");
+    uint16_t values[20];
+    for(int i = 0; i < 20; i++) {
+        values[i] = i + 1;
+    }
+
+    /** Elements 10..29 span chunks 0 and 1 */
+    EXPECT_EQ(0, table.set(10, mbed::make_Span(values)));
+    EXPECT_EQ(2u, table.flash_write_count());
+
+    table_t reloaded((uint16_t) 0, "cal");
+    mbed::Span<uint16_t, ENTRIES> all = reloaded.get();
+    EXPECT_EQ(0, all[9]);
+    EXPECT_EQ(1, all[10]);
+    EXPECT_EQ(20, all[29]);
+    EXPECT_EQ(0, all[30]);
+}
+
+TEST_F(TestChunkedPersistentArray, adopts_unchunked_table)
+{
+    uint16_t legacy[ENTRIES];
+    for(int i = 0; i < ENTRIES; i++) {
+        legacy[i] = i;
+    }
+    {
+        ep::PersistentArray<uint16_t, ENTRIES> whole(mbed::make_Span(legacy), "cal");
+        whole.set(mbed::make_Span(legacy));
+    }
+
+    table_t table((uint16_t) 0, "cal");
+    EXPECT_EQ(200, table.get(200));
+    kv_info_t info;
+    EXPECT_EQ(MBED_ERROR_ITEM_NOT_FOUND, kv_get_info("cal", &info));
+    EXPECT_EQ(MBED_SUCCESS, kv_get_info("cal.15", &info));
+}
+
+TEST_F(TestChunkedPersistentArray, benchmark_bytes_per_update)
+{
+    ep::PersistentArray<uint16_t, ENTRIES> whole((uint16_t) 0, "whole");
+    table_t chunked((uint16_t) 0, "chunked");
+    uint16_t values[ENTRIES] = { 0 };
+
+    const int updates = 100;
+
+    kvstore_stub::reset_stats();
+    for(int i = 0; i < updates; i++) {
+        values[(i * 7) % ENTRIES] = i + 1;
+        whole.set(mbed::make_Span(values));
+    }
+    uint32_t whole_bytes = kvstore_stub::stats().value_bytes;
+
+    kvstore_stub::reset_stats();
+    for(int i = 0; i < updates; i++) {
+        chunked.set((i * 7) % ENTRIES, i + 1);
+    }
+    uint32_t chunked_bytes = kvstore_stub::stats().value_bytes;
+
+    printf("%d single-element updates of a %d-entry table: %u bytes/update whole, %u bytes/update chunked\r\n",
+            updates, (int) ENTRIES, whole_bytes / updates, chunked_bytes / updates);
+
+    EXPECT_EQ(ENTRIES * sizeof(uint16_t), whole_bytes / updates);
+    EXPECT_EQ(16 * sizeof(uint16_t), chunked_bytes / updates);
+}
@@ -0,0 +1,34 @@
+
+####################
+# UNIT TESTS
+####################
+
+set(unittest-includes ${unittest-includes}
+  .
+  ../
+  ../../mbed-os/
+  ../../mbed-os/platform/
+  ../../mbed-os/platform/mbed-trace/include/
+  ../../mbed-os/rtos/include/
+  ../../mbed-os/storage/kvstore/kvstore_global_api/include/kvstore_global_api/
+  ../platform/
+)
+
+set(unittest-sources
+  ../extensions/PersistentGroup.cpp
+  ../extensions/PersistentWriter.cpp
+  ../extensions/PersistentRegistry.cpp
+  stubs/kvstore_global_api_stub.cpp
+  ../../mbed-os/UNITTESTS/stubs/mbed_assert_stub.cpp
+  ../../mbed-os/UNITTESTS/stubs/mbed_critical_stub.c
+  ../../mbed-os/UNITTESTS/stubs/EventFlags_stub.cpp
+  ../../mbed-os/UNITTESTS/stubs/Thread_stub.cpp
+)
+
+set(unittest-test-sources
+  extensions/ChunkedPersistentArray/test_ChunkedPersistentArray.cpp
+)
+
+set(CONF_FLAGS "-DMBED_CONF_PLATFORM_CTHUNK_COUNT_MAX=10 -DMBED_CONF_MBED_TRACE_ENABLE=0")
+set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} ${DEVICE_FLAGS} ${CONF_FLAGS}")
+set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} ${DEVICE_FLAGS} ${CONF_FLAGS}")
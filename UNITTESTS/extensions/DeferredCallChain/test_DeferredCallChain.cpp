@@ -0,0 +1,201 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/DeferredCallChain.h"
+
+#include <vector>
+
+/** Exposes drain() so deferred invocations can be dispatched without the queue */
+template<size_t Depth, typename... ArgTs>
+class DrainableCallChain : public ep::DeferredCallChain<Depth, ArgTs...> {
+
+public:
+
+    DrainableCallChain(events::EventQueue &queue, bool coalesce = false) :
+        ep::DeferredCallChain<Depth, ArgTs...>(queue, coalesce) {
+    }
+
+    using ep::DeferredCallChain<Depth, ArgTs...>::drain;
+
+};
+
+class Recorder {
+
+public:
+
+    void record(int value) {
+        values.push_back(value);
+    }
+
+    std::vector<int> values;
+
+};
+
+static void noop(void)
+{
+}
+
+/**
+ * Test for DeferredCallChain extension
+ */
+class TestDeferredCallChain : public testing::Test {
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+};
+
+TEST_F(TestDeferredCallChain, deferred_invocations_are_drained_in_order)
+{
+    events::EventQueue queue;
+    DrainableCallChain<8, int> chain(queue);
+    Recorder recorder;
+    chain.attach(mbed::callback(&recorder, &Recorder::record));
+
+    EXPECT_TRUE(chain.defer(1));
+    EXPECT_TRUE(chain.defer(2));
+    EXPECT_TRUE(chain.defer(3));
+    EXPECT_TRUE(recorder.values.empty());
+
+    chain.drain();
+    EXPECT_EQ(std::vector<int>({ 1, 2, 3 }), recorder.values);
+
+    /** The ring is reusable once drained */
+    for(int i = 0; i < 20; i++) {
+        EXPECT_TRUE(chain.defer(i));
+        chain.drain();
+    }
+    EXPECT_EQ(23u, recorder.values.size());
+    EXPECT_EQ(0u, chain.overflow_count());
+}
+
+TEST_F(TestDeferredCallChain, full_ring_drops_and_counts)
+{
+    events::EventQueue queue;
+    DrainableCallChain<4, int> chain(queue);
+    Recorder recorder;
+    chain.attach(mbed::callback(&recorder, &Recorder::record));
+
+    for(int i = 0; i < 6; i++) {
+        chain.defer(i);
+    }
+    EXPECT_EQ(2u, chain.overflow_count());
+
+    chain.drain();
+    EXPECT_EQ(std::vector<int>({ 0, 1, 2, 3 }), recorder.values);
+
+    chain.reset_counters();
+    EXPECT_EQ(0u, chain.overflow_count());
+}
+
+TEST_F(TestDeferredCallChain, coalescing_keeps_latest_arguments)
+{
+    events::EventQueue queue;
+    DrainableCallChain<4, int> chain(queue, true);
+    Recorder recorder;
+    chain.attach(mbed::callback(&recorder, &Recorder::record));
+
+    for(int i = 0; i < 10; i++) {
+        EXPECT_TRUE(chain.defer(i));
+    }
+    EXPECT_EQ(9u, chain.coalesced_count());
+    EXPECT_EQ(0u, chain.overflow_count());
+
+    chain.drain();
+    chain.drain();
+    EXPECT_EQ(std::vector<int>({ 9 }), recorder.values);
+}
+
+TEST_F(TestDeferredCallChain, one_drain_event_is_posted_per_batch)
+{
+    events::EventQueue queue;
+    DrainableCallChain<8, int> chain(queue);
+    Recorder recorder;
+    chain.attach(mbed::callback(&recorder, &Recorder::record));
+
+    chain.defer(1);
+    chain.defer(2);
+    queue.dispatch(0);
+    EXPECT_EQ(std::vector<int>({ 1, 2 }), recorder.values);
+
+    /** A new batch posts a new drain */
+    chain.defer(3);
+    queue.dispatch(0);
+    EXPECT_EQ(std::vector<int>({ 1, 2, 3 }), recorder.values);
+    EXPECT_EQ(0u, chain.post_fail_count());
+}
+
+TEST_F(TestDeferredCallChain, failed_post_is_counted_and_retried)
+{
+    /** Room for a single event, taken before the chain posts */
+    events::EventQueue queue(EVENTS_EVENT_SIZE);
+    DrainableCallChain<8, int> chain(queue);
+    Recorder recorder;
+    chain.attach(mbed::callback(&recorder, &Recorder::record));
+
+    queue.call(mbed::callback(noop));
+    EXPECT_TRUE(chain.defer(1));
+    EXPECT_TRUE(chain.defer(2));
+    EXPECT_EQ(2u, chain.post_fail_count());
+
+    /** The invocations stay queued and the next defer posts again */
+    queue.dispatch(0);
+    EXPECT_TRUE(chain.defer(3));
+    queue.dispatch(0);
+    EXPECT_EQ(std::vector<int>({ 1, 2, 3 }), recorder.values);
+}
+
+TEST_F(TestDeferredCallChain, destruction_cancels_posted_drain)
+{
+    events::EventQueue queue;
+    Recorder recorder;
+
+    DrainableCallChain<8, int> *chain = new DrainableCallChain<8, int>(queue);
+    chain->attach(mbed::callback(&recorder, &Recorder::record));
+    chain->defer(1);
+    delete chain;
+
+    queue.dispatch(0);
+    EXPECT_TRUE(recorder.values.empty());
+}
+
+TEST_F(TestDeferredCallChain, call_through_base_reference_uses_deferred_dispatch)
+{
+    events::EventQueue queue;
+    DrainableCallChain<8, int> chain(queue);
+    Recorder recorder;
+    chain.attach(mbed::callback(&recorder, &Recorder::record));
+
+    /** Outside of an ISR DeferredCallChain dispatches right away either way */
+    ep::CallChain<int> &base = chain;
+    base.call(5);
+    base(6);
+    EXPECT_EQ(std::vector<int>({ 5, 6 }), recorder.values);
+}
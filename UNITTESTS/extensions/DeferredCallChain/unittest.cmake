@@ -0,0 +1,30 @@
+
+####################
+# UNIT TESTS
+####################
+
+set(unittest-includes ${unittest-includes}
+  .
+  ../
+  ../../mbed-os/
+  ../../mbed-os/platform/
+  ../../mbed-os/events/include/
+  ../platform/
+)
+
+set(unittest-sources
+  ../../mbed-os/UNITTESTS/stubs/mbed_assert_stub.cpp
+  ../../mbed-os/UNITTESTS/stubs/mbed_critical_stub.c
+  ../../mbed-os/platform/source/mbed_atomic_impl.c
+  ../../mbed-os/events/source/EventQueue.cpp
+  ../../mbed-os/events/source/equeue.c
+  ../../mbed-os/events/source/equeue_posix.c
+)
+
+set(unittest-test-sources
+  extensions/DeferredCallChain/test_DeferredCallChain.cpp
+)
+
+set(CONF_FLAGS "-DMBED_CONF_PLATFORM_CTHUNK_COUNT_MAX=10 -DEQUEUE_PLATFORM_POSIX")
+set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} ${DEVICE_FLAGS} ${CONF_FLAGS}")
+set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} ${DEVICE_FLAGS} ${CONF_FLAGS}")
@@ -0,0 +1,145 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/DerivedVariable.h"
+
+#include <vector>
+
+/**
+ * Test for DerivedVariable extension
+ */
+class TestDerivedVariable : public testing::Test {
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+public:
+
+    typedef ep::BoundVariable<int> source_t;
+    typedef ep::DerivedVariable<int, source_t> unary_t;
+    typedef ep::DerivedVariable<int, source_t, source_t> binary_t;
+    typedef ep::DerivedVariable<int, unary_t, unary_t> diamond_t;
+
+    static int twice(int a) {
+        return 2 * a;
+    }
+
+    static int thrice(int a) {
+        return 3 * a;
+    }
+
+    static int sum(int a, int b) {
+        return a + b;
+    }
+
+    class Recorder {
+    public:
+        void on_update(int value) {
+            values.push_back(value);
+        }
+
+        std::vector<int> values;
+    };
+};
+
+/** Nothing is computed until the value is read */
+TEST_F(TestDerivedVariable, lazy)
+{
+    source_t a(1), b(2);
+    binary_t total(mbed::callback(sum), a, b);
+    EXPECT_EQ(0u, total.compute_count());
+
+    a = 10;
+    b = 20;
+    a = 30;
+    EXPECT_EQ(0u, total.compute_count());
+
+    EXPECT_EQ(50, total.get());
+    EXPECT_EQ(50, (int) total);
+    EXPECT_EQ(1u, total.compute_count());
+
+    // Setting an input to the same value does not recompute
+    a = 30;
+    EXPECT_EQ(50, total.get());
+    EXPECT_EQ(1u, total.compute_count());
+}
+
+/** Subscribed nodes recompute eagerly and notify with the new value */
+TEST_F(TestDerivedVariable, subscribed)
+{
+    source_t a(1), b(2);
+    binary_t total(mbed::callback(sum), a, b);
+    Recorder recorder;
+    total.attach(mbed::callback(&recorder, &Recorder::on_update));
+
+    a = 5;
+    b = 6;
+    ASSERT_EQ(2u, recorder.values.size());
+    EXPECT_EQ(7, recorder.values[0]);
+    EXPECT_EQ(11, recorder.values[1]);
+    EXPECT_EQ(2u, total.compute_count());
+}
+
+/** A diamond computes its sink once per update, without glitches */
+TEST_F(TestDerivedVariable, diamond)
+{
+    source_t a(1);
+    unary_t b(mbed::callback(twice), a);
+    unary_t c(mbed::callback(thrice), a);
+    diamond_t d(mbed::callback(sum), b, c);
+    Recorder recorder;
+    d.attach(mbed::callback(&recorder, &Recorder::on_update));
+
+    a = 2;
+    a = 3;
+
+    // Only consistent values 5*a are ever observed
+    ASSERT_EQ(2u, recorder.values.size());
+    EXPECT_EQ(10, recorder.values[0]);
+    EXPECT_EQ(15, recorder.values[1]);
+    EXPECT_EQ(2u, d.compute_count());
+    EXPECT_EQ(2u, b.compute_count());
+    EXPECT_EQ(2u, c.compute_count());
+}
+
+/** Destroying a DerivedVariable detaches it from its inputs */
+TEST_F(TestDerivedVariable, detach_on_destroy)
+{
+    source_t a(1);
+    {
+        unary_t b(mbed::callback(twice), a);
+        Recorder recorder;
+        b.attach(mbed::callback(&recorder, &Recorder::on_update));
+        a = 2;
+        EXPECT_EQ(1u, recorder.values.size());
+    }
+    a = 3;
+    EXPECT_EQ(3, a.get());
+}
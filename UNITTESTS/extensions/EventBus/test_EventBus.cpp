@@ -0,0 +1,152 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/EventBus.h"
+
+#include <chrono>
+#include <stdio.h>
+
+/**
+ * Test for EventBus extension
+ */
+class TestEventBus : public testing::Test {
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+public:
+
+    struct TemperatureTopic {
+        typedef float payload_t;
+    };
+
+    struct HumidityTopic {
+        typedef float payload_t;
+    };
+
+    struct ButtonTopic {
+        typedef int payload_t;
+    };
+
+    typedef ep::EventBus<TemperatureTopic, HumidityTopic, ButtonTopic> bus_t;
+
+    class Sink {
+    public:
+        Sink() : count(0), last(0) { }
+
+        void on_float(float value) {
+            count++;
+            last = value;
+        }
+
+        void on_int(int value) {
+            count++;
+            last = value;
+        }
+
+        int count;
+        float last;
+    };
+};
+
+/** Payloads only reach subscribers of the published topic */
+TEST_F(TestEventBus, topics_are_independent)
+{
+    bus_t bus;
+    Sink temperature, humidity, button;
+    bus.subscribe<TemperatureTopic>(mbed::callback(&temperature, &Sink::on_float));
+    bus.subscribe<HumidityTopic>(mbed::callback(&humidity, &Sink::on_float));
+    bus.subscribe<ButtonTopic>(mbed::callback(&button, &Sink::on_int));
+
+    bus.publish<TemperatureTopic>(21.5f);
+    bus.publish<ButtonTopic>(3);
+    bus.publish<ButtonTopic>(4);
+
+    EXPECT_EQ(1, temperature.count);
+    EXPECT_FLOAT_EQ(21.5f, temperature.last);
+    EXPECT_EQ(0, humidity.count);
+    EXPECT_EQ(2, button.count);
+    EXPECT_FLOAT_EQ(4.0f, button.last);
+
+    EXPECT_EQ(1u, bus.publish_count<TemperatureTopic>());
+    EXPECT_EQ(0u, bus.publish_count<HumidityTopic>());
+    EXPECT_EQ(2u, bus.publish_count<ButtonTopic>());
+}
+
+/** Unsubscribe through the bus or a Subscription */
+TEST_F(TestEventBus, unsubscribe)
+{
+    bus_t bus;
+    Sink a, b;
+    bus.subscribe<TemperatureTopic>(mbed::callback(&a, &Sink::on_float));
+    {
+        ep::Subscription sub = bus.subscribe<TemperatureTopic>(mbed::callback(&b, &Sink::on_float));
+        bus.publish<TemperatureTopic>(1.0f);
+    }
+    bus.publish<TemperatureTopic>(2.0f);
+    bus.unsubscribe<TemperatureTopic>(mbed::callback(&a, &Sink::on_float));
+    bus.publish<TemperatureTopic>(3.0f);
+
+    EXPECT_EQ(2, a.count);
+    EXPECT_EQ(1, b.count);
+    EXPECT_EQ(3u, bus.publish_count<TemperatureTopic>());
+}
+
+/**
+ * Host benchmark of publish cost for 1-32 subscribers.
+ * Results are printed, not asserted.
+ */
+TEST_F(TestEventBus, benchmark_publish)
+{
+    const int iterations = 100000;
+    Sink sinks[32];
+
+    printf("%12s %16s\n", "subscribers", "ns per publish");
+
+    for(int subscribers = 1; subscribers <= 32; subscribers *= 2) {
+        bus_t bus;
+        for(int i = 0; i < subscribers; i++) {
+            bus.subscribe<HumidityTopic>(mbed::callback(&sinks[i], &Sink::on_float));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < iterations; i++) {
+            bus.publish<HumidityTopic>((float) i);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        printf("%12d %16.1f\n", subscribers,
+                std::chrono::duration<double, std::nano>(end - start).count() / iterations);
+
+        EXPECT_EQ((uint32_t) iterations, bus.publish_count<HumidityTopic>());
+    }
+
+    EXPECT_EQ(6 * iterations, sinks[0].count);
+}
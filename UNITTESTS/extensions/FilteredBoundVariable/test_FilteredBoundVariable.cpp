@@ -0,0 +1,195 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/FilteredBoundVariable.h"
+
+#include <chrono>
+#include <vector>
+
+/** Clock advanced by hand */
+struct ManualClock {
+    typedef std::chrono::milliseconds duration;
+    typedef duration::rep rep;
+    typedef duration::period period;
+    typedef std::chrono::time_point<ManualClock> time_point;
+    static const bool is_steady = true;
+
+    static time_point now() {
+        return current;
+    }
+
+    static void advance(duration elapsed) {
+        current += elapsed;
+    }
+
+    static time_point current;
+};
+
+ManualClock::time_point ManualClock::current;
+
+template<typename T>
+class Recorder {
+
+public:
+
+    void record(T value) {
+        values.push_back(value);
+    }
+
+    std::vector<T> values;
+
+};
+
+/**
+ * Test for FilteredBoundVariable extension
+ */
+class TestFilteredBoundVariable : public testing::Test {
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+};
+
+TEST_F(TestFilteredBoundVariable, unchanged_values_are_suppressed)
+{
+    ep::FilteredBoundVariable<int, ManualClock> variable(1);
+    Recorder<int> recorder;
+    variable.attach(mbed::callback(&recorder, &Recorder<int>::record));
+
+    variable = 1;
+    variable = 2;
+    variable = 2;
+    variable = 3;
+
+    EXPECT_EQ(std::vector<int>({ 2, 3 }), recorder.values);
+    EXPECT_EQ(2u, variable.suppressed_count());
+    EXPECT_EQ(2u, variable.notify_count());
+}
+
+TEST_F(TestFilteredBoundVariable, deadband_is_relative_to_last_notified_value)
+{
+    ep::FilteredBoundVariable<float, ManualClock> variable(20.0f);
+    Recorder<float> recorder;
+    variable.attach(mbed::callback(&recorder, &Recorder<float>::record));
+    variable.set_deadband(0.5f);
+
+    /** Noise around the last notified value does not chatter */
+    variable = 20.3f;
+    variable = 19.7f;
+    variable = 20.4f;
+    EXPECT_TRUE(recorder.values.empty());
+    EXPECT_FLOAT_EQ(20.4f, variable.get());
+
+    /** Slow drift is reported once it leaves the band */
+    variable = 20.6f;
+    ASSERT_EQ(1u, recorder.values.size());
+    EXPECT_FLOAT_EQ(20.6f, recorder.values[0]);
+
+    /** Relative band: 10% of 20.6 */
+    variable.set_deadband(0.0f, 0.1f);
+    variable = 22.5f;
+    EXPECT_EQ(1u, recorder.values.size());
+    variable = 22.8f;
+    EXPECT_EQ(2u, recorder.values.size());
+}
+
+TEST_F(TestFilteredBoundVariable, rate_limit_coalesces_to_latest_value)
+{
+    ep::FilteredBoundVariable<int, ManualClock> variable(0);
+    Recorder<int> recorder;
+    variable.attach(mbed::callback(&recorder, &Recorder<int>::record));
+    variable.set_min_interval(std::chrono::milliseconds(100));
+
+    variable = 1;
+    ManualClock::advance(std::chrono::milliseconds(10));
+    variable = 2;
+    variable = 3;
+    EXPECT_EQ(std::vector<int>({ 1 }), recorder.values);
+    EXPECT_EQ(1u, variable.rate_limited_count());
+
+    /** Without a queue the pending value goes out on flush() */
+    variable.flush();
+    EXPECT_EQ(std::vector<int>({ 1, 3 }), recorder.values);
+    variable.flush();
+    EXPECT_EQ(2u, recorder.values.size());
+
+    /** Or on the first set() after the interval */
+    ManualClock::advance(std::chrono::milliseconds(50));
+    variable = 4;
+    ManualClock::advance(std::chrono::milliseconds(100));
+    variable = 5;
+    EXPECT_EQ(std::vector<int>({ 1, 3, 5 }), recorder.values);
+}
+
+TEST_F(TestFilteredBoundVariable, returning_to_notified_value_drops_pending)
+{
+    ep::FilteredBoundVariable<int, ManualClock> variable(0);
+    Recorder<int> recorder;
+    variable.attach(mbed::callback(&recorder, &Recorder<int>::record));
+    variable.set_min_interval(std::chrono::milliseconds(100));
+
+    variable = 1;
+    variable = 2;
+    variable = 1;
+    variable.flush();
+    EXPECT_EQ(std::vector<int>({ 1 }), recorder.values);
+}
+
+TEST_F(TestFilteredBoundVariable, queue_flushes_pending_value)
+{
+    events::EventQueue queue;
+    ep::FilteredBoundVariable<int, ManualClock> variable(0, &queue);
+    Recorder<int> recorder;
+    variable.attach(mbed::callback(&recorder, &Recorder<int>::record));
+    variable.set_min_interval(std::chrono::milliseconds(10));
+
+    variable = 1;
+    variable = 2;
+    queue.dispatch_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(std::vector<int>({ 1, 2 }), recorder.values);
+}
+
+TEST_F(TestFilteredBoundVariable, destruction_cancels_scheduled_flush)
+{
+    events::EventQueue queue;
+    Recorder<int> recorder;
+
+    ep::FilteredBoundVariable<int, ManualClock> *variable =
+            new ep::FilteredBoundVariable<int, ManualClock>(0, &queue);
+    variable->attach(mbed::callback(&recorder, &Recorder<int>::record));
+    variable->set_min_interval(std::chrono::milliseconds(10));
+
+    *variable = 1;
+    *variable = 2;
+    delete variable;
+
+    queue.dispatch_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(std::vector<int>({ 1 }), recorder.values);
+}
@@ -0,0 +1,171 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/HistoryBoundVariable.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+
+/**
+ * Test for HistoryBoundVariable extension
+ *
+ * Statistics are checked against a brute-force scan of a reference window.
+ */
+class TestHistoryBoundVariable : public testing::Test {
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+public:
+
+    struct tri_axis_reading_t {
+        typedef float component_type;
+        float x;
+        float y;
+        float z;
+    };
+
+    struct raw_tri_axis_reading_t {
+        typedef int32_t component_type;
+        int32_t x;
+        int32_t y;
+        int32_t z;
+    };
+
+    void on_update(float) {
+        _mean_in_callback = _history->mean();
+    }
+
+    ep::HistoryBoundVariable<float, 4> *_history;
+    float _mean_in_callback;
+
+};
+
+TEST_F(TestHistoryBoundVariable, empty_history)
+{
+    ep::HistoryBoundVariable<float, 8> var(5.0f);
+
+    EXPECT_EQ(0u, var.size());
+    EXPECT_EQ(5.0f, var.get());
+    EXPECT_EQ(0.0f, var.mean());
+    EXPECT_EQ(0.0f, var.variance());
+    EXPECT_EQ(0.0f, var.min());
+    EXPECT_EQ(0.0f, var.max());
+}
+
+TEST_F(TestHistoryBoundVariable, ring_keeps_last_values)
+{
+    ep::HistoryBoundVariable<int, 3> var;
+
+    for(int i = 1; i <= 5; i++) {
+        var = i;
+    }
+
+    EXPECT_TRUE(var.full());
+    ASSERT_EQ(3u, var.size());
+    EXPECT_EQ(5, var.at(0));
+    EXPECT_EQ(4, var.at(1));
+    EXPECT_EQ(3, var.at(2));
+}
+
+TEST_F(TestHistoryBoundVariable, rolling_statistics_match_brute_force)
+{
+    const size_t window = 7;
+    ep::HistoryBoundVariable<float, window> var;
+    std::deque<float> reference;
+
+    srand(1234);
+    for(int i = 0; i < 1000; i++) {
+        float value = (float) (rand() % 2000 - 1000) / 10.0f;
+        var = value;
+        reference.push_back(value);
+        if(reference.size() > window) {
+            reference.pop_front();
+        }
+
+        float mean = 0.0f;
+        for(float v : reference) {
+            mean += v;
+        }
+        mean /= reference.size();
+        float variance = 0.0f;
+        for(float v : reference) {
+            variance += (v - mean) * (v - mean);
+        }
+        variance /= reference.size();
+
+        ASSERT_NEAR(mean, var.mean(), 1e-2f);
+        ASSERT_NEAR(variance, var.variance(), 1.0f);
+        ASSERT_EQ(*std::min_element(reference.begin(), reference.end()), var.min());
+        ASSERT_EQ(*std::max_element(reference.begin(), reference.end()), var.max());
+    }
+}
+
+TEST_F(TestHistoryBoundVariable, tri_axis_components)
+{
+    ep::HistoryBoundVariable<tri_axis_reading_t, 2> var;
+    size_t components = var.components;
+    ASSERT_EQ(3u, components);
+
+    var = tri_axis_reading_t { 1.0f, 10.0f, -1.0f };
+    var = tri_axis_reading_t { 3.0f, 20.0f, -5.0f };
+
+    EXPECT_FLOAT_EQ(2.0f, var.mean(0));
+    EXPECT_FLOAT_EQ(15.0f, var.mean(1));
+    EXPECT_FLOAT_EQ(-3.0f, var.mean(2));
+    EXPECT_FLOAT_EQ(25.0f, var.variance(1));
+    EXPECT_EQ(-5.0f, var.min(2));
+    EXPECT_EQ(20.0f, var.max(1));
+}
+
+TEST_F(TestHistoryBoundVariable, integer_components)
+{
+    ep::HistoryBoundVariable<raw_tri_axis_reading_t, 2> var;
+
+    var = raw_tri_axis_reading_t { 100, -2000, 7 };
+    var = raw_tri_axis_reading_t { 300, -1000, 9 };
+
+    EXPECT_FLOAT_EQ(200.0f, var.mean(0));
+    EXPECT_FLOAT_EQ(-1500.0f, var.mean(1));
+    EXPECT_EQ(-2000.0f, var.min(1));
+    EXPECT_EQ(9.0f, var.max(2));
+}
+
+TEST_F(TestHistoryBoundVariable, subscribers_see_updated_statistics)
+{
+    ep::HistoryBoundVariable<float, 4> var;
+    _history = &var;
+    var.attach(mbed::callback(this, &TestHistoryBoundVariable::on_update));
+
+    var = 2.0f;
+    var = 4.0f;
+    EXPECT_FLOAT_EQ(3.0f, _mean_in_callback);
+}
@@ -0,0 +1,215 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/JournaledCounter.h"
+
+#include <cstring>
+#include <vector>
+
+/**
+ * NOR flash stand-in: erases to 0xFF, bits can only be programmed from
+ * 1 to 0, and erases are counted per sector to check wear leveling. Like
+ * FlashIAPBlockDevice, the geometry reads 0 and accesses fail until init().
+ */
+class NorFlashStandIn : public mbed::BlockDevice {
+
+public:
+
+    static const uint32_t SECTOR_SIZE = 256;
+    static const uint32_t PROGRAM_SIZE = 4;
+
+    NorFlashStandIn(uint32_t sectors) : _data(sectors * SECTOR_SIZE, 0xFF),
+        _erase_counts(sectors, 0), _program_bytes(0), _fail_after(-1), _initialized(false) {
+    }
+
+    virtual int init() { _initialized = true; return 0; }
+    virtual int deinit() { _initialized = false; return 0; }
+
+    virtual int read(void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size) {
+        if(!_initialized) {
+            return mbed::BD_ERROR_DEVICE_ERROR;
+        }
+        memcpy(buffer, &_data[addr], size);
+        return 0;
+    }
+
+    virtual int program(const void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size) {
+        if(!_initialized) {
+            return mbed::BD_ERROR_DEVICE_ERROR;
+        }
+        const uint8_t *bytes = (const uint8_t *) buffer;
+        for(mbed::bd_size_t i = 0; i < size; i++) {
+            if(_fail_after == 0) {
+                /** Power lost part way through */
+                return mbed::BD_ERROR_DEVICE_ERROR;
+            }
+            if(_fail_after > 0) {
+                _fail_after--;
+            }
+            _data[addr + i] &= bytes[i];
+        }
+        _program_bytes += size;
+        return 0;
+    }
+
+    virtual int erase(mbed::bd_addr_t addr, mbed::bd_size_t size) {
+        if(!_initialized) {
+            return mbed::BD_ERROR_DEVICE_ERROR;
+        }
+        memset(&_data[addr], 0xFF, size);
+        for(mbed::bd_size_t sector = addr / SECTOR_SIZE; sector < (addr + size) / SECTOR_SIZE; sector++) {
+            _erase_counts[sector]++;
+        }
+        return 0;
+    }
+
+    virtual mbed::bd_size_t get_read_size() const { return _initialized ? 1 : 0; }
+    virtual mbed::bd_size_t get_program_size() const { return _initialized ? PROGRAM_SIZE : 0; }
+    virtual mbed::bd_size_t get_erase_size() const { return _initialized ? SECTOR_SIZE : 0; }
+    virtual mbed::bd_size_t get_erase_size(mbed::bd_addr_t) const { return this->get_erase_size(); }
+    virtual int get_erase_value() const { return 0xFF; }
+    virtual mbed::bd_size_t size() const { return _data.size(); }
+    virtual const char *get_type() const { return "NOR"; }
+
+    std::vector<uint8_t> _data;
+    std::vector<uint32_t> _erase_counts;
+    uint32_t _program_bytes;
+
+    /** Number of bytes programmed before the next program fails, -1 to never fail */
+    int _fail_after;
+
+    bool _initialized;
+
+};
+
+/**
+ * Test for JournaledCounter extension
+ */
+class TestJournaledCounter : public testing::Test {
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+};
+
+TEST_F(TestJournaledCounter, value_survives_reboot)
+{
+    NorFlashStandIn flash(4);
+    flash.init();
+
+    {
+        ep::JournaledCounter counter(flash, 0, flash.size());
+        ASSERT_EQ(0, counter.init());
+        EXPECT_EQ(0u, counter.get());
+        for(int i = 0; i < 10; i++) {
+            ASSERT_EQ(0, counter.increment());
+        }
+        ASSERT_EQ(0, counter.add(5));
+    }
+
+    ep::JournaledCounter counter(flash, 0, flash.size());
+    ASSERT_EQ(0, counter.init());
+    EXPECT_EQ(15u, counter.get());
+
+    ASSERT_EQ(0, counter.set(3));
+    ep::JournaledCounter rebooted(flash, 0, flash.size());
+    ASSERT_EQ(0, rebooted.init());
+    EXPECT_EQ(3u, rebooted.get());
+}
+
+TEST_F(TestJournaledCounter, compaction_levels_wear)
+{
+    NorFlashStandIn flash(4);
+    flash.init();
+    ep::JournaledCounter counter(flash, 0, flash.size());
+    ASSERT_EQ(0, counter.init());
+
+    /** 30 entries per 256-byte sector after a 16-byte header */
+    const uint32_t updates = 1000;
+    for(uint32_t i = 0; i < updates; i++) {
+        ASSERT_EQ(0, counter.increment());
+    }
+    EXPECT_EQ(updates, counter.get());
+    EXPECT_EQ(updates / 30, counter.compaction_count());
+
+    /** Erases are spread evenly over the ring */
+    for(uint32_t sector = 0; sector < 4; sector++) {
+        EXPECT_NEAR(flash._erase_counts[0], flash._erase_counts[sector], 1);
+    }
+
+    /** Each update programmed one 8-byte entry, not a whole record */
+    EXPECT_LT(flash._program_bytes, updates * 8 + (counter.compaction_count() + 1) * 16 + 1);
+
+    ep::JournaledCounter rebooted(flash, 0, flash.size());
+    ASSERT_EQ(0, rebooted.init());
+    EXPECT_EQ(updates, rebooted.get());
+}
+
+TEST_F(TestJournaledCounter, torn_entry_is_skipped)
+{
+    NorFlashStandIn flash(2);
+    flash.init();
+    ep::JournaledCounter counter(flash, 0, flash.size());
+    ASSERT_EQ(0, counter.init());
+    ASSERT_EQ(0, counter.add(7));
+
+    /** Only half of the entry gets programmed */
+    flash._fail_after = 2;
+    EXPECT_NE(0, counter.add(100));
+    flash._fail_after = -1;
+
+    ep::JournaledCounter rebooted(flash, 0, flash.size());
+    ASSERT_EQ(0, rebooted.init());
+    EXPECT_EQ(7u, rebooted.get());
+    EXPECT_EQ(1u, rebooted.torn_count());
+
+    /** Appending continues after the torn slot */
+    ASSERT_EQ(0, rebooted.increment());
+    ep::JournaledCounter again(flash, 0, flash.size());
+    ASSERT_EQ(0, again.init());
+    EXPECT_EQ(8u, again.get());
+}
+
+TEST_F(TestJournaledCounter, constructed_before_block_device_init)
+{
+    /** eg: a global counter on a FlashIAPBlockDevice */
+    NorFlashStandIn flash(2);
+    ep::JournaledCounter counter(flash, 0, flash.size());
+    EXPECT_NE(0, counter.init());
+    EXPECT_NE(0, counter.increment());
+
+    flash.init();
+    ASSERT_EQ(0, counter.init());
+    ASSERT_EQ(0, counter.add(4));
+
+    ep::JournaledCounter rebooted(flash, 0, flash.size());
+    ASSERT_EQ(0, rebooted.init());
+    EXPECT_EQ(4u, rebooted.get());
+}
@@ -0,0 +1,188 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/MappedImage.h"
+#include "extensions/MappedPersistentArray.h"
+
+#include "MappedFileBlockDevice.h"
+
+#include <unistd.h>
+
+/**
+ * Test for MappedImage and MappedPersistentArray extensions against a
+ * memory-mapped file standing in for internal flash
+ */
+class TestMappedImage : public testing::Test {
+
+    virtual void SetUp()
+    {
+        unlink(_path);
+    }
+
+    virtual void TearDown()
+    {
+        unlink(_path);
+    }
+
+public:
+
+    const char *_path = "/tmp/ep_oc_mcu_test_MappedImage.bin";
+
+};
+
+static const uint16_t default_curve[100] = { 1, 2, 3 };
+
+TEST_F(TestMappedImage, reads_in_place_and_persists)
+{
+    uint16_t curve[100];
+    for(int i = 0; i < 100; i++) {
+        curve[i] = 1000 + i;
+    }
+
+    {
+        MappedFileBlockDevice flash(_path, 4 * 4096);
+        ASSERT_EQ(0, flash.init());
+        ep::MappedImage image(flash, flash.mapped(), 0, flash.size());
+        ep::MappedPersistentArray<uint16_t, 100> table(image, mbed::make_const_Span(default_curve));
+        ASSERT_EQ(0, image.init());
+
+        EXPECT_FALSE(table.stored());
+        EXPECT_EQ(default_curve, table.get().data());
+
+        ASSERT_EQ(0, table.set(mbed::make_const_Span(curve)));
+        EXPECT_TRUE(table.stored());
+        EXPECT_EQ(1099, table.get()[99]);
+
+        /** Zero-copy: the span points into the mapped flash */
+        const uint8_t *data = (const uint8_t *) table.get().data();
+        EXPECT_GE(data, flash.mapped());
+        EXPECT_LT(data, flash.mapped() + flash.size());
+    }
+
+    MappedFileBlockDevice flash(_path, 4 * 4096);
+    ASSERT_EQ(0, flash.init());
+    ep::MappedImage image(flash, flash.mapped(), 0, flash.size());
+    ep::MappedPersistentArray<uint16_t, 100> table(image, mbed::make_const_Span(default_curve));
+    ASSERT_EQ(0, image.init());
+    EXPECT_TRUE(table.stored());
+    EXPECT_EQ(1u, image.sequence());
+    EXPECT_EQ(0, memcmp(curve, table.get().data(), sizeof(curve)));
+}
+
+TEST_F(TestMappedImage, interrupted_update_keeps_previous_image)
+{
+    MappedFileBlockDevice flash(_path, 4 * 4096);
+    ASSERT_EQ(0, flash.init());
+    ep::MappedImage image(flash, flash.mapped(), 0, flash.size());
+    ASSERT_EQ(0, image.init());
+
+    const char first[] = "first image";
+    const char second[] = "second image, never completed";
+    ASSERT_EQ(0, image.update(first, sizeof(first)));
+
+    /** Power lost while programming the data of the other slot */
+    flash.fail_after(16);
+    EXPECT_NE(0, image.update(second, sizeof(second)));
+    flash.fail_after(-1);
+    EXPECT_STREQ(first, (const char *) image.data());
+
+    ep::MappedImage rebooted(flash, flash.mapped(), 0, flash.size());
+    ASSERT_EQ(0, rebooted.init());
+    EXPECT_EQ(1u, rebooted.sequence());
+    EXPECT_STREQ(first, (const char *) rebooted.data());
+}
+
+TEST_F(TestMappedImage, streamed_update_and_corruption)
+{
+    MappedFileBlockDevice flash(_path, 4 * 4096, 4096, 16);
+    ASSERT_EQ(0, flash.init());
+    ep::MappedImage image(flash, flash.mapped(), 0, flash.size());
+    ASSERT_EQ(0, image.init());
+
+    /** Chunks that do not line up with the 16-byte program unit */
+    uint8_t blob[1000];
+    for(size_t i = 0; i < sizeof(blob); i++) {
+        blob[i] = (uint8_t) (i * 7);
+    }
+    ASSERT_EQ(0, image.begin_update(sizeof(blob)));
+    for(size_t offset = 0; offset < sizeof(blob); offset += 37) {
+        size_t chunk = (sizeof(blob) - offset < 37)? sizeof(blob) - offset : 37;
+        ASSERT_EQ(0, image.write(blob + offset, chunk));
+    }
+    ASSERT_EQ(0, image.commit_update());
+    ASSERT_EQ(0, image.update("v2", 3));
+    ASSERT_EQ(0, image.update(blob, sizeof(blob)));
+    EXPECT_EQ(3u, image.sequence());
+    EXPECT_EQ(0, memcmp(blob, image.data(), sizeof(blob)));
+
+    /** A flipped bit in the active image falls back to the previous one */
+    uint8_t *active = (uint8_t *) image.data();
+    active[500] ^= 0x01;
+    ep::MappedImage rebooted(flash, flash.mapped(), 0, flash.size());
+    ASSERT_EQ(0, rebooted.init());
+    EXPECT_EQ(2u, rebooted.sequence());
+    EXPECT_STREQ("v2", (const char *) rebooted.data());
+}
+
+TEST_F(TestMappedImage, geometry_is_read_at_init)
+{
+    /** A global image is constructed before the block device is initialized */
+    MappedFileBlockDevice flash(_path, 4 * 4096, 4096, 16);
+    ep::MappedImage image(flash, flash.mapped(), 0, flash.size());
+    EXPECT_NE(0, image.init());
+    EXPECT_EQ(0u, image.capacity());
+
+    ASSERT_EQ(0, flash.init());
+    ASSERT_EQ(0, image.init());
+    EXPECT_EQ(2 * 4096u - 32, image.capacity());
+
+    const char first[] = "first image";
+    ASSERT_EQ(0, image.update(first, sizeof(first)));
+    EXPECT_STREQ(first, (const char *) image.data());
+}
+
+TEST_F(TestMappedImage, write_after_failed_program_returns_error)
+{
+    MappedFileBlockDevice flash(_path, 4 * 4096);
+    ASSERT_EQ(0, flash.init());
+    ep::MappedImage image(flash, flash.mapped(), 0, flash.size());
+    ASSERT_EQ(0, image.init());
+
+    const char first[] = "first image";
+    ASSERT_EQ(0, image.update(first, sizeof(first)));
+
+    uint8_t blob[64];
+    memset(blob, 0x5A, sizeof(blob));
+    ASSERT_EQ(0, image.begin_update(sizeof(blob)));
+    flash.fail_after(8);
+    EXPECT_NE(0, image.write(blob, 32));
+    flash.fail_after(-1);
+
+    /** The rest of the stream is rejected, and the previous image stays active */
+    EXPECT_NE(0, image.write(blob + 32, 32));
+    EXPECT_NE(0, image.commit_update());
+    EXPECT_EQ(1u, image.sequence());
+    EXPECT_STREQ(first, (const char *) image.data());
+}
@@ -0,0 +1,137 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/PersistentVariable.h"
+
+#include "kvstore_global_api_stub.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+/**
+ * Test for PersistentArray/PersistentVariable extension against the
+ * file-backed KVStore stub
+ */
+class TestPersistentArray : public testing::Test {
+
+    virtual void SetUp()
+    {
+        kvstore_stub::config_t config = kvstore_stub::default_config();
+        config.path = _path;
+        config.size = 16 * 1024;
+        config.read_latency_us = 100;
+        config.write_latency_us = 2000;
+        config.erase_latency_us = 50000;
+        unlink(_path);
+        ASSERT_EQ(0, kvstore_stub::open(config));
+        _config = config;
+    }
+
+    virtual void TearDown()
+    {
+        kvstore_stub::close();
+        unlink(_path);
+    }
+
+public:
+
+    /** Simulate a power cycle: remap the file and drop the RAM caches */
+    void reboot()
+    {
+        kvstore_stub::close();
+        ASSERT_EQ(0, kvstore_stub::open(_config));
+        ep::PersistentVariable<uint32_t>::invalidate_all_caches();
+    }
+
+    const char *_path = "/tmp/ep_oc_mcu_test_PersistentArray.kv";
+    kvstore_stub::config_t _config;
+
+};
+
+TEST_F(TestPersistentArray, value_persists_across_reboot)
+{
+    {
+        ep::PersistentVariable<uint32_t> boot_count(0, "boot_count");
+        EXPECT_EQ(0u, boot_count.get());
+        boot_count = boot_count + 1;
+    }
+
+    this->reboot();
+
+    ep::PersistentVariable<uint32_t> boot_count(0, "boot_count");
+    EXPECT_EQ(1u, boot_count.get());
+}
+
+TEST_F(TestPersistentArray, cached_reads_skip_flash)
+{
+    ep::PersistentVariable<uint32_t> uncached(5, "uncached");
+    ep::PersistentVariable<uint32_t> cached(5, "cached", 0, true);
+    uncached.get();
+    cached.get();
+
+    kvstore_stub::reset_stats();
+    for(int i = 0; i < 100; i++) {
+        (void) (uint32_t) uncached;
+    }
+    uint64_t uncached_us = kvstore_stub::stats().simulated_us;
+
+    kvstore_stub::reset_stats();
+    for(int i = 0; i < 100; i++) {
+        (void) (uint32_t) cached;
+    }
+
+    printf("100 reads: %llu us uncached, %llu us cached (%u hits)\r\n",
+            (unsigned long long) uncached_us, (unsigned long long) kvstore_stub::stats().simulated_us,
+            cached.hit_count());
+
+    EXPECT_EQ(100u * 100, uncached_us);
+    EXPECT_EQ(0u, kvstore_stub::stats().get_count);
+    EXPECT_EQ(100u, cached.hit_count());
+}
+
+TEST_F(TestPersistentArray, write_amplification)
+{
+    ep::PersistentVariable<uint32_t> cached(0, "setpoint", 0, true);
+    cached.get();
+
+    /** Half of the sets repeat the previous value */
+    kvstore_stub::reset_stats();
+    for(uint32_t i = 0; i < 1000; i++) {
+        cached = (i / 2) + 1;
+    }
+
+    printf("1000 sets: %u flash writes, %u skipped, write amplification %.1f, %u sector erases (max %u per sector)\r\n",
+            cached.flash_write_count(), cached.skipped_write_count(), kvstore_stub::write_amplification(),
+            kvstore_stub::stats().sector_erases, kvstore_stub::max_sector_erase_count());
+
+    EXPECT_EQ(500u, cached.skipped_write_count());
+    EXPECT_EQ(500u, kvstore_stub::stats().set_count);
+    EXPECT_GT(kvstore_stub::stats().compaction_count, 0u);
+
+    /** The latest value survives compactions */
+    this->reboot();
+    ep::PersistentVariable<uint32_t> reloaded(0, "setpoint");
+    EXPECT_EQ(500u, reloaded.get());
+}
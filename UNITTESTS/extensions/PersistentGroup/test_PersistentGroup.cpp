@@ -0,0 +1,255 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/PersistentVariable.h"
+#include "extensions/PersistentGroup.h"
+
+#include "kvstore_global_api_stub.h"
+
+#include <memory>
+#include <vector>
+#include <stdio.h>
+
+/**
+ * Test for PersistentGroup extension
+ */
+class TestPersistentGroup : public testing::Test {
+
+    virtual void SetUp()
+    {
+        kv_reset("/kv/");
+        kvstore_stub::reset_stats();
+        variable_t::invalidate_all_caches();
+
+        for(int i = 0; i < VARIABLE_COUNT; i++) {
+            snprintf(_keys[i], sizeof(_keys[i]), "setting_%02d", i);
+        }
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+public:
+
+    static const int VARIABLE_COUNT = 30;
+
+    typedef ep::PersistentVariable<uint32_t> variable_t;
+
+    char _keys[VARIABLE_COUNT][16];
+
+};
+
+TEST_F(TestPersistentGroup, group_commit_saves_writes)
+{
+    std::vector<std::unique_ptr<variable_t>> separate;
+    for(int i = 0; i < VARIABLE_COUNT; i++) {
+        separate.emplace_back(new variable_t(0, _keys[i]));
+    }
+
+    kvstore_stub::reset_stats();
+    for(int i = 0; i < VARIABLE_COUNT; i++) {
+        *separate[i] = i + 100;
+    }
+    uint32_t separate_writes = kvstore_stub::stats().set_count;
+    uint32_t separate_bytes = kvstore_stub::stats().programmed_bytes;
+
+    kv_reset("/kv/");
+    ep::PersistentGroup config("config");
+    std::vector<std::unique_ptr<variable_t>> grouped;
+    for(int i = 0; i < VARIABLE_COUNT; i++) {
+        grouped.emplace_back(new variable_t(0, _keys[i]));
+        config.add(*grouped[i]);
+    }
+
+    kvstore_stub::reset_stats();
+    config.begin();
+    for(int i = 0; i < VARIABLE_COUNT; i++) {
+        *grouped[i] = i + 100;
+    }
+    EXPECT_EQ(0u, kvstore_stub::stats().set_count);
+    EXPECT_EQ(0, config.commit());
+    uint32_t grouped_writes = kvstore_stub::stats().set_count;
+    uint32_t grouped_bytes = kvstore_stub::stats().programmed_bytes;
+
+    printf("%d variables: %u writes / %u bytes separately, %u write / %u bytes grouped\r\n",
+            VARIABLE_COUNT, separate_writes, separate_bytes, grouped_writes, grouped_bytes);
+
+    EXPECT_EQ((uint32_t) VARIABLE_COUNT, separate_writes);
+    EXPECT_EQ(1u, grouped_writes);
+    EXPECT_LT(grouped_bytes, separate_bytes);
+
+    /** Committing again without changes writes nothing */
+    config.begin();
+    *grouped[0] = 100;
+    config.commit();
+    EXPECT_EQ(1u, kvstore_stub::stats().set_count);
+}
+
+TEST_F(TestPersistentGroup, load_from_packed_record)
+{
+    {
+        ep::PersistentGroup config("config");
+        variable_t a(0, "a"), b(0, "b");
+        config.add(a);
+        config.add(b);
+        config.begin();
+        a = 1;
+        b = 2;
+        config.commit();
+    }
+
+    /** Simulate a reboot */
+    variable_t::invalidate_all_caches();
+    kvstore_stub::reset_stats();
+
+    ep::PersistentGroup config("config");
+    variable_t a(0, "a"), b(0, "b");
+    config.add(a);
+    config.add(b);
+
+    EXPECT_EQ(1u, a.get());
+    EXPECT_EQ(2u, b.get());
+    EXPECT_EQ(1u, kvstore_stub::stats().get_count);
+
+    kv_info_t info;
+    EXPECT_EQ(MBED_ERROR_ITEM_NOT_FOUND, kv_get_info("a", &info));
+}
+
+TEST_F(TestPersistentGroup, member_falls_back_to_own_key)
+{
+    /** Stored by a firmware without groups */
+    {
+        variable_t legacy(0, "legacy");
+        legacy = 42;
+    }
+    variable_t::invalidate_all_caches();
+
+    ep::PersistentGroup config("config");
+    variable_t legacy(0, "legacy"), fresh(0, "fresh");
+    config.add(legacy);
+    config.add(fresh);
+
+    EXPECT_EQ(42u, legacy.get());
+
+    /** Autocommit outside a transaction moves both into the packed record */
+    fresh = 7;
+    kv_info_t info;
+    EXPECT_EQ(MBED_ERROR_ITEM_NOT_FOUND, kv_get_info("legacy", &info));
+    variable_t::invalidate_all_caches();
+
+    variable_t legacy_reloaded(0, "legacy");
+    ep::PersistentGroup reloaded("config");
+    reloaded.add(legacy_reloaded);
+    EXPECT_EQ(42u, legacy_reloaded.get());
+}
+
+TEST_F(TestPersistentGroup, setting_one_member_after_reboot_keeps_the_others)
+{
+    {
+        ep::PersistentGroup config("config");
+        variable_t a(0, "a"), b(0, "b");
+        config.add(a);
+        config.add(b);
+        config.begin();
+        a = 1;
+        b = 2;
+        config.commit();
+    }
+
+    /** Simulate a reboot, then only set a */
+    variable_t::invalidate_all_caches();
+    {
+        ep::PersistentGroup config("config");
+        variable_t a(0, "a"), b(0, "b");
+        config.add(a);
+        config.add(b);
+        config.begin();
+        a = 5;
+        EXPECT_EQ(0, config.commit());
+    }
+
+    variable_t::invalidate_all_caches();
+    ep::PersistentGroup config("config");
+    variable_t a(0, "a"), b(0, "b");
+    config.add(a);
+    config.add(b);
+    EXPECT_EQ(5u, a.get());
+    EXPECT_EQ(2u, b.get());
+}
+
+TEST_F(TestPersistentGroup, failed_write_is_reported)
+{
+    ep::PersistentGroup config("config");
+    variable_t a(0, "a");
+    config.add(a);
+    a = 1;
+
+    kvstore_stub::fail_with(MBED_ERROR_MEDIA_FULL);
+    config.begin();
+    a = 2;
+    EXPECT_EQ(MBED_ERROR_MEDIA_FULL, config.commit());
+    kvstore_stub::fail_with(0);
+
+    /** Retried on the next commit */
+    config.begin();
+    a = 2;
+    EXPECT_EQ(0, config.commit());
+    variable_t::invalidate_all_caches();
+    EXPECT_EQ(2u, a.get());
+}
+
+TEST_F(TestPersistentGroup, destroyed_member_is_removed)
+{
+    {
+        ep::PersistentGroup config("config");
+        variable_t a(0, "a");
+        config.add(a);
+        {
+            variable_t b(0, "b");
+            config.add(b);
+            b = 2;
+        }
+
+        /** Rewrites the record without touching the destroyed member */
+        a = 1;
+        EXPECT_EQ(2u, config.commit_count());
+
+        /** A member outliving its group */
+        variable_t c(0, "c");
+        {
+            ep::PersistentGroup scratch("scratch");
+            scratch.add(c);
+        }
+        c = 3;
+    }
+
+    variable_t::invalidate_all_caches();
+    ep::PersistentGroup config("config");
+    variable_t a(0, "a"), c(0, "c");
+    config.add(a);
+    EXPECT_EQ(1u, a.get());
+    EXPECT_EQ(3u, c.get());
+}
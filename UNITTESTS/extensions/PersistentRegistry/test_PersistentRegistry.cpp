@@ -0,0 +1,255 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/PersistentVariable.h"
+#include "extensions/PersistentRegistry.h"
+
+#include "kvstore_global_api_stub.h"
+
+#include <unistd.h>
+
+/**
+ * Test for PersistentRegistry extension against the file-backed KVStore stub
+ */
+class TestPersistentRegistry : public testing::Test {
+
+    virtual void SetUp()
+    {
+        kvstore_stub::config_t config = kvstore_stub::default_config();
+        config.path = _path;
+        config.size = 16 * 1024;
+        unlink(_path);
+        ASSERT_EQ(0, kvstore_stub::open(config));
+        _config = config;
+    }
+
+    virtual void TearDown()
+    {
+        kvstore_stub::close();
+        unlink(_path);
+    }
+
+public:
+
+    /** Simulate a power cycle: remap the file and drop the RAM caches */
+    void reboot()
+    {
+        kvstore_stub::close();
+        ASSERT_EQ(0, kvstore_stub::open(_config));
+        ep::PersistentVariable<uint32_t>::invalidate_all_caches();
+    }
+
+    const char *_path = "/tmp/ep_oc_mcu_test_PersistentRegistry.kv";
+    kvstore_stub::config_t _config;
+
+};
+
+/** Version 1 stored the thresholds as 4 uint8_t */
+static bool migrate_thresholds(const void *stored, size_t size, uint16_t version, void *value)
+{
+    if(version != 0 || size != 4) {
+        return false;
+    }
+    for(size_t i = 0; i < 4; i++) {
+        ((uint16_t *) value)[i] = ((const uint8_t *) stored)[i] * 10;
+    }
+    return true;
+}
+
+TEST_F(TestPersistentRegistry, boot_load_writes_defaults_once)
+{
+    {
+        ep::PersistentVariable<uint32_t> a(1, "a"), b(2, "b"), c(3, "c");
+        ep::PersistentRegistry::add(a);
+        ep::PersistentRegistry::add(b);
+        ep::PersistentRegistry::add(c);
+
+        kvstore_stub::reset_stats();
+        EXPECT_EQ(0, ep::PersistentRegistry::load_all());
+        EXPECT_EQ(3u, kvstore_stub::stats().set_count);
+        EXPECT_EQ(0u, kvstore_stub::stats().get_count);
+
+        /** Served from RAM after the boot load */
+        EXPECT_EQ(2u, b.get());
+        EXPECT_EQ(0u, kvstore_stub::stats().get_count);
+        b = 20;
+    }
+
+    this->reboot();
+
+    ep::PersistentVariable<uint32_t> a(1, "a"), b(2, "b"), c(3, "c");
+    ep::PersistentRegistry::add(a);
+    ep::PersistentRegistry::add(b);
+    ep::PersistentRegistry::add(c);
+
+    kvstore_stub::reset_stats();
+    EXPECT_EQ(0, ep::PersistentRegistry::load_all());
+    EXPECT_EQ(0u, kvstore_stub::stats().set_count);
+    EXPECT_EQ(3u, kvstore_stub::stats().get_count);
+    EXPECT_EQ(20u, b.get());
+    EXPECT_EQ(3u, kvstore_stub::stats().get_count);
+}
+
+TEST_F(TestPersistentRegistry, reload_after_invalidate_reads_only_its_key)
+{
+    uint8_t old_thresholds[4] = { 1, 2, 3, 4 };
+    ASSERT_EQ(0, kv_set("thresholds", old_thresholds, sizeof(old_thresholds), 0));
+
+    ep::PersistentArray<uint16_t, 4> thresholds(0, "thresholds");
+    ep::PersistentVariable<uint32_t> a(1, "a"), b(2, "b");
+    ep::PersistentRegistry::add(thresholds, 1, mbed::callback(migrate_thresholds));
+    ep::PersistentRegistry::add(a, 1);
+    ep::PersistentRegistry::add(b, 1);
+    EXPECT_EQ(0, ep::PersistentRegistry::load_all());
+
+    /** One read per variable, no schema or migration record */
+    ep::PersistentVariable<uint32_t>::invalidate_all_caches();
+    kvstore_stub::reset_stats();
+    EXPECT_EQ(1u, a.get());
+    EXPECT_EQ(2u, b.get());
+    EXPECT_EQ(30, thresholds.get()[2]);
+    EXPECT_EQ(3u, kvstore_stub::stats().get_count);
+    EXPECT_EQ(0u, kvstore_stub::stats().set_count);
+}
+
+TEST_F(TestPersistentRegistry, size_change_migrates_once)
+{
+    uint8_t old_thresholds[4] = { 1, 2, 3, 4 };
+    ASSERT_EQ(0, kv_set("thresholds", old_thresholds, sizeof(old_thresholds), 0));
+
+    {
+        ep::PersistentArray<uint16_t, 4> thresholds(0, "thresholds");
+        ep::PersistentRegistry::add(thresholds, 1, mbed::callback(migrate_thresholds));
+
+        uint32_t migrations = ep::PersistentRegistry::migration_count();
+        EXPECT_EQ(0, ep::PersistentRegistry::load_all());
+        EXPECT_EQ(migrations + 1, ep::PersistentRegistry::migration_count());
+        EXPECT_EQ(30, thresholds.get()[2]);
+    }
+
+    this->reboot();
+
+    ep::PersistentArray<uint16_t, 4> thresholds(0, "thresholds");
+    ep::PersistentRegistry::add(thresholds, 1, mbed::callback(migrate_thresholds));
+
+    uint32_t migrations = ep::PersistentRegistry::migration_count();
+    EXPECT_EQ(0, ep::PersistentRegistry::load_all());
+    EXPECT_EQ(migrations, ep::PersistentRegistry::migration_count());
+    EXPECT_EQ(40, thresholds.get()[3]);
+}
+
+TEST_F(TestPersistentRegistry, version_bump_without_migration_resets)
+{
+    {
+        ep::PersistentVariable<uint32_t> mode(7, "mode");
+        mode = 9;
+    }
+
+    ep::PersistentVariable<uint32_t> mode(7, "mode");
+    ep::PersistentRegistry::add(mode, 2);
+    EXPECT_EQ(0, ep::PersistentRegistry::load_all());
+    EXPECT_EQ(7u, mode.get());
+
+    /** The value is not migrated again after a reload */
+    this->reboot();
+    mode = 11;
+    this->reboot();
+    EXPECT_EQ(11u, mode.get());
+}
+TEST_F(TestPersistentRegistry, interrupted_migration_is_finished_once)
+{
+    /** Power loss before the migration record, after it, after the value, after the schema record */
+    for(unsigned writes = 0; writes < 4; writes++) {
+        kv_remove("thresholds");
+        kv_remove(ep::PersistentRegistry::SCHEMA_KEY);
+        kv_remove(ep::PersistentRegistry::MIGRATION_KEY);
+
+        uint8_t old_thresholds[4] = { 1, 2, 3, 4 };
+        ASSERT_EQ(0, kv_set("thresholds", old_thresholds, sizeof(old_thresholds), 0));
+
+        {
+            ep::PersistentArray<uint16_t, 4> thresholds(0, "thresholds");
+            ep::PersistentRegistry::add(thresholds, 1, mbed::callback(migrate_thresholds));
+
+            kvstore_stub::fail_after_writes(writes, MBED_ERROR_FAILED_OPERATION);
+            EXPECT_NE(0, ep::PersistentRegistry::load_all());
+        }
+
+        this->reboot();
+
+        {
+            ep::PersistentArray<uint16_t, 4> thresholds(0, "thresholds");
+            ep::PersistentRegistry::add(thresholds, 1, mbed::callback(migrate_thresholds));
+
+            EXPECT_EQ(0, ep::PersistentRegistry::load_all());
+            EXPECT_EQ(10, thresholds.get()[0]) << "power loss after " << writes << " writes";
+            EXPECT_EQ(40, thresholds.get()[3]) << "power loss after " << writes << " writes";
+        }
+
+        kv_info_t info;
+        EXPECT_EQ(MBED_ERROR_ITEM_NOT_FOUND, kv_get_info(ep::PersistentRegistry::MIGRATION_KEY, &info));
+
+        /** Loaded from the finished migration, not migrated again */
+        this->reboot();
+
+        ep::PersistentArray<uint16_t, 4> thresholds(0, "thresholds");
+        ep::PersistentRegistry::add(thresholds, 1, mbed::callback(migrate_thresholds));
+
+        uint32_t migrations = ep::PersistentRegistry::migration_count();
+        EXPECT_EQ(0, ep::PersistentRegistry::load_all());
+        EXPECT_EQ(migrations, ep::PersistentRegistry::migration_count());
+        EXPECT_EQ(30, thresholds.get()[2]);
+    }
+}
+
+TEST_F(TestPersistentRegistry, unregistered_versions_are_kept)
+{
+    {
+        ep::PersistentArray<uint16_t, 4> thresholds(0, "thresholds");
+        ep::PersistentRegistry::add(thresholds, 1);
+        EXPECT_EQ(0, ep::PersistentRegistry::load_all());
+        uint16_t values[4] = { 5, 6, 7, 8 };
+        thresholds.set(values);
+    }
+
+    this->reboot();
+
+    /** Only another key changes version on this boot */
+    {
+        ep::PersistentVariable<uint32_t> mode(7, "mode");
+        ep::PersistentRegistry::add(mode, 2);
+        EXPECT_EQ(0, ep::PersistentRegistry::load_all());
+    }
+
+    this->reboot();
+
+    ep::PersistentArray<uint16_t, 4> thresholds(0, "thresholds");
+    ep::PersistentRegistry::add(thresholds, 1);
+
+    uint32_t migrations = ep::PersistentRegistry::migration_count();
+    EXPECT_EQ(0, ep::PersistentRegistry::load_all());
+    EXPECT_EQ(migrations, ep::PersistentRegistry::migration_count());
+    EXPECT_EQ(7, thresholds.get()[2]);
+}
@@ -0,0 +1,247 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/PersistentVariable.h"
+#include "extensions/PersistentWriter.h"
+
+#include "kvstore_global_api_stub.h"
+
+#include <unistd.h>
+
+/**
+ * Writer whose worker is not started: the test runs its steps in place
+ */
+class ManualPersistentWriter : public ep::PersistentWriter {
+
+public:
+
+    /** One pass of the worker after it woke up for dirty entries */
+    bool run_dirty(void) {
+        return this->process(FLAG_DIRTY);
+    }
+
+    /** One pass of the worker after on_power_fail() */
+    bool run_power_fail(void) {
+        return this->process(FLAG_POWER_FAIL);
+    }
+
+    /** One pass of the worker after the destructor asked it to stop */
+    bool run_stop(void) {
+        return this->process(FLAG_STOP);
+    }
+
+};
+
+/**
+ * Test for PersistentWriter extension against the file-backed KVStore stub
+ */
+class TestPersistentWriter : public testing::Test {
+
+    virtual void SetUp()
+    {
+        kvstore_stub::config_t config = kvstore_stub::default_config();
+        config.path = _path;
+        unlink(_path);
+        ASSERT_EQ(0, kvstore_stub::open(config));
+        _config = config;
+    }
+
+    virtual void TearDown()
+    {
+        kvstore_stub::fail_with(0);
+        kvstore_stub::close();
+        unlink(_path);
+    }
+
+public:
+
+    /** Simulate a power cycle: remap the file and drop the RAM caches */
+    void reboot()
+    {
+        kvstore_stub::close();
+        ASSERT_EQ(0, kvstore_stub::open(_config));
+        ep::PersistentVariable<uint32_t>::invalidate_all_caches();
+    }
+
+    /** Value of a key as persisted, bypassing any RAM copy */
+    uint32_t persisted(const char *key)
+    {
+        ep::PersistentVariable<uint32_t> reader(0, key);
+        return reader.get();
+    }
+
+    const char *_path = "/tmp/ep_oc_mcu_test_PersistentWriter.kv";
+    kvstore_stub::config_t _config;
+
+};
+
+TEST_F(TestPersistentWriter, sets_are_coalesced_until_written)
+{
+    ManualPersistentWriter writer;
+    ep::PersistentVariable<uint32_t> setpoint(0, "setpoint");
+    setpoint.set_writer(&writer);
+
+    setpoint = 1;
+    setpoint = 2;
+    setpoint = 3;
+    EXPECT_EQ(3u, setpoint.get());
+    EXPECT_EQ(1u, writer.pending_count());
+    EXPECT_EQ(2u, writer.coalesced_count());
+    EXPECT_EQ(0u, setpoint.flash_write_count());
+
+    EXPECT_TRUE(writer.run_dirty());
+    EXPECT_EQ(0u, writer.pending_count());
+    EXPECT_EQ(1u, writer.write_count());
+    EXPECT_EQ(1u, setpoint.flash_write_count());
+
+    reboot();
+    EXPECT_EQ(3u, persisted("setpoint"));
+}
+
+TEST_F(TestPersistentWriter, flush_writes_every_dirty_entry)
+{
+    ManualPersistentWriter writer;
+    ep::PersistentVariable<uint32_t> a(0, "a"), b(0, "b");
+    a.set_writer(&writer);
+    b.set_writer(&writer);
+
+    a = 10;
+    b = 20;
+    a = 11;
+    EXPECT_EQ(2u, writer.pending_count());
+
+    writer.flush();
+    EXPECT_EQ(0u, writer.pending_count());
+    EXPECT_EQ(2u, writer.write_count());
+
+    /** Nothing left to write */
+    writer.flush();
+    EXPECT_EQ(2u, writer.write_count());
+
+    reboot();
+    EXPECT_EQ(11u, persisted("a"));
+    EXPECT_EQ(20u, persisted("b"));
+}
+
+TEST_F(TestPersistentWriter, power_fail_writes_dirty_entries_and_halts)
+{
+    ManualPersistentWriter writer;
+    ep::PersistentVariable<uint32_t> counter(0, "counter");
+    counter.set_writer(&writer);
+
+    counter = 42;
+    writer.on_power_fail();
+    EXPECT_FALSE(writer.run_power_fail());
+    EXPECT_TRUE(writer.halted());
+    EXPECT_EQ(0u, writer.pending_count());
+
+    reboot();
+    EXPECT_EQ(42u, persisted("counter"));
+}
+
+TEST_F(TestPersistentWriter, failed_write_is_retried_by_next_set)
+{
+    ManualPersistentWriter writer;
+    ep::PersistentVariable<uint32_t> setpoint(0, "setpoint");
+    setpoint.set_writer(&writer);
+
+    setpoint = 7;
+    kvstore_stub::fail_with(MBED_ERROR_FAILED_OPERATION);
+    writer.flush();
+    kvstore_stub::fail_with(0);
+    EXPECT_EQ(1u, setpoint.flash_write_count());
+
+    /** The same value again is not skipped as already persisted */
+    setpoint = 7;
+    EXPECT_EQ(0u, setpoint.skipped_write_count());
+    EXPECT_EQ(1u, writer.pending_count());
+    writer.flush();
+    EXPECT_EQ(2u, setpoint.flash_write_count());
+
+    reboot();
+    EXPECT_EQ(7u, persisted("setpoint"));
+}
+
+TEST_F(TestPersistentWriter, failed_write_keeps_new_value)
+{
+    ManualPersistentWriter writer;
+    ep::PersistentVariable<uint32_t> setpoint(0, "setpoint");
+    setpoint.set_writer(&writer);
+
+    setpoint = 7;
+    writer.flush();
+    setpoint = 8;
+
+    kvstore_stub::fail_with(MBED_ERROR_FAILED_OPERATION);
+    EXPECT_TRUE(writer.run_dirty());
+    kvstore_stub::fail_with(0);
+    EXPECT_EQ(1u, writer.failed_write_count());
+    EXPECT_EQ(1u, writer.pending_count());
+
+    /** Not reloaded from KVStore, which still holds the old value */
+    ep::PersistentVariable<uint32_t>::invalidate_all_caches();
+    EXPECT_EQ(8u, setpoint.get());
+
+    /** Written by the worker's retry */
+    EXPECT_TRUE(writer.run_dirty());
+    EXPECT_EQ(0u, writer.pending_count());
+
+    reboot();
+    EXPECT_EQ(8u, persisted("setpoint"));
+}
+
+TEST_F(TestPersistentWriter, destroyed_entry_is_written_and_removed)
+{
+    ManualPersistentWriter writer;
+    {
+        ep::PersistentVariable<uint32_t> a(0, "a"), b(0, "b");
+        a.set_writer(&writer);
+        b.set_writer(&writer);
+        a = 1;
+        b = 2;
+    }
+    EXPECT_EQ(0u, writer.pending_count());
+    EXPECT_EQ(2u, writer.write_count());
+
+    /** Nothing left that points to the destroyed entries */
+    EXPECT_TRUE(writer.run_dirty());
+    EXPECT_EQ(2u, writer.write_count());
+
+    reboot();
+    EXPECT_EQ(1u, persisted("a"));
+    EXPECT_EQ(2u, persisted("b"));
+}
+
+TEST_F(TestPersistentWriter, stop_ends_the_worker)
+{
+    ManualPersistentWriter writer;
+    ep::PersistentVariable<uint32_t> setpoint(0, "setpoint");
+    setpoint.set_writer(&writer);
+
+    setpoint = 3;
+    EXPECT_FALSE(writer.run_stop());
+    EXPECT_FALSE(writer.halted());
+    EXPECT_EQ(1u, writer.pending_count());
+}
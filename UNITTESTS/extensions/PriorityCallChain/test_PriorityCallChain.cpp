@@ -0,0 +1,154 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/PriorityCallChain.h"
+
+#include <string>
+
+/**
+ * Test for PriorityCallChain extension
+ *
+ * Each handler appends its tag to a string so the
+ * dispatch order can be checked directly.
+ */
+class TestPriorityCallChain : public testing::Test {
+
+    virtual void SetUp()
+    {
+        trace.clear();
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+public:
+
+    class Tag {
+    public:
+        Tag() : owner(NULL), tag('?') { }
+
+        void append(void) {
+            owner->trace += tag;
+        }
+
+        TestPriorityCallChain *owner;
+        char tag;
+    };
+
+    void init_tags(Tag *tags, const char *names) {
+        for(int i = 0; names[i]; i++) {
+            tags[i].owner = this;
+            tags[i].tag = names[i];
+        }
+    }
+
+    std::string trace;
+};
+
+/** Lower priority numbers run first, attach order is kept within a bucket */
+TEST_F(TestPriorityCallChain, priority_order)
+{
+    Tag tags[5];
+    init_tags(tags, "abcde");
+    ep::PriorityCallChain<8, 3> callchain;
+    callchain.attach(mbed::callback(&tags[0], &Tag::append), 2);
+    callchain.attach(mbed::callback(&tags[1], &Tag::append), 0);
+    callchain.attach(mbed::callback(&tags[2], &Tag::append), 1);
+    callchain.attach(mbed::callback(&tags[3], &Tag::append), 0);
+    callchain.attach(mbed::callback(&tags[4], &Tag::append), 2);
+    callchain.call();
+
+    EXPECT_EQ("bdcae", trace);
+}
+
+/** Detaching from the head, middle and tail of a bucket */
+TEST_F(TestPriorityCallChain, detach)
+{
+    Tag tags[4];
+    init_tags(tags, "abcd");
+    ep::PriorityCallChain<4, 2> callchain;
+    for(int i = 0; i < 4; i++) {
+        callchain.attach(mbed::callback(&tags[i], &Tag::append), 1);
+    }
+
+    callchain.detach(mbed::callback(&tags[1], &Tag::append), 1);
+    callchain.call();
+    EXPECT_EQ("acd", trace);
+
+    trace.clear();
+    callchain.detach(mbed::callback(&tags[3], &Tag::append), 1);
+    callchain.detach(mbed::callback(&tags[0], &Tag::append), 1);
+    callchain.call();
+    EXPECT_EQ("c", trace);
+
+    // Tail must be updated so appends land after the remaining link
+    trace.clear();
+    callchain.attach(mbed::callback(&tags[0], &Tag::append), 1);
+    callchain.call();
+    EXPECT_EQ("ca", trace);
+    EXPECT_EQ(2u, callchain.size());
+}
+
+/** Capacity is fixed and slots are recycled */
+TEST_F(TestPriorityCallChain, capacity)
+{
+    Tag tags[3];
+    init_tags(tags, "abc");
+    ep::PriorityCallChain<2, 2> callchain;
+    EXPECT_TRUE(callchain.attach(mbed::callback(&tags[0], &Tag::append), 1));
+    EXPECT_TRUE(callchain.attach(mbed::callback(&tags[1], &Tag::append), 1));
+    EXPECT_TRUE(callchain.full());
+    EXPECT_FALSE(callchain.attach(mbed::callback(&tags[2], &Tag::append), 0));
+
+    callchain.detach(mbed::callback(&tags[0], &Tag::append), 1);
+    EXPECT_TRUE(callchain.attach(mbed::callback(&tags[2], &Tag::append), 0));
+    callchain.call();
+    EXPECT_EQ("cb", trace);
+
+    trace.clear();
+    callchain.detach_all();
+    callchain.call();
+    EXPECT_EQ("", trace);
+    EXPECT_EQ(0u, callchain.size());
+}
+
+/** Out of range priorities are rejected without taking a slot */
+TEST_F(TestPriorityCallChain, priority_out_of_range)
+{
+    Tag tags[2];
+    init_tags(tags, "ab");
+    ep::PriorityCallChain<2, 2> callchain;
+    ep::PriorityCallChain<2, 2>::link_t link(mbed::callback(&tags[1], &Tag::append));
+    EXPECT_FALSE(callchain.attach(mbed::callback(&tags[0], &Tag::append), 2));
+    EXPECT_FALSE(callchain.attach(link, 0xFF));
+    EXPECT_EQ(0u, callchain.size());
+
+    EXPECT_TRUE(callchain.attach(link, 1));
+    callchain.detach(link, 2);
+    EXPECT_EQ(1u, callchain.size());
+    callchain.call();
+    EXPECT_EQ("b", trace);
+}
@@ -0,0 +1,180 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/QueuedBoundVariable.h"
+
+#include <vector>
+
+/** Exposes the pending event of each target queue */
+class InspectableQueuedBoundVariable : public ep::QueuedBoundVariable<int, 2> {
+
+public:
+
+    InspectableQueuedBoundVariable(int value = 0) : ep::QueuedBoundVariable<int, 2>(value) {
+    }
+
+    using ep::QueuedBoundVariable<int, 2>::operator=;
+
+    int event_id(events::EventQueue &queue) {
+        target_t *target = this->find_target(queue, false);
+        return (target ? target->event_id : 0);
+    }
+
+};
+
+class Recorder {
+
+public:
+
+    void record(int value) {
+        values.push_back(value);
+    }
+
+    std::vector<int> values;
+
+};
+
+static void ignore(void *)
+{
+}
+
+/**
+ * Test for QueuedBoundVariable extension
+ */
+class TestQueuedBoundVariable : public testing::Test {
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+};
+
+TEST_F(TestQueuedBoundVariable, queued_subscribers_get_latest_value_once)
+{
+    events::EventQueue queue;
+    InspectableQueuedBoundVariable variable;
+    Recorder inline_recorder, first, second;
+    variable.attach(mbed::callback(&inline_recorder, &Recorder::record));
+    variable.attach(mbed::callback(&first, &Recorder::record), queue);
+    variable.attach(mbed::callback(&second, &Recorder::record), queue);
+
+    variable = 1;
+    variable = 2;
+    variable = 3;
+    EXPECT_EQ(std::vector<int>({ 1, 2, 3 }), inline_recorder.values);
+    EXPECT_TRUE(first.values.empty());
+
+    queue.dispatch(0);
+    EXPECT_EQ(std::vector<int>({ 3 }), first.values);
+    EXPECT_EQ(std::vector<int>({ 3 }), second.values);
+}
+
+TEST_F(TestQueuedBoundVariable, one_event_per_queue)
+{
+    events::EventQueue queue_a, queue_b;
+    InspectableQueuedBoundVariable variable;
+    Recorder a, b;
+    variable.attach(mbed::callback(&a, &Recorder::record), queue_a);
+    variable.attach(mbed::callback(&b, &Recorder::record), queue_b);
+
+    variable = 1;
+    variable = 2;
+    queue_a.dispatch(0);
+    variable = 3;
+    queue_a.dispatch(0);
+    queue_b.dispatch(0);
+
+    EXPECT_EQ(std::vector<int>({ 2, 3 }), a.values);
+    EXPECT_EQ(std::vector<int>({ 3 }), b.values);
+
+    /** A third queue does not fit */
+    events::EventQueue queue_c;
+    Recorder c;
+    EXPECT_FALSE(variable.attach(mbed::callback(&c, &Recorder::record), queue_c).is_valid());
+}
+
+TEST_F(TestQueuedBoundVariable, event_id_life_cycle)
+{
+    events::EventQueue queue;
+    InspectableQueuedBoundVariable variable;
+    Recorder recorder;
+    variable.attach(mbed::callback(&recorder, &Recorder::record), queue);
+
+    EXPECT_EQ(0, variable.event_id(queue));
+
+    variable = 1;
+    int first = variable.event_id(queue);
+    EXPECT_GT(first, 0);
+
+    /** Coalesced into the pending event */
+    variable = 2;
+    EXPECT_EQ(first, variable.event_id(queue));
+
+    queue.dispatch(0);
+    EXPECT_EQ(0, variable.event_id(queue));
+
+    variable = 3;
+    EXPECT_GT(variable.event_id(queue), 0);
+    queue.dispatch(0);
+    EXPECT_EQ(std::vector<int>({ 2, 3 }), recorder.values);
+}
+
+TEST_F(TestQueuedBoundVariable, failed_post_is_counted_and_retried)
+{
+    /** Room for a single event of the same size, taken before the variable posts */
+    events::EventQueue queue(EVENTS_EVENT_SIZE);
+    InspectableQueuedBoundVariable variable;
+    Recorder recorder;
+    variable.attach(mbed::callback(&recorder, &Recorder::record), queue);
+
+    queue.call(mbed::callback(ignore), (void *) NULL);
+    variable = 1;
+    EXPECT_EQ(1u, variable.post_fail_count());
+    EXPECT_EQ(0, variable.event_id(queue));
+
+    queue.dispatch(0);
+    variable = 2;
+    EXPECT_GT(variable.event_id(queue), 0);
+    queue.dispatch(0);
+    EXPECT_EQ(std::vector<int>({ 2 }), recorder.values);
+}
+
+TEST_F(TestQueuedBoundVariable, destruction_cancels_pending_events)
+{
+    events::EventQueue queue;
+    Recorder recorder;
+
+    InspectableQueuedBoundVariable *variable = new InspectableQueuedBoundVariable();
+    variable->attach(mbed::callback(&recorder, &Recorder::record), queue);
+    *variable = 1;
+    delete variable;
+
+    queue.dispatch(0);
+    EXPECT_TRUE(recorder.values.empty());
+}
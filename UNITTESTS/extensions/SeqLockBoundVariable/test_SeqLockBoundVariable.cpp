@@ -0,0 +1,158 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/SeqLockBoundVariable.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**
+ * Test for SeqLockBoundVariable extension
+ *
+ * Every field of a written reading holds the same value, so a
+ * torn read shows up as a reading with mismatched fields.
+ */
+class TestSeqLockBoundVariable : public testing::Test {
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+public:
+
+    struct reading_t {
+        uint32_t x;
+        uint32_t y;
+        uint32_t z;
+        uint32_t timestamp;
+        uint32_t pad[12];
+    };
+
+    static reading_t make_reading(uint32_t value) {
+        reading_t reading;
+        reading.x = value;
+        reading.y = value;
+        reading.z = value;
+        reading.timestamp = value;
+        for(int i = 0; i < 12; i++) {
+            reading.pad[i] = value;
+        }
+        return reading;
+    }
+
+    static bool is_consistent(const reading_t &reading) {
+        for(int i = 0; i < 12; i++) {
+            if(reading.pad[i] != reading.x) {
+                return false;
+            }
+        }
+        return (reading.y == reading.x) && (reading.z == reading.x) && (reading.timestamp == reading.x);
+    }
+
+    class Counter {
+    public:
+        Counter() : count(0) { }
+
+        void on_update(reading_t) {
+            count++;
+        }
+
+        int count;
+    };
+};
+
+/** Values and notifications behave like a plain BoundVariable */
+TEST_F(TestSeqLockBoundVariable, set_get)
+{
+    Counter counter;
+    ep::SeqLockBoundVariable<reading_t> variable(make_reading(1));
+    variable.attach(mbed::callback(&counter, &Counter::on_update));
+    EXPECT_EQ(1u, variable.get().x);
+
+    variable = make_reading(2);
+    reading_t reading = variable;
+    EXPECT_EQ(2u, reading.x);
+    EXPECT_EQ(1, counter.count);
+    EXPECT_EQ(1u, variable.version());
+}
+
+/**
+ * Stress test: one writer and several readers on separate host threads.
+ * No reader may ever observe a torn or out-of-order value.
+ */
+TEST_F(TestSeqLockBoundVariable, concurrent_readers_no_torn_reads)
+{
+    const uint32_t writes = 200000;
+    const int reader_count = 3;
+
+    ep::SeqLockBoundVariable<reading_t> variable(make_reading(0));
+    std::atomic<bool> done(false);
+    std::atomic<uint32_t> torn(0);
+    std::atomic<uint32_t> backwards(0);
+    std::atomic<uint64_t> reads(0);
+
+    std::vector<std::thread> readers;
+    for(int r = 0; r < reader_count; r++) {
+        readers.push_back(std::thread([&]() {
+            uint32_t last = 0;
+            uint64_t local_reads = 0;
+            while(!done.load()) {
+                reading_t reading = variable.get();
+                if(!is_consistent(reading)) {
+                    torn++;
+                }
+                if(reading.x < last) {
+                    backwards++;
+                }
+                last = reading.x;
+                local_reads++;
+            }
+            reads += local_reads;
+        }));
+    }
+
+    std::thread writer([&]() {
+        for(uint32_t i = 1; i <= writes; i++) {
+            variable.set(make_reading(i));
+        }
+        done = true;
+    });
+
+    writer.join();
+    for(std::thread &reader : readers) {
+        reader.join();
+    }
+
+    EXPECT_EQ(0u, torn.load());
+    EXPECT_EQ(0u, backwards.load());
+    EXPECT_GT(reads.load(), 0u);
+    EXPECT_EQ(writes, variable.get().x);
+    EXPECT_EQ(writes, variable.version());
+}
@@ -0,0 +1,296 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/SerialCOBS/SerialCOBS.h"
+
+#include "cobsr.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <errno.h>
+#include <stdio.h>
+
+/** Never called, the loopback file handle is non-blocking */
+void thread_sleep_for(uint32_t millisec)
+{
+}
+
+/**
+ * Non-blocking loopback serial port: bytes written are read back, at most
+ * `burst` bytes per read() to model what arrives between two polls. Every
+ * read() takes a mutex like BufferedSerial does.
+ */
+class LoopbackFileHandle : public mbed::FileHandle {
+
+public:
+
+    LoopbackFileHandle(size_t burst = SIZE_MAX) : _burst(burst), _position(0), _read_count(0) {
+    }
+
+    virtual ssize_t read(void *buffer, size_t size) {
+        _mutex.lock();
+        size_t count = std::min(std::min(size, _burst), _wire.size() - _position);
+        memcpy(buffer, _wire.data() + _position, count);
+        _position += count;
+        _read_count++;
+        _mutex.unlock();
+        return (count ? (ssize_t) count : -EAGAIN);
+    }
+
+    virtual ssize_t write(const void *buffer, size_t size) {
+        const char *bytes = static_cast<const char *>(buffer);
+        _wire.insert(_wire.end(), bytes, bytes + size);
+        return size;
+    }
+
+    virtual off_t seek(off_t offset, int whence = SEEK_SET) {
+        return -ESPIPE;
+    }
+
+    virtual int close() {
+        return 0;
+    }
+
+    virtual bool is_blocking() const {
+        return false;
+    }
+
+    bool drained(void) const {
+        return _position == _wire.size();
+    }
+
+    void rewind_wire(void) {
+        _position = 0;
+    }
+
+    size_t _burst;
+    std::vector<char> _wire;
+    size_t _position;
+    uint32_t _read_count;
+    PlatformMutex _mutex;
+
+};
+
+/**
+ * The RX path SerialCOBS had before it read in chunks: one read() of the
+ * underlying file handle per byte, kept to benchmark against
+ */
+class ByteAtATimeSerialCOBS : public SerialCOBS {
+
+public:
+
+    ByteAtATimeSerialCOBS(mbed::FileHandle &fh) : SerialCOBS(fh) {
+    }
+
+    ssize_t read_bytewise(void *buffer, size_t size) {
+        char *ptr = static_cast<char *>(buffer);
+        size_t data_read = 0;
+
+        _mutex.lock();
+        if(_output_buf.empty()) {
+            this->read_and_decode_byte();
+        }
+        if(_output_buf.empty()) {
+            _mutex.unlock();
+            return -EAGAIN;
+        }
+        while(data_read < size && !_output_buf.empty()) {
+            _output_buf.pop(*ptr++);
+            data_read++;
+        }
+        _mutex.unlock();
+
+        return data_read;
+    }
+
+protected:
+
+    void read_and_decode_byte(void) {
+        char rx_byte;
+        if(_fh.read(&rx_byte, 1) != 1) {
+            return;
+        }
+
+        if(rx_byte == '\0') {
+            char decode_buf[MBED_CONF_SERIALCOBS_RXBUF_SIZE];
+            cobsr_decode_result result = cobsr_decode(
+                    decode_buf, MBED_CONF_SERIALCOBS_RXBUF_SIZE,
+                    _staging_buf, _staging_index);
+            if(result.status == COBSR_DECODE_OK) {
+                for(unsigned int i = 0; i < result.out_len; i++) {
+                    _output_buf.push(decode_buf[i]);
+                }
+            }
+            _staging_index = 0;
+        } else {
+            _staging_buf[_staging_index++] = rx_byte;
+            if(_staging_index >= MBED_CONF_SERIALCOBS_RXBUF_SIZE) {
+                _staging_index = 0;
+            }
+        }
+    }
+
+};
+
+/** Random frames of 1 to max_size bytes, zeros included */
+static std::vector<std::vector<char>> make_frames(size_t count, size_t max_size, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::vector<std::vector<char>> frames(count);
+    for(auto &frame : frames) {
+        frame.resize(1 + random() % max_size);
+        for(auto &byte : frame) {
+            byte = (random() % 8 == 0) ? 0 : (char) random();
+        }
+    }
+    return frames;
+}
+
+/** Read until the loopback is drained, returns the decoded stream */
+template<typename Read>
+static std::vector<char> read_all(LoopbackFileHandle &loopback, Read read)
+{
+    std::vector<char> decoded;
+    char buffer[MBED_CONF_SERIALCOBS_RXBUF_SIZE];
+    while(true) {
+        ssize_t count = read(buffer, sizeof(buffer));
+        if(count > 0) {
+            decoded.insert(decoded.end(), buffer, buffer + count);
+        } else if(loopback.drained()) {
+            break;
+        }
+    }
+    return decoded;
+}
+
+/**
+ * Test for SerialCOBS extension
+ */
+class TestSerialCOBS : public testing::Test {
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+};
+
+TEST_F(TestSerialCOBS, frames_split_across_and_packed_into_reads)
+{
+    const size_t bursts[] = { 1, 3, 100, SIZE_MAX };
+
+    for(size_t burst : bursts) {
+        LoopbackFileHandle loopback(burst);
+        SerialCOBS cobs(loopback);
+
+        std::vector<char> expected;
+        for(auto &frame : make_frames(200, 100, burst)) {
+            ASSERT_EQ((ssize_t) frame.size(), cobs.write(frame.data(), frame.size()));
+            expected.insert(expected.end(), frame.begin(), frame.end());
+        }
+
+        std::vector<char> decoded = read_all(loopback, [&](char *buffer, size_t size) {
+            return cobs.read(buffer, size);
+        });
+        EXPECT_EQ(expected, decoded) << "burst " << burst;
+    }
+}
+
+TEST_F(TestSerialCOBS, overflowed_frame_is_dropped_until_next_delimiter)
+{
+    LoopbackFileHandle loopback(64);
+    SerialCOBS cobs(loopback);
+
+    /** A frame longer than the staging buffer */
+    std::vector<char> garbage(MBED_CONF_SERIALCOBS_RXBUF_SIZE + 10, 0x01);
+    garbage.push_back('\0');
+    loopback.write(garbage.data(), garbage.size());
+
+    const char frame[] = "after";
+    cobs.write(frame, sizeof(frame));
+
+    std::vector<char> decoded = read_all(loopback, [&](char *buffer, size_t size) {
+        return cobs.read(buffer, size);
+    });
+    EXPECT_EQ(std::vector<char>(frame, frame + sizeof(frame)), decoded);
+}
+
+/**
+ * 1 Mbaud 8N1 is 100 kB/s, or 100 bytes per read() when the port is polled
+ * every millisecond. Bursts of 1 byte model polling as fast as bytes arrive.
+ */
+TEST_F(TestSerialCOBS, benchmark_loopback_throughput)
+{
+    const size_t bursts[] = { 1, 16, 100, 256 };
+    const double baud_1m_bytes_per_s = 100000.0;
+
+    printf("burst | byte-at-a-time: MB/s  fh reads  %%cpu@1Mbaud | chunked: MB/s  fh reads  %%cpu@1Mbaud\r\n");
+
+    for(size_t burst : bursts) {
+        LoopbackFileHandle loopback(burst);
+        ByteAtATimeSerialCOBS cobs(loopback);
+
+        std::vector<char> expected;
+        for(auto &frame : make_frames(20000, 200, 1)) {
+            cobs.write(frame.data(), frame.size());
+            expected.insert(expected.end(), frame.begin(), frame.end());
+        }
+        double wire_bytes = loopback._wire.size();
+
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<char> before = read_all(loopback, [&](char *buffer, size_t size) {
+            return cobs.read_bytewise(buffer, size);
+        });
+        double before_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        uint32_t before_reads = loopback._read_count;
+
+        loopback.rewind_wire();
+        loopback._read_count = 0;
+        begin = std::chrono::steady_clock::now();
+        std::vector<char> after = read_all(loopback, [&](char *buffer, size_t size) {
+            return cobs.read(buffer, size);
+        });
+        double after_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        uint32_t after_reads = loopback._read_count;
+
+        printf("%5u | %20.1f  %8u  %11.3f | %13.1f  %8u  %11.3f\r\n", (unsigned) burst,
+                wire_bytes / before_s / 1e6, (unsigned) before_reads, 100.0 * baud_1m_bytes_per_s * before_s / wire_bytes,
+                wire_bytes / after_s / 1e6, (unsigned) after_reads, 100.0 * baud_1m_bytes_per_s * after_s / wire_bytes);
+
+        EXPECT_EQ(expected, before);
+        EXPECT_EQ(expected, after);
+
+        /** One file handle read per burst instead of one per byte */
+        if(burst > 1) {
+            EXPECT_LT(after_reads, before_reads);
+        }
+    }
+}
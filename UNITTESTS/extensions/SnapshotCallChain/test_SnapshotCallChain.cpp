@@ -0,0 +1,146 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/SnapshotCallChain.h"
+
+/**
+ * Test for SnapshotCallChain extension
+ *
+ * Handlers modify the chain they are being called from
+ */
+class TestSnapshotCallChain : public testing::Test {
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+public:
+
+    typedef ep::SnapshotCallChain<4> chain_t;
+
+    class Handler {
+    public:
+        Handler() : chain(NULL), other(NULL), count(0) { }
+
+        void count_only(void) {
+            count++;
+        }
+
+        void detach_self(void) {
+            count++;
+            EXPECT_TRUE(chain->detach(mbed::callback(this, &Handler::detach_self)));
+        }
+
+        void detach_other(void) {
+            count++;
+            EXPECT_TRUE(chain->detach(mbed::callback(other, &Handler::count_only)));
+        }
+
+        void attach_other(void) {
+            count++;
+            EXPECT_TRUE(chain->attach(mbed::callback(other, &Handler::count_only)));
+        }
+
+        chain_t *chain;
+        Handler *other;
+        int count;
+    };
+};
+
+/** A handler can unsubscribe itself during dispatch */
+TEST_F(TestSnapshotCallChain, detach_self)
+{
+    chain_t chain;
+    Handler a, b;
+    a.chain = &chain;
+    chain.attach(mbed::callback(&a, &Handler::detach_self));
+    chain.attach(mbed::callback(&b, &Handler::count_only));
+
+    chain.call();
+    chain.call();
+
+    EXPECT_EQ(1, a.count);
+    EXPECT_EQ(2, b.count);
+    EXPECT_EQ(1u, chain.size());
+    EXPECT_TRUE(chain.is_quiescent());
+}
+
+/** Detaching a later handler takes effect on the next dispatch */
+TEST_F(TestSnapshotCallChain, detach_other)
+{
+    chain_t chain;
+    Handler a, b;
+    a.chain = &chain;
+    a.other = &b;
+    chain.attach(mbed::callback(&a, &Handler::detach_other));
+    chain.attach(mbed::callback(&b, &Handler::count_only));
+
+    chain.call();
+    EXPECT_EQ(1, b.count);
+
+    chain.call();
+    EXPECT_EQ(2, a.count);
+    EXPECT_EQ(1, b.count);
+}
+
+/** Attaching during dispatch is not visible until the next call */
+TEST_F(TestSnapshotCallChain, attach_during_call)
+{
+    chain_t chain;
+    Handler a, b;
+    a.chain = &chain;
+    a.other = &b;
+    chain.attach(mbed::callback(&a, &Handler::attach_other));
+
+    chain.call();
+    EXPECT_EQ(0, b.count);
+
+    chain.call();
+    EXPECT_EQ(1, b.count);
+    EXPECT_EQ(2u, chain.size());
+}
+
+/** Pool slots of detached links are recycled */
+TEST_F(TestSnapshotCallChain, recycle_slots)
+{
+    ep::SnapshotCallChain<2> chain;
+    Handler handlers[8];
+    for(int i = 0; i < 8; i++) {
+        EXPECT_TRUE(chain.attach(mbed::callback(&handlers[i], &Handler::count_only)));
+        chain.call();
+        EXPECT_TRUE(chain.detach(mbed::callback(&handlers[i], &Handler::count_only)));
+        EXPECT_EQ(1, handlers[i].count);
+    }
+
+    EXPECT_TRUE(chain.attach(mbed::callback(&handlers[0], &Handler::count_only)));
+    EXPECT_TRUE(chain.attach(mbed::callback(&handlers[1], &Handler::count_only)));
+    EXPECT_FALSE(chain.attach(mbed::callback(&handlers[2], &Handler::count_only)));
+    EXPECT_TRUE(chain.detach_all());
+    EXPECT_EQ(0u, chain.size());
+}
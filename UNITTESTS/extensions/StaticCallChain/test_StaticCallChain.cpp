@@ -0,0 +1,246 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/CallChain.h"
+#include "extensions/StaticCallChain.h"
+
+#include <chrono>
+#include <stdio.h>
+
+/**
+ * Test for StaticCallChain extension
+ *
+ * Links record the order they were called in so dispatch
+ * order can be checked along with execution.
+ */
+class TestStaticCallChain : public testing::Test {
+
+    virtual void SetUp()
+    {
+        order_index = 0;
+        for(int i = 0; i < 8; i++) {
+            order[i] = -1;
+        }
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+public:
+
+    class Recorder {
+    public:
+        Recorder() : owner(NULL), id(0) { }
+
+        void record(void) {
+            owner->order[owner->order_index++] = id;
+        }
+
+        TestStaticCallChain *owner;
+        int id;
+    };
+
+    /** Link subclass that only forwards values above its threshold */
+    class ThresholdLink : public ep::CallChainLink<int> {
+    public:
+        ThresholdLink(mbed::Callback<void(int)> cb, int threshold) :
+            ep::CallChainLink<int>(cb), threshold(threshold) { }
+
+        virtual void call(int value) {
+            if(value > threshold) {
+                this->cb.call(value);
+            }
+        }
+
+        int threshold;
+    };
+
+    class Counter {
+    public:
+        Counter() : count(0) { }
+
+        void increment(int) {
+            count++;
+        }
+
+        void tick(void) {
+            count++;
+        }
+
+        int count;
+    };
+
+    void init_recorders(Recorder *recorders, int n) {
+        for(int i = 0; i < n; i++) {
+            recorders[i].owner = this;
+            recorders[i].id = i;
+        }
+    }
+
+    int order[8];
+    int order_index;
+};
+
+/** Links are dispatched in attach order */
+TEST_F(TestStaticCallChain, dispatch_order)
+{
+    Recorder recorders[3];
+    init_recorders(recorders, 3);
+    ep::StaticCallChain<4> callchain;
+    callchain.attach(mbed::callback(&recorders[2], &Recorder::record));
+    callchain.attach(mbed::callback(&recorders[0], &Recorder::record));
+    callchain.attach(mbed::callback(&recorders[1], &Recorder::record));
+    callchain.call();
+
+    EXPECT_EQ(3, order_index);
+    EXPECT_EQ(2, order[0]);
+    EXPECT_EQ(0, order[1]);
+    EXPECT_EQ(1, order[2]);
+}
+
+/** Detaching preserves the order of the remaining links */
+TEST_F(TestStaticCallChain, detach_middle)
+{
+    Recorder recorders[3];
+    init_recorders(recorders, 3);
+    ep::StaticCallChain<4> callchain;
+    callchain.attach(mbed::callback(&recorders[0], &Recorder::record));
+    callchain.attach(mbed::callback(&recorders[1], &Recorder::record));
+    callchain.attach(mbed::callback(&recorders[2], &Recorder::record));
+    callchain.detach(mbed::callback(&recorders[1], &Recorder::record));
+    callchain.call();
+
+    EXPECT_EQ(2, order_index);
+    EXPECT_EQ(0, order[0]);
+    EXPECT_EQ(2, order[1]);
+    EXPECT_EQ(2u, callchain.size());
+}
+
+/** Attaching past capacity fails, freed slots can be reused */
+TEST_F(TestStaticCallChain, capacity)
+{
+    Recorder recorders[3];
+    init_recorders(recorders, 3);
+    ep::StaticCallChain<2> callchain;
+    EXPECT_TRUE(callchain.attach(mbed::callback(&recorders[0], &Recorder::record)));
+    EXPECT_TRUE(callchain.attach(mbed::callback(&recorders[1], &Recorder::record)));
+    EXPECT_TRUE(callchain.full());
+    EXPECT_FALSE(callchain.attach(mbed::callback(&recorders[2], &Recorder::record)));
+
+    // Duplicates are accepted without taking a slot
+    EXPECT_TRUE(callchain.attach(mbed::callback(&recorders[1], &Recorder::record)));
+
+    callchain.detach(mbed::callback(&recorders[0], &Recorder::record));
+    EXPECT_TRUE(callchain.attach(mbed::callback(&recorders[2], &Recorder::record)));
+    callchain.call();
+
+    EXPECT_EQ(2, order_index);
+    EXPECT_EQ(1, order[0]);
+    EXPECT_EQ(2, order[1]);
+}
+
+/** Subclassed links are dispatched through their virtual call */
+TEST_F(TestStaticCallChain, virtual_links)
+{
+    Counter low, high;
+    ThresholdLink low_link(mbed::callback(&low, &Counter::increment), 10);
+    ThresholdLink high_link(mbed::callback(&high, &Counter::increment), 100);
+    ep::StaticCallChain<2, int> callchain;
+    callchain.attach(low_link);
+    callchain.attach(high_link);
+
+    callchain.call(5);
+    callchain.call(50);
+    callchain.call(500);
+
+    EXPECT_EQ(2, low.count);
+    EXPECT_EQ(1, high.count);
+
+    callchain.detach(low_link);
+    callchain.call(500);
+
+    EXPECT_EQ(2, low.count);
+    EXPECT_EQ(2, high.count);
+}
+
+/** Detach all links */
+TEST_F(TestStaticCallChain, detach_all)
+{
+    Counter counter;
+    ThresholdLink link(mbed::callback(&counter, &Counter::increment), 0);
+    Counter plain;
+    ep::StaticCallChain<2, int> callchain;
+    callchain.attach(link);
+    callchain.attach(mbed::callback(&plain, &Counter::increment));
+    callchain.detach_all();
+    callchain.call(1);
+
+    EXPECT_EQ(0, counter.count);
+    EXPECT_EQ(0, plain.count);
+    EXPECT_EQ(0u, callchain.size());
+}
+
+template<typename Chain>
+static double ns_per_dispatch(Chain &chain, int iterations)
+{
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; i++) {
+        chain.call();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+/**
+ * Host benchmark of per-dispatch cost for CallChain vs StaticCallChain
+ *
+ * Results are printed, not asserted, since they depend on the host
+ */
+TEST_F(TestStaticCallChain, benchmark_dispatch)
+{
+    const int iterations = 100000;
+    Counter counters[64];
+
+    printf("%8s %18s %18s\n", "links", "CallChain ns", "StaticCallChain ns");
+
+    for(int links = 1; links <= 64; links *= 2) {
+        ep::CallChain<> dynamic_chain;
+        ep::StaticCallChain<64> static_chain;
+
+        for(int i = 0; i < links; i++) {
+            dynamic_chain.attach(mbed::callback(&counters[i], &Counter::tick));
+            static_chain.attach(mbed::callback(&counters[i], &Counter::tick));
+        }
+
+        double dynamic_ns = ns_per_dispatch(dynamic_chain, iterations);
+        double static_ns = ns_per_dispatch(static_chain, iterations);
+
+        printf("%8d %18.1f %18.1f\n", links, dynamic_ns, static_ns);
+    }
+
+    // Each chain called every counter once per iteration
+    EXPECT_EQ(2 * iterations * 7, counters[0].count);
+}
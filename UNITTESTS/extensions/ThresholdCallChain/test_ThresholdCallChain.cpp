@@ -0,0 +1,143 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/ThresholdCallChain.h"
+
+/**
+ * Test for ThresholdCallChain extension
+ */
+class TestThresholdCallChain : public testing::Test {
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+public:
+
+    class Counter {
+    public:
+        Counter() : count(0), last(0) { }
+
+        void on_crossing(float value) {
+            count++;
+            last = value;
+        }
+
+        int count;
+        float last;
+    };
+
+    typedef ep::ThresholdLink<float> link_t;
+};
+
+/** Only crossed thresholds are called, in the direction of travel */
+TEST_F(TestThresholdCallChain, crossings)
+{
+    Counter c10, c20, c30;
+    link_t l10(mbed::callback(&c10, &Counter::on_crossing), 10.0f);
+    link_t l20(mbed::callback(&c20, &Counter::on_crossing), 20.0f);
+    link_t l30(mbed::callback(&c30, &Counter::on_crossing), 30.0f);
+    ep::ThresholdCallChain<float, 4> chain;
+    chain.attach(l30);
+    chain.attach(l10);
+    chain.attach(l20);
+
+    // First value primes, no calls
+    chain.call(15.0f);
+    EXPECT_EQ(0, c10.count);
+    EXPECT_TRUE(l10.is_above());
+    EXPECT_FALSE(l20.is_above());
+
+    // Cross 20 and 30 upwards
+    chain.call(35.0f);
+    EXPECT_EQ(0, c10.count);
+    EXPECT_EQ(1, c20.count);
+    EXPECT_EQ(1, c30.count);
+    EXPECT_FLOAT_EQ(35.0f, c30.last);
+
+    // No crossing
+    chain.call(31.0f);
+    EXPECT_EQ(1, c30.count);
+
+    // Cross everything downwards
+    chain.call(0.0f);
+    EXPECT_EQ(1, c10.count);
+    EXPECT_EQ(2, c20.count);
+    EXPECT_EQ(2, c30.count);
+    EXPECT_FALSE(l10.is_above());
+}
+
+/** A link with hysteresis only re-arms once the value falls far enough */
+TEST_F(TestThresholdCallChain, hysteresis)
+{
+    Counter counter;
+    link_t link(mbed::callback(&counter, &Counter::on_crossing), 50.0f, 5.0f, link_t::RISING);
+    ep::ThresholdCallChain<float, 1> chain;
+    chain.attach(link);
+
+    chain.call(40.0f);
+    chain.call(51.0f);
+    EXPECT_EQ(1, counter.count);
+
+    // Chatter around the threshold does not re-trigger
+    chain.call(48.0f);
+    chain.call(52.0f);
+    chain.call(46.0f);
+    chain.call(50.0f);
+    EXPECT_EQ(1, counter.count);
+    EXPECT_TRUE(link.is_above());
+
+    // Falling below the release threshold re-arms without calling (rising only)
+    chain.call(44.0f);
+    EXPECT_FALSE(link.is_above());
+    EXPECT_EQ(1, counter.count);
+
+    chain.call(50.0f);
+    EXPECT_EQ(2, counter.count);
+}
+
+/** Links attached after priming start in the correct state */
+TEST_F(TestThresholdCallChain, attach_detach)
+{
+    Counter a, b;
+    link_t la(mbed::callback(&a, &Counter::on_crossing), 10.0f);
+    link_t lb(mbed::callback(&b, &Counter::on_crossing), 10.0f);
+    ep::ThresholdCallChain<float, 2> chain;
+    chain.attach(la);
+    chain.call(20.0f);
+
+    chain.attach(lb);
+    EXPECT_TRUE(lb.is_above());
+
+    chain.detach(la);
+    chain.call(0.0f);
+    EXPECT_EQ(0, a.count);
+    EXPECT_EQ(1, b.count);
+    EXPECT_EQ(1u, chain.size());
+}
@@ -0,0 +1,349 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/TimerWheel/TimerWheel.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <stdio.h>
+
+/**
+ * TimerWheel on a virtual clock: schedule() records when the hardware
+ * timeout would fire and run_until() plays the interrupts back
+ */
+class VirtualTimerWheel : public ep::TimerWheel {
+
+public:
+
+    VirtualTimerWheel() : ep::TimerWheel(std::chrono::milliseconds(1)),
+        _now(0), _fire_at(0), _armed(false), _schedule_count(0) {
+    }
+
+    /** Advance the clock, firing the hardware timeout on time */
+    void run_until(uint32_t tick) {
+        while(_armed && (int32_t) (_fire_at - tick) <= 0) {
+            _now = _fire_at;
+            _armed = false;
+            this->process();
+        }
+        _now = tick;
+    }
+
+    virtual uint32_t now(void) {
+        return _now;
+    }
+
+    virtual void schedule(uint32_t ticks) {
+        _fire_at = _now + ticks;
+        _armed = true;
+        _schedule_count++;
+    }
+
+    virtual void cancel(void) {
+        _armed = false;
+    }
+
+    uint32_t _now;
+    uint32_t _fire_at;
+    bool _armed;
+    uint32_t _schedule_count;
+
+};
+
+/** A timer remembering when it should and did expire */
+struct ProbeTimer {
+
+    ProbeTimer() : due(0), fired_at(0), fire_count(0), wheel(NULL) {
+        timer.attach(mbed::callback(this, &ProbeTimer::on_expire));
+    }
+
+    void start(VirtualTimerWheel &w, uint32_t ticks) {
+        wheel = &w;
+        due = w.now() + ticks;
+        w.start(timer, ticks);
+    }
+
+    void on_expire() {
+        fired_at = wheel->now();
+        fire_count++;
+    }
+
+    ep::SoftTimer timer;
+    uint32_t due;
+    uint32_t fired_at;
+    uint32_t fire_count;
+    VirtualTimerWheel *wheel;
+
+};
+
+/**
+ * One hardware timeout per timer, as with an mbed::Timeout each: a sorted
+ * singly linked ticker queue where insert and remove walk the list
+ */
+class TickerQueueModel {
+
+public:
+
+    struct event_t {
+        uint32_t timestamp;
+        event_t *next;
+        bool queued;
+    };
+
+    TickerQueueModel() : _head(NULL), _visits(0), _interrupts(0) {
+    }
+
+    void insert(event_t &event, uint32_t timestamp) {
+        this->remove(event);
+        event.timestamp = timestamp;
+        event_t **link = &_head;
+        while(*link && (int32_t) ((*link)->timestamp - timestamp) <= 0) {
+            link = &(*link)->next;
+            _visits++;
+        }
+        event.next = *link;
+        event.queued = true;
+        *link = &event;
+    }
+
+    void remove(event_t &event) {
+        if(!event.queued) {
+            return;
+        }
+        event_t **link = &_head;
+        while(*link != &event) {
+            link = &(*link)->next;
+            _visits++;
+        }
+        *link = event.next;
+        event.queued = false;
+    }
+
+    /** Fire every event due by now, one interrupt per distinct timestamp */
+    template<typename F>
+    void run_until(uint32_t now, F on_expire) {
+        while(_head && (int32_t) (_head->timestamp - now) <= 0) {
+            uint32_t timestamp = _head->timestamp;
+            _interrupts++;
+            while(_head && _head->timestamp == timestamp) {
+                event_t *event = _head;
+                _head = event->next;
+                event->queued = false;
+                on_expire(event);
+            }
+        }
+    }
+
+    event_t *_head;
+    uint64_t _visits;
+    uint32_t _interrupts;
+
+};
+
+/**
+ * Test for TimerWheel extension
+ */
+class TestTimerWheel : public testing::Test {
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+};
+
+TEST_F(TestTimerWheel, timers_expire_exactly_on_time)
+{
+    VirtualTimerWheel wheel;
+    std::mt19937 random(1);
+    std::vector<ProbeTimer> probes(500);
+
+    /** Durations spanning every level, started at random times */
+    for(size_t i = 0; i < probes.size(); i++) {
+        wheel.run_until(wheel.now() + random() % 50);
+        uint32_t ticks = 1 + (random() % (1 << (6 * ((i % 4) + 1))));
+        probes[i].start(wheel, ticks);
+    }
+
+    wheel.run_until(wheel.now() + ep::TimerWheel::MAX_TICKS);
+
+    for(size_t i = 0; i < probes.size(); i++) {
+        ASSERT_EQ(1u, probes[i].fire_count);
+        EXPECT_EQ(probes[i].due, probes[i].fired_at);
+    }
+    EXPECT_EQ(0u, wheel.active_count());
+    EXPECT_FALSE(wheel._armed);
+}
+
+TEST_F(TestTimerWheel, stop_and_restart)
+{
+    VirtualTimerWheel wheel;
+    ProbeTimer stopped, restarted;
+    stopped.start(wheel, 100);
+    restarted.start(wheel, 100);
+
+    wheel.run_until(50);
+    wheel.stop(stopped.timer);
+    restarted.start(wheel, 100);
+    EXPECT_FALSE(stopped.timer.active());
+
+    wheel.run_until(1000);
+    EXPECT_EQ(0u, stopped.fire_count);
+    EXPECT_EQ(1u, restarted.fire_count);
+    EXPECT_EQ(150u, restarted.fired_at);
+
+    /** The duration is rounded up to whole ticks plus one */
+    restarted.wheel = &wheel;
+    wheel.start(restarted.timer, std::chrono::microseconds(1500));
+    wheel.run_until(2000);
+    EXPECT_EQ(1003u, restarted.fired_at);
+}
+
+TEST_F(TestTimerWheel, wraps_around_the_tick_counter)
+{
+    VirtualTimerWheel wheel;
+    wheel._now = UINT32_MAX - 100;
+    ProbeTimer probe;
+    probe.start(wheel, 5000);
+    wheel.run_until(wheel.now() + 10000);
+    EXPECT_EQ(1u, probe.fire_count);
+    EXPECT_EQ(probe.due, probe.fired_at);
+}
+
+/** Repeatable sequence of random timeouts between 20 and 520 ms */
+struct TimeoutSequence {
+
+    TimeoutSequence(size_t size, uint32_t seed) : values(size), index(0) {
+        std::mt19937 random(seed);
+        for(auto &value : values) {
+            value = 20000 + random() % 500000;
+        }
+    }
+
+    uint32_t next_us() {
+        index = (index + 1) % values.size();
+        return values[index];
+    }
+
+    std::vector<uint32_t> values;
+    size_t index;
+
+};
+
+/** Benchmark timer restarting itself when it expires */
+struct BenchTimer {
+
+    BenchTimer() : wheel(NULL), timeouts(NULL), ops(NULL) {
+        timer.attach(mbed::callback(this, &BenchTimer::restart));
+    }
+
+    void restart() {
+        wheel->start(timer, std::chrono::microseconds(timeouts->next_us()));
+        (*ops)++;
+    }
+
+    ep::SoftTimer timer;
+    ep::TimerWheel *wheel;
+    TimeoutSequence *timeouts;
+    uint64_t *ops;
+
+};
+
+/**
+ * Timeouts restarted with a new random duration when they expire, and
+ * now and then kicked (restarted early), as protocol timeouts are
+ */
+TEST_F(TestTimerWheel, benchmark_concurrent_timeouts)
+{
+    const uint32_t duration = 10000;
+    const size_t counts[] = { 10, 100, 1000 };
+
+    printf("%u ms of virtual time\r\n", (unsigned) duration);
+    printf("timers | ticker queue: visits/op  interrupts   ns/op | wheel: interrupts  ns/op\r\n");
+
+    for(size_t count : counts) {
+
+        /** One hardware timeout per timer, microsecond timestamps */
+        TimeoutSequence timeouts(count * 64, count);
+        std::mt19937 kicks(count);
+        TickerQueueModel queue;
+        std::vector<TickerQueueModel::event_t> events(count);
+        uint64_t queue_ops = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for(auto &event : events) {
+            event.queued = false;
+            queue.insert(event, timeouts.next_us());
+            queue_ops++;
+        }
+        for(uint32_t now = 0; now < duration; now++) {
+            queue.run_until(now * 1000, [&](TickerQueueModel::event_t *event) {
+                queue.insert(*event, now * 1000 + timeouts.next_us());
+                queue_ops++;
+            });
+            if(now % 10 == 0) {
+                queue.insert(events[kicks() % count], now * 1000 + timeouts.next_us());
+                queue_ops++;
+            }
+        }
+        double queue_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / queue_ops;
+
+        /** All timers on one wheel with 1 ms ticks */
+        timeouts.index = 0;
+        kicks.seed(count);
+        VirtualTimerWheel wheel;
+        std::vector<BenchTimer> timers(count);
+        uint64_t wheel_ops = 0;
+        begin = std::chrono::steady_clock::now();
+        for(auto &timer : timers) {
+            timer.wheel = &wheel;
+            timer.timeouts = &timeouts;
+            timer.ops = &wheel_ops;
+            timer.restart();
+        }
+        for(uint32_t now = 0; now < duration; now++) {
+            wheel.run_until(now);
+            if(now % 10 == 0) {
+                timers[kicks() % count].restart();
+            }
+        }
+        double wheel_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / wheel_ops;
+
+        printf("%6u | %22.1f  %10u  %6.1f | %17u  %5.1f\r\n", (unsigned) count,
+                (double) queue._visits / queue_ops, queue._interrupts, queue_ns,
+                wheel.process_count(), wheel_ns);
+
+        /** At most one interrupt per tick, however many timers */
+        EXPECT_LE(wheel.process_count(), duration);
+
+        for(auto &timer : timers) {
+            wheel.stop(timer.timer);
+        }
+    }
+}
@@ -0,0 +1,199 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gtest/gtest.h"
+
+#include "extensions/TripleBufferBoundVariable.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**
+ * Test for TripleBufferBoundVariable extension
+ */
+class TestTripleBufferBoundVariable : public testing::Test {
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+public:
+
+    void on_update(int value) {
+        _updates.push_back(value);
+    }
+
+    std::vector<int> _updates;
+
+    /** Frame large enough that a torn copy would show */
+    struct frame_t {
+        uint32_t sequence;
+        uint32_t check[7];
+    };
+
+    static frame_t make_frame(uint32_t sequence) {
+        frame_t frame;
+        frame.sequence = sequence;
+        for(uint32_t &check : frame.check) {
+            check = ~sequence;
+        }
+        return frame;
+    }
+
+    static bool is_consistent(const frame_t &frame) {
+        for(uint32_t check : frame.check) {
+            if(check != ~frame.sequence) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+};
+
+TEST_F(TestTripleBufferBoundVariable, initial_value_is_not_new)
+{
+    ep::TripleBufferBoundVariable<int> var(7);
+
+    EXPECT_FALSE(var.has_new());
+    EXPECT_TRUE(var.consumed());
+    EXPECT_EQ(7, var.get());
+}
+
+TEST_F(TestTripleBufferBoundVariable, consumer_reads_latest_frame)
+{
+    ep::TripleBufferBoundVariable<int> var(0);
+
+    EXPECT_TRUE(var.publish(1));
+    EXPECT_TRUE(var.has_new());
+    EXPECT_FALSE(var.consumed());
+
+    /** Overwrites frame 1 before it is read */
+    EXPECT_FALSE(var.publish(2));
+    var = 3;
+    EXPECT_EQ(2u, var.dropped_count());
+
+    EXPECT_EQ(3, var.get());
+    EXPECT_FALSE(var.has_new());
+    EXPECT_TRUE(var.consumed());
+
+    /** Reading again returns the same frame */
+    EXPECT_EQ(3, var.get());
+
+    EXPECT_TRUE(var.publish(4));
+    EXPECT_EQ(4, (int) var);
+}
+
+TEST_F(TestTripleBufferBoundVariable, producer_never_overwrites_front)
+{
+    ep::TripleBufferBoundVariable<int> var(0);
+
+    var = 1;
+    EXPECT_EQ(1, var.get());
+
+    /** The consumer's front buffer must survive any number of publishes */
+    for(int i = 2; i < 10; i++) {
+        var = i;
+    }
+    EXPECT_EQ(9, var.get());
+}
+
+TEST_F(TestTripleBufferBoundVariable, update_calls_subscribers_in_consumer_context)
+{
+    ep::TripleBufferBoundVariable<int> var(0);
+    var.attach(mbed::callback(this, &TestTripleBufferBoundVariable::on_update));
+
+    var = 1;
+    var = 2;
+    EXPECT_TRUE(_updates.empty());
+
+    EXPECT_TRUE(var.update());
+    EXPECT_FALSE(var.update());
+    ASSERT_EQ(1u, _updates.size());
+    EXPECT_EQ(2, _updates[0]);
+}
+
+TEST_F(TestTripleBufferBoundVariable, assignment_returns_published_value)
+{
+    ep::TripleBufferBoundVariable<int> var(0);
+
+    int assigned = (var = 5);
+    EXPECT_EQ(5, assigned);
+
+    /** The returned copy is not changed by later frames */
+    var = 6;
+    EXPECT_EQ(5, assigned);
+    EXPECT_EQ(6, var.get());
+}
+
+/**
+ * Stress test: one producer and one consumer on separate host threads.
+ * The consumer may never observe a torn or out-of-order frame.
+ */
+TEST_F(TestTripleBufferBoundVariable, concurrent_producer_consumer_no_torn_frames)
+{
+    const uint32_t frames = 200000;
+
+    ep::TripleBufferBoundVariable<frame_t> var(make_frame(0));
+    std::atomic<bool> done(false);
+    std::atomic<uint32_t> torn(0);
+    std::atomic<uint32_t> backwards(0);
+    std::atomic<uint64_t> reads(0);
+
+    std::thread consumer([&]() {
+        uint32_t last = 0;
+        uint64_t local_reads = 0;
+        while(!done.load()) {
+            frame_t frame = var.get();
+            if(!is_consistent(frame)) {
+                torn++;
+            }
+            if(frame.sequence < last) {
+                backwards++;
+            }
+            last = frame.sequence;
+            local_reads++;
+        }
+        reads = local_reads;
+    });
+
+    std::thread producer([&]() {
+        for(uint32_t i = 1; i <= frames; i++) {
+            var = make_frame(i);
+        }
+        done = true;
+    });
+
+    producer.join();
+    consumer.join();
+
+    EXPECT_EQ(0u, torn.load());
+    EXPECT_EQ(0u, backwards.load());
+    EXPECT_GT(reads.load(), 0u);
+    EXPECT_EQ(frames, var.get().sequence);
+}
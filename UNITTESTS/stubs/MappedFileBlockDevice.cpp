@@ -0,0 +1,142 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "MappedFileBlockDevice.h"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFileBlockDevice::MappedFileBlockDevice(const char *path, mbed::bd_size_t size,
+        mbed::bd_size_t erase_size, mbed::bd_size_t program_size) :
+    _path(path), _size(size), _erase_size(erase_size), _program_size(program_size),
+    _fd(-1), _base(NULL), _initialized(false), _fail_after(-1), _programmed_bytes(0), _erase_count(0)
+{
+    /** Reserve the address range, the file is mapped over it by init() */
+    void *base = mmap(NULL, _size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(base != MAP_FAILED) {
+        _base = (uint8_t *) base;
+    }
+}
+
+MappedFileBlockDevice::~MappedFileBlockDevice()
+{
+    this->deinit();
+    if(_base) {
+        munmap(_base, _size);
+    }
+}
+
+int MappedFileBlockDevice::init()
+{
+    if(_initialized) {
+        return mbed::BD_ERROR_OK;
+    }
+    if(!_base) {
+        return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+
+    _fd = ::open(_path, O_RDWR | O_CREAT, 0644);
+    if(_fd < 0) {
+        return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+
+    /** A new file starts erased */
+    struct stat info;
+    bool created = (fstat(_fd, &info) == 0 && info.st_size == 0);
+    if(ftruncate(_fd, _size) != 0) {
+        ::close(_fd);
+        _fd = -1;
+        return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+
+    void *base = mmap(_base, _size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, _fd, 0);
+    if(base == MAP_FAILED) {
+        ::close(_fd);
+        _fd = -1;
+        return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+    _initialized = true;
+
+    if(created) {
+        memset(_base, 0xFF, _size);
+    }
+    return mbed::BD_ERROR_OK;
+}
+
+int MappedFileBlockDevice::deinit()
+{
+    if(_initialized) {
+        msync(_base, _size, MS_SYNC);
+        mmap(_base, _size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        _initialized = false;
+    }
+    if(_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+    return mbed::BD_ERROR_OK;
+}
+
+int MappedFileBlockDevice::read(void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size)
+{
+    if(!this->in_range(addr, size)) {
+        return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+    memcpy(buffer, _base + addr, size);
+    return mbed::BD_ERROR_OK;
+}
+
+int MappedFileBlockDevice::program(const void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size)
+{
+    if(!this->in_range(addr, size) || (addr % _program_size) || (size % _program_size)) {
+        return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+
+    const uint8_t *bytes = (const uint8_t *) buffer;
+    for(mbed::bd_size_t i = 0; i < size; i++) {
+        if(_fail_after == 0) {
+            /** Power lost part way through */
+            return mbed::BD_ERROR_DEVICE_ERROR;
+        }
+        if(_fail_after > 0) {
+            _fail_after--;
+        }
+        _base[addr + i] &= bytes[i];
+        _programmed_bytes++;
+    }
+    return mbed::BD_ERROR_OK;
+}
+
+int MappedFileBlockDevice::erase(mbed::bd_addr_t addr, mbed::bd_size_t size)
+{
+    if(!this->in_range(addr, size) || (addr % _erase_size) || (size % _erase_size)) {
+        return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+    memset(_base + addr, 0xFF, size);
+    _erase_count += size / _erase_size;
+    return mbed::BD_ERROR_OK;
+}
@@ -0,0 +1,115 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_UNITTESTS_STUBS_MAPPEDFILEBLOCKDEVICE_H_
+#define EP_OC_MCU_UNITTESTS_STUBS_MAPPEDFILEBLOCKDEVICE_H_
+
+#include "blockdevice/BlockDevice.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Host stand-in for memory-mapped internal flash (eg: FlashIAPBlockDevice)
+ * backed by a memory-mapped file.
+ *
+ * It behaves like NOR flash: it erases to 0xFF and programming can only
+ * clear bits. mapped() returns the address at which block device address 0
+ * can be read directly once initialized. Like flash at a fixed address, it
+ * is reserved at construction and stays the same across deinit() and
+ * init(). As for FlashIAPBlockDevice, the geometry reads 0 until init().
+ * Open the same file again to simulate a reboot, and use fail_after() to
+ * simulate a power loss part way through a program.
+ */
+class MappedFileBlockDevice : public mbed::BlockDevice {
+
+public:
+
+    /**
+     * @param[in] path Backing file, created erased if it does not exist
+     * @param[in] size Size of the device in bytes
+     * @param[in] erase_size Erase sector size in bytes
+     * @param[in] program_size Program unit in bytes
+     */
+    MappedFileBlockDevice(const char *path, mbed::bd_size_t size,
+            mbed::bd_size_t erase_size = 4096, mbed::bd_size_t program_size = 8);
+
+    virtual ~MappedFileBlockDevice();
+
+    virtual int init();
+    virtual int deinit();
+
+    virtual int read(void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size);
+    virtual int program(const void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size);
+    virtual int erase(mbed::bd_addr_t addr, mbed::bd_size_t size);
+
+    virtual mbed::bd_size_t get_read_size() const { return _initialized ? 1 : 0; }
+    virtual mbed::bd_size_t get_program_size() const { return _initialized ? _program_size : 0; }
+    virtual mbed::bd_size_t get_erase_size() const { return _initialized ? _erase_size : 0; }
+    virtual mbed::bd_size_t get_erase_size(mbed::bd_addr_t) const { return this->get_erase_size(); }
+    virtual int get_erase_value() const { return 0xFF; }
+    virtual mbed::bd_size_t size() const { return _size; }
+    virtual const char *get_type() const { return "MAPPEDFILE"; }
+
+    /** Address of block device address 0, readable once initialized */
+    const uint8_t *mapped() const {
+        return _base;
+    }
+
+    /** Make programming fail after the given number of bytes, -1 to never fail */
+    void fail_after(int bytes) {
+        _fail_after = bytes;
+    }
+
+    uint64_t programmed_bytes() const {
+        return _programmed_bytes;
+    }
+
+    uint32_t erase_count() const {
+        return _erase_count;
+    }
+
+protected:
+
+    bool in_range(mbed::bd_addr_t addr, mbed::bd_size_t size) const {
+        return (_initialized && addr + size <= _size);
+    }
+
+protected:
+
+    const char *_path;
+    mbed::bd_size_t _size;
+    mbed::bd_size_t _erase_size;
+    mbed::bd_size_t _program_size;
+
+    int _fd;
+    uint8_t *_base;
+    bool _initialized;
+
+    int _fail_after;
+    uint64_t _programmed_bytes;
+    uint32_t _erase_count;
+
+};
+
+#endif /* EP_OC_MCU_UNITTESTS_STUBS_MAPPEDFILEBLOCKDEVICE_H_ */
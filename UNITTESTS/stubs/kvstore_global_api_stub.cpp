@@ -0,0 +1,422 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "kvstore_global_api_stub.h"
+
+#include "kvstore_global_api.h"
+#include "platform/mbed_error.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace kvstore_stub;
+
+namespace {
+
+const uint32_t RECORD_MAGIC = 0x54444253; /* "TDBS" */
+const uint32_t TOMBSTONE_FLAG = (1UL << 31);
+
+/** Same size as a TDBStore record header */
+struct record_header_t {
+    uint32_t magic;
+    uint16_t header_size;
+    uint16_t key_size;
+    uint32_t data_size;
+    uint32_t user_flags;
+    uint32_t crc;
+    uint32_t reserved;
+};
+
+struct store_t {
+    config_t config;
+    int fd;
+    uint8_t *base;
+    size_t free_offset;
+    std::vector<uint32_t> erase_counts;
+    stats_t stats;
+    int fail_error;
+    long writes_until_fail;
+    int fail_after_error;
+};
+
+store_t store = { {}, -1, NULL, 0, {}, {}, 0, -1, 0 };
+
+/** Count a kv_set or kv_remove, false if it must fail */
+bool count_write(void)
+{
+    if(store.writes_until_fail == 0) {
+        store.fail_error = store.fail_after_error;
+        store.writes_until_fail = -1;
+    }
+    if(store.fail_error) {
+        return false;
+    }
+    if(store.writes_until_fail > 0) {
+        store.writes_until_fail--;
+    }
+    return true;
+}
+
+size_t record_size(size_t key_size, size_t data_size)
+{
+    return (sizeof(record_header_t) + key_size + data_size + 3) & ~((size_t) 3);
+}
+
+void add_latency(uint32_t us)
+{
+    store.stats.simulated_us += us;
+    if(store.config.sleep && us) {
+        usleep(us);
+    }
+}
+
+bool ensure_open(void)
+{
+    if(!store.base) {
+        kvstore_stub::open(default_config());
+    }
+    return (store.base != NULL);
+}
+
+const record_header_t *header_at(size_t offset)
+{
+    if(offset + sizeof(record_header_t) > store.config.size) {
+        return NULL;
+    }
+    const record_header_t *header = (const record_header_t *) (store.base + offset);
+    return (header->magic == RECORD_MAGIC)? header : NULL;
+}
+
+/** Offset of the newest record of a key, or -1 if absent or removed */
+long find(const char *key)
+{
+    size_t key_size = strlen(key);
+    long found = -1;
+    size_t offset = 0;
+    const record_header_t *header;
+    while((header = header_at(offset)) != NULL) {
+        if(header->key_size == key_size &&
+                memcmp(store.base + offset + sizeof(record_header_t), key, key_size) == 0) {
+            found = (header->user_flags & TOMBSTONE_FLAG)? -1 : (long) offset;
+        }
+        offset += record_size(header->key_size, header->data_size);
+    }
+    return found;
+}
+
+void erase_all(void)
+{
+    memset(store.base, 0xFF, store.config.size);
+    for(size_t sector = 0; sector < store.erase_counts.size(); sector++) {
+        store.erase_counts[sector]++;
+        store.stats.sector_erases++;
+        add_latency(store.config.erase_latency_us);
+    }
+    store.free_offset = 0;
+}
+
+void program(size_t offset, const void *data, size_t size)
+{
+    memcpy(store.base + offset, data, size);
+    store.stats.programmed_bytes += size;
+}
+
+/** Keep only the newest live record of each key, like a TDBStore garbage collection */
+void compact(void)
+{
+    std::vector<uint8_t> live;
+    size_t offset = 0;
+    const record_header_t *header;
+    while((header = header_at(offset)) != NULL) {
+        size_t size = record_size(header->key_size, header->data_size);
+        std::string key((const char *) (store.base + offset + sizeof(record_header_t)), header->key_size);
+        if(find(key.c_str()) == (long) offset) {
+            live.insert(live.end(), store.base + offset, store.base + offset + size);
+        }
+        offset += size;
+    }
+
+    erase_all();
+    program(0, live.data(), live.size());
+    store.free_offset = live.size();
+    store.stats.compaction_count++;
+}
+
+int append(const char *key, const void *buffer, size_t size, uint32_t flags)
+{
+    size_t key_size = strlen(key);
+    size_t total = record_size(key_size, size);
+    if(store.free_offset + total > store.config.size) {
+        compact();
+        if(store.free_offset + total > store.config.size) {
+            return MBED_ERROR_MEDIA_FULL;
+        }
+    }
+
+    std::vector<uint8_t> record(total, 0);
+    record_header_t header = { RECORD_MAGIC, sizeof(record_header_t), (uint16_t) key_size,
+            (uint32_t) size, flags, 0, 0 };
+    memcpy(record.data(), &header, sizeof(header));
+    memcpy(record.data() + sizeof(header), key, key_size);
+    if(size) {
+        memcpy(record.data() + sizeof(header) + key_size, buffer, size);
+    }
+
+    program(store.free_offset, record.data(), total);
+    store.free_offset += total;
+    return MBED_SUCCESS;
+}
+
+}
+
+config_t kvstore_stub::default_config(void)
+{
+    config_t config = { NULL, 64 * 1024, 4 * 1024, 0, 0, 0, false };
+    return config;
+}
+
+int kvstore_stub::open(const config_t &config)
+{
+    close();
+
+    int fd;
+    if(config.path) {
+        fd = ::open(config.path, O_RDWR | O_CREAT, 0644);
+    } else {
+        char path[] = "/tmp/kvstore_stub_XXXXXX";
+        fd = mkstemp(path);
+        if(fd >= 0) {
+            unlink(path);
+        }
+    }
+    if(fd < 0) {
+        return -1;
+    }
+
+    /** A new (or resized) file starts out erased */
+    off_t previous_size = lseek(fd, 0, SEEK_END);
+    if(previous_size != (off_t) config.size && ftruncate(fd, config.size) != 0) {
+        ::close(fd);
+        return -1;
+    }
+
+    void *base = mmap(NULL, config.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(base == MAP_FAILED) {
+        ::close(fd);
+        return -1;
+    }
+
+    store.config = config;
+    store.fd = fd;
+    store.base = (uint8_t *) base;
+    store.erase_counts.assign((config.size + config.sector_size - 1) / config.sector_size, 0);
+    store.fail_error = 0;
+    store.writes_until_fail = -1;
+    memset(&store.stats, 0, sizeof(store.stats));
+
+    if(previous_size != (off_t) config.size) {
+        memset(store.base, 0xFF, config.size);
+    }
+
+    /** Find the end of the log */
+    const record_header_t *header;
+    store.free_offset = 0;
+    while((header = header_at(store.free_offset)) != NULL) {
+        store.free_offset += record_size(header->key_size, header->data_size);
+    }
+
+    return 0;
+}
+
+void kvstore_stub::close(void)
+{
+    if(store.base) {
+        msync(store.base, store.config.size, MS_SYNC);
+        munmap(store.base, store.config.size);
+        ::close(store.fd);
+        store.base = NULL;
+        store.fd = -1;
+    }
+}
+
+stats_t &kvstore_stub::stats(void)
+{
+    return store.stats;
+}
+
+void kvstore_stub::reset_stats(void)
+{
+    memset(&store.stats, 0, sizeof(store.stats));
+}
+
+uint32_t kvstore_stub::sector_erase_count(size_t sector)
+{
+    return (sector < store.erase_counts.size())? store.erase_counts[sector] : 0;
+}
+
+uint32_t kvstore_stub::max_sector_erase_count(void)
+{
+    uint32_t max = 0;
+    for(uint32_t count : store.erase_counts) {
+        max = (count > max)? count : max;
+    }
+    return max;
+}
+
+float kvstore_stub::write_amplification(void)
+{
+    if(store.stats.value_bytes == 0) {
+        return 0.0f;
+    }
+    return (float) store.stats.programmed_bytes / store.stats.value_bytes;
+}
+
+void kvstore_stub::fail_with(int error)
+{
+    store.fail_error = error;
+}
+
+void kvstore_stub::fail_after_writes(unsigned count, int error)
+{
+    store.writes_until_fail = count;
+    store.fail_after_error = error;
+}
+
+int kv_set(const char *full_name_key, const void *buffer, size_t size, uint32_t create_flags)
+{
+    if(!full_name_key || (!buffer && size)) {
+        return MBED_ERROR_INVALID_ARGUMENT;
+    }
+    if(!ensure_open()) {
+        return MBED_ERROR_FAILED_OPERATION;
+    }
+    if(!count_write()) {
+        return store.fail_error;
+    }
+
+    store.stats.set_count++;
+    add_latency(store.config.write_latency_us);
+
+    long existing = find(full_name_key);
+    if(existing >= 0 && (((const record_header_t *) (store.base + existing))->user_flags & KV_WRITE_ONCE_FLAG)) {
+        return MBED_ERROR_WRITE_PROTECTED;
+    }
+
+    int err = append(full_name_key, buffer, size, create_flags);
+    if(!err) {
+        store.stats.value_bytes += size;
+    }
+    return err;
+}
+
+int kv_get(const char *full_name_key, void *buffer, size_t buffer_size, size_t *actual_size)
+{
+    if(!full_name_key || !actual_size) {
+        return MBED_ERROR_INVALID_ARGUMENT;
+    }
+    if(!ensure_open()) {
+        return MBED_ERROR_FAILED_OPERATION;
+    }
+    if(store.fail_error) {
+        return store.fail_error;
+    }
+
+    store.stats.get_count++;
+    add_latency(store.config.read_latency_us);
+
+    long offset = find(full_name_key);
+    if(offset < 0) {
+        return MBED_ERROR_ITEM_NOT_FOUND;
+    }
+
+    const record_header_t *header = (const record_header_t *) (store.base + offset);
+    size_t size = (header->data_size < buffer_size)? header->data_size : buffer_size;
+    memcpy(buffer, store.base + offset + sizeof(record_header_t) + header->key_size, size);
+    *actual_size = size;
+    store.stats.read_bytes += size;
+    return MBED_SUCCESS;
+}
+
+int kv_get_info(const char *full_name_key, kv_info_t *info)
+{
+    if(!full_name_key || !info) {
+        return MBED_ERROR_INVALID_ARGUMENT;
+    }
+    if(!ensure_open()) {
+        return MBED_ERROR_FAILED_OPERATION;
+    }
+    if(store.fail_error) {
+        return store.fail_error;
+    }
+
+    long offset = find(full_name_key);
+    if(offset < 0) {
+        return MBED_ERROR_ITEM_NOT_FOUND;
+    }
+
+    const record_header_t *header = (const record_header_t *) (store.base + offset);
+    info->size = header->data_size;
+    info->flags = header->user_flags;
+    return MBED_SUCCESS;
+}
+
+int kv_remove(const char *full_name_key)
+{
+    if(!full_name_key) {
+        return MBED_ERROR_INVALID_ARGUMENT;
+    }
+    if(!ensure_open()) {
+        return MBED_ERROR_FAILED_OPERATION;
+    }
+    if(!count_write()) {
+        return store.fail_error;
+    }
+
+    store.stats.remove_count++;
+    add_latency(store.config.write_latency_us);
+
+    long offset = find(full_name_key);
+    if(offset < 0) {
+        return MBED_ERROR_ITEM_NOT_FOUND;
+    }
+    if(((const record_header_t *) (store.base + offset))->user_flags & KV_WRITE_ONCE_FLAG) {
+        return MBED_ERROR_WRITE_PROTECTED;
+    }
+    return append(full_name_key, NULL, 0, TOMBSTONE_FLAG);
+}
+
+int kv_reset(const char *)
+{
+    if(!ensure_open()) {
+        return MBED_ERROR_FAILED_OPERATION;
+    }
+    erase_all();
+    return MBED_SUCCESS;
+}
@@ -0,0 +1,120 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_UNITTESTS_STUBS_KVSTORE_GLOBAL_API_STUB_H_
+#define EP_OC_MCU_UNITTESTS_STUBS_KVSTORE_GLOBAL_API_STUB_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Host implementation of the KVStore global API (kv_set, kv_get, ...)
+ * for unit tests and benchmarks.
+ *
+ * Records are appended to a memory-mapped file, laid out like a simplified
+ * TDBStore: a 24-byte header, the key and the value per record, newer
+ * records shadowing older ones. When the file is full, live records are
+ * compacted, which erases every sector. Latencies are added to a simulated
+ * clock (and optionally slept), and programmed bytes and per-sector erases
+ * are counted to measure write amplification and wear.
+ *
+ * The store opens itself with the default configuration (an anonymous
+ * temporary file) on first use. Open a named file to persist across a
+ * simulated reboot (close() then open() the same path).
+ */
+namespace kvstore_stub {
+
+struct config_t {
+    /** Backing file, NULL for an anonymous temporary file */
+    const char *path;
+
+    /** Size of the store and of one erase sector in bytes */
+    size_t size;
+    size_t sector_size;
+
+    /** Simulated latency per operation, and per sector for erases */
+    uint32_t read_latency_us;
+    uint32_t write_latency_us;
+    uint32_t erase_latency_us;
+
+    /** Actually sleep for the simulated latency */
+    bool sleep;
+};
+
+struct stats_t {
+    uint32_t get_count;
+    uint32_t set_count;
+    uint32_t remove_count;
+    uint32_t compaction_count;
+
+    /** Value bytes passed to kv_set */
+    uint64_t value_bytes;
+
+    /** Bytes programmed to the store, including headers, keys and compactions */
+    uint64_t programmed_bytes;
+
+    uint64_t read_bytes;
+    uint32_t sector_erases;
+
+    /** Sum of the simulated latencies */
+    uint64_t simulated_us;
+};
+
+/** Default configuration: 64 KiB store, 4 KiB sectors, no latency */
+config_t default_config(void);
+
+/**
+ * Open (or create) a store, closing the current one
+ * @retval 0 on success, -1 if the file could not be mapped
+ */
+int open(const config_t &config);
+
+/** Unmap the store. The next KVStore call reopens the default configuration. */
+void close(void);
+
+stats_t &stats(void);
+
+void reset_stats(void);
+
+/** Number of times a sector has been erased since the store was opened */
+uint32_t sector_erase_count(size_t sector);
+
+/** Largest sector_erase_count() over all sectors */
+uint32_t max_sector_erase_count(void);
+
+/** Programmed bytes per value byte written since the last reset_stats() */
+float write_amplification(void);
+
+/** Make the next KVStore calls fail with the given error, 0 to stop */
+void fail_with(int error);
+
+/**
+ * Let the next count writes (kv_set or kv_remove) succeed, then fail every
+ * KVStore call with the given error, as after a power loss. Reopening the
+ * store stops it.
+ */
+void fail_after_writes(unsigned count, int error);
+
+}
+
+#endif /* EP_OC_MCU_UNITTESTS_STUBS_KVSTORE_GLOBAL_API_STUB_H_ */
@@ -0,0 +1,70 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * Host critical sections for tests that run on several threads.
+ *
+ * mbed-os's mbed_critical_stub.c makes critical sections no-ops, and
+ * mbed_atomic_impl.c builds the atomic operations on them. Link this
+ * instead of mbed_critical_stub.c to make those operations atomic between
+ * host threads.
+ */
+
+#include "platform/mbed_critical.h"
+
+#include <mutex>
+
+static std::recursive_mutex &critical_mutex(void)
+{
+    static std::recursive_mutex mutex;
+    return mutex;
+}
+
+static thread_local unsigned critical_depth = 0;
+
+bool core_util_are_interrupts_enabled(void)
+{
+    return (critical_depth == 0);
+}
+
+bool core_util_is_isr_active(void)
+{
+    return false;
+}
+
+bool core_util_in_critical_section(void)
+{
+    return (critical_depth > 0);
+}
+
+void core_util_critical_section_enter(void)
+{
+    critical_mutex().lock();
+    critical_depth++;
+}
+
+void core_util_critical_section_exit(void)
+{
+    critical_depth--;
+    critical_mutex().unlock();
+}
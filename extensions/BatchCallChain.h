@@ -0,0 +1,149 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_BATCHCALLCHAIN_H_
+#define EP_OC_MCU_EXTENSIONS_BATCHCALLCHAIN_H_
+
+#include "extensions/CallChain.h"
+
+#include "platform/Callback.h"
+#include "platform/Span.h"
+
+namespace ep {
+
+/**
+ * A CallChain that dispatches a whole batch of samples at once,
+ * eg: the contents of a sensor FIFO.
+ *
+ * Batch subscribers (void(mbed::Span<const T>)) are called once per batch
+ * with the whole span.
+ *
+ * Per-sample subscribers (void(T)) are adapted automatically: each one is
+ * called for every sample of the batch in turn, so the chain is only traversed
+ * once per batch instead of once per sample.
+ *
+ * Both kinds of subscriber are kept in CallChains, so they can be detached
+ * from within a call() and attach() returns a SubscriptionToken for either.
+ *
+ * @note: this API does NOT guarantee ANY specific order of execution!
+ */
+template<typename T>
+class BatchCallChain : public CallChain<mbed::Span<const T>>
+{
+
+public:
+
+    typedef mbed::Span<const T> batch_t;
+
+    /** Batch subscriber attach/detach are inherited from CallChain */
+    using CallChain<batch_t>::attach;
+    using CallChain<batch_t>::detach;
+
+    BatchCallChain() : CallChain<batch_t>(), _per_sample() {
+    }
+
+    virtual ~BatchCallChain() {
+        this->detach_all();
+    }
+
+    /**
+     * Attach a per-sample callback to the callchain
+     * @param[in] cb Callback to call for each sample of a batch
+     * @retval Token that can be converted into a Subscription. Invalid
+     * if the callback was already attached.
+     */
+    virtual SubscriptionToken attach(const mbed::Callback<void(T)> &cb) {
+        return _per_sample.attach(cb);
+    }
+
+    /**
+     * Detach a per-sample callback
+     * @param[in] cb Callback to remove from the callchain
+     */
+    virtual void detach(const mbed::Callback<void(T)> &cb) {
+        _per_sample.detach(cb);
+    }
+
+    void detach_all(void) {
+        CallChain<batch_t>::detach_all();
+        _per_sample.detach_all();
+    }
+
+    /**
+     * Invoke all callbacks in this chain with a batch of samples
+     * @param[in] samples Samples to pass to each callback
+     */
+    void call(batch_t samples) {
+
+        CallChain<batch_t>::call(samples);
+        _per_sample.call_each(samples);
+    }
+
+    void operator()(batch_t samples) {
+        call(samples);
+    }
+
+    /**
+     * Invoke all callbacks in this chain with a single sample
+     * @param[in] sample Sample to pass to each callback
+     */
+    void call(const T &sample) {
+        call(batch_t(&sample, 1));
+    }
+
+protected:
+
+    /** CallChain of per-sample callbacks, calling each one for a whole batch in turn */
+    class SampleChain : public CallChain<T>
+    {
+
+    public:
+
+        void call_each(batch_t samples) {
+
+            this->_dispatch_depth++;
+
+            for(typename CallChain<T>::Node &node : this->chain) {
+                /** Stop as soon as the callback is detached */
+                for(size_t i = 0; i < samples.size() && !node.removed; i++) {
+                    node.link.call(samples[i]);
+                }
+            }
+
+            /** Sweep callbacks detached during the dispatch */
+            if(--this->_dispatch_depth == 0 && this->_pending_removal) {
+                this->_pending_removal = false;
+                this->chain.remove_if([](const typename CallChain<T>::Node &node) { return node.removed; });
+            }
+        }
+
+    };
+
+    /** Per-sample callbacks */
+    SampleChain _per_sample;
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_BATCHCALLCHAIN_H_ */
@@ -35,6 +35,8 @@ template<typename T>
 class BoundVariable {
 public:
 
+    typedef T value_type;
+
     /** Empty constructor */
     BoundVariable() {
     }
@@ -44,26 +46,35 @@ public:
             _value(value) {
     }
 
+    virtual ~BoundVariable() {
+    }
+
     T &operator=(const T &rhs) {
         this->set(rhs);
         return _value;
     }
 
     operator T() {
-        return _value;
+        return this->get();
     }
 
-    T get(void) {
+    virtual T get(void) {
         return _value;
     }
 
-    void set(T new_value) {
+    virtual void set(T new_value) {
         _value = new_value;
         _callchain.call(_value);
     }
 
-    void attach(const mbed::Callback<void(T)>& cb) {
-        _callchain.attach(cb);
+    /**
+     * Attach a callback to be executed when the variable is set
+     * @param[in] cb Callback to attach
+     * @retval Token that can be converted into an ep::Subscription to detach
+     * the callback automatically
+     */
+    SubscriptionToken attach(const mbed::Callback<void(T)>& cb) {
+        return _callchain.attach(cb);
     }
 
     void detach(const mbed::Callback<void(T)>& cb) {
@@ -27,7 +27,9 @@
 #include "platform/Callback.h"
 #include "platform/NonCopyable.h"
 
-#include <forward_list>
+#include "extensions/Subscription.h"
+
+#include <list>
 
 
 namespace ep {
@@ -80,15 +82,22 @@ namespace ep {
 	 * (eg: an invidual threshold for each handler) it can do so by replacing
 	 * this Link type
 	 *
+	 * attach() returns a SubscriptionToken. Converting it into an ep::Subscription
+	 * detaches the callback in O(1) when the Subscription is destroyed.
+	 *
+	 * Callbacks may be detached (by any means) from within a call(). Removal
+	 * is deferred until the outermost call() returns, and detached callbacks
+	 * are not executed for the rest of that call().
+	 *
 	 * @note: this API does NOT guarantee ANY specific order of execution!
 	 */
 	template<typename... ArgTs>
-	class CallChain : private mbed::NonCopyable<CallChain<ArgTs...>>
+	class CallChain : public Subscribable, private mbed::NonCopyable<CallChain<ArgTs...>>
 	{
 
 	public:
 
-		CallChain() : chain() {
+		CallChain() : chain(), _dispatch_depth(0), _pending_removal(false) {
 		}
 
 		virtual ~CallChain() {
@@ -97,26 +106,30 @@ namespace ep {
 
 		/** Attach a callback to the callchain
 		 * @param[in] callback Callback to attach to the callchain
+		 * @retval Token that can be converted into a Subscription. Invalid
+		 * if the callback was already attached.
 		 */
-		virtual void attach(const CallChainLink<ArgTs...>& callback) {
+		virtual SubscriptionToken attach(const CallChainLink<ArgTs...>& callback) {
 
 			/** Make sure a duplicate isn't being added */
-			for(CallChainLink<ArgTs...> cb : chain) {
-				if(cb == callback) {
-					return;
+			for(Node &node : chain) {
+				if(!node.removed && node.link == callback) {
+					return SubscriptionToken();
 				}
 			}
 
 			/** Made it here, add the callback to the end of the list */
-			chain.push_front(callback);
+			chain.emplace_front(callback);
+			chain.front().self = chain.begin();
+			return SubscriptionToken(this, &chain.front());
 		}
 
         /**
          * Attach a callback to the callchain, initializing with a Callback instance
          * @param[in] callback Callback to attach to the callchain
          */
-        virtual void attach(const mbed::Callback<void(ArgTs...)>& cb) {
-            this->attach(CallChainLink<ArgTs...>(cb));
+        virtual SubscriptionToken attach(const mbed::Callback<void(ArgTs...)>& cb) {
+            return this->attach(CallChainLink<ArgTs...>(cb));
         }
 
 		/**
@@ -127,7 +140,12 @@ namespace ep {
 		 * object. Equivalency is based on memory comparison, not pointer comparison
 		 */
 		virtual void detach(const CallChainLink<ArgTs...>& callback) {
-			chain.remove(callback);
+			for(Node &node : chain) {
+				if(!node.removed && node.link == callback) {
+					this->remove(node);
+					return;
+				}
+			}
 		}
 
         /**
@@ -142,17 +160,42 @@ namespace ep {
         }
 
 		void detach_all(void) {
-			chain.clear();
+			for(Node &node : chain) {
+				if(node.owner) {
+					Subscribable::orphan(node.owner);
+					node.owner = NULL;
+				}
+				node.removed = true;
+			}
+
+			if(_dispatch_depth) {
+				_pending_removal = true;
+			} else {
+				chain.clear();
+			}
 		}
 
 		/**
 		 * Invoke all callbacks in this chain
 		 * @param[in] args Arguments to pass to each callback in the chain
+		 *
+		 * @note Virtual so that chains with their own dispatch (eg: deferred
+		 * to an EventQueue) keep it when invoked through a CallChain reference
 		 */
-		void call(ArgTs... args) {
+		virtual void call(ArgTs... args) {
+
+			_dispatch_depth++;
 
-			for(CallChainLink<ArgTs...> cb : chain) {
-				cb.call(args...);
+			for(Node &node : chain) {
+				if(!node.removed) {
+					node.link.call(args...);
+				}
+			}
+
+			/** Sweep callbacks detached during the dispatch */
+			if(--_dispatch_depth == 0 && _pending_removal) {
+				_pending_removal = false;
+				chain.remove_if([](const Node &node) { return node.removed; });
 			}
 		}
 
@@ -160,9 +203,64 @@ namespace ep {
 			call(args...);
 		}
 
+		/** Returns true if no callbacks are attached */
+		bool empty(void) {
+			for(Node &node : chain) {
+				if(!node.removed) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+	protected:
+
+		struct Node;
+
+		typedef typename std::list<Node>::iterator node_iterator_t;
+
+		/** Stored link plus bookkeeping for O(1) unsubscribe */
+		struct Node {
+			Node(const CallChainLink<ArgTs...> &link) : link(link), owner(NULL), removed(false) {
+			}
+
+			CallChainLink<ArgTs...> link;
+			node_iterator_t self;            /** Position of this node in the chain */
+			Subscription *owner;             /** Subscription tracking this node, if any */
+			bool removed;                    /** Detached during a dispatch, waiting to be swept */
+		};
+
+		virtual void unsubscribe(void *node) {
+			Node *n = static_cast<Node *>(node);
+			n->owner = NULL;
+			this->remove(*n);
+		}
+
+		virtual void set_owner(void *node, Subscription *owner) {
+			static_cast<Node *>(node)->owner = owner;
+		}
+
+		/** Remove a node now, or after the current dispatch */
+		void remove(Node &node) {
+			if(node.owner) {
+				Subscribable::orphan(node.owner);
+				node.owner = NULL;
+			}
+
+			if(_dispatch_depth) {
+				node.removed = true;
+				_pending_removal = true;
+			} else {
+				chain.erase(node.self);
+			}
+		}
+
 	protected:
 
-		std::forward_list<CallChainLink<ArgTs...>> chain; /** Singly-linked list to store callbacks */
+		std::list<Node> chain; /** Doubly-linked list to store callbacks */
+
+		unsigned int _dispatch_depth; /** Nesting level of call() */
+		bool _pending_removal; /** Nodes were detached during a dispatch */
 	};
 }
 
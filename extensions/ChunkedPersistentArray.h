@@ -0,0 +1,296 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_CHUNKEDPERSISTENTARRAY_H_
+#define EP_OC_MCU_EXTENSIONS_CHUNKEDPERSISTENTARRAY_H_
+
+#include "kvstore_global_api.h"
+#include "platform/mbed_error.h"
+#include "platform/mbed_assert.h"
+#include "platform/Span.h"
+#include "platform/mbed_critical.h"
+#include "mbed-trace/mbed_trace.h"
+
+#include <cstring>
+
+#include <stdio.h>
+
+namespace ep {
+
+/**
+ * Persistent array for large tables (eg: calibration tables) that stores
+ * its elements in fixed-size chunks, each under its own KVStore sub-key
+ * ("<key>.<chunk>").
+ *
+ * Updating one element or a range only writes the chunks that actually
+ * changed, instead of the whole array. get() still returns the whole array
+ * as one contiguous span.
+ *
+ * The array is loaded from KVStore on first access and served from RAM
+ * afterwards. Chunks that were never written keep their default values.
+ * A table previously stored as a PersistentArray under the same key is
+ * adopted and rewritten as chunks the first time it is loaded.
+ *
+ * Chunks that could not be written stay dirty and are retried by the next
+ * set() or sync().
+ *
+ * @tparam T Element type
+ * @tparam N Number of elements
+ * @tparam ChunkElements Number of elements per chunk
+ */
+template<typename T, ptrdiff_t N, ptrdiff_t ChunkElements = 16>
+class ChunkedPersistentArray
+{
+
+public:
+
+    static const ptrdiff_t CHUNK_COUNT = (N + ChunkElements - 1) / ChunkElements;
+
+    /**
+     * Initialize a chunked persistent array with a default array of values
+     * @param[in] default_array Array of default values to use
+     * @param[in] key Base key to use for kvstore, at most KEY_MAX - 6 characters
+     * @param[in] flags Creation flags for kvstore API
+     */
+    ChunkedPersistentArray(mbed::Span<const T,N> default_array, const char *key, uint32_t flags = 0) :
+        _key(key), _flags(flags), _loaded(false),
+        _flash_write_count(0), _bytes_written(0), _skipped_write_count(0) {
+        memcpy(_array, default_array.data(), N*sizeof(T));
+        memset(_dirty, 0, sizeof(_dirty));
+    }
+
+    /**
+     * Initialize a chunked persistent array with a default value for every element
+     * @param[in] default_value The default value of every element
+     * @param[in] key Base key to use for kvstore
+     * @param[in] flags Creation flags for kvstore API
+     */
+    ChunkedPersistentArray(const T &default_value, const char *key, uint32_t flags = 0) :
+        _key(key), _flags(flags), _loaded(false),
+        _flash_write_count(0), _bytes_written(0), _skipped_write_count(0) {
+        for(ptrdiff_t i = 0; i < N; i++) {
+            _array[i] = default_value;
+        }
+        memset(_dirty, 0, sizeof(_dirty));
+    }
+
+    /**
+     * Returns the whole array, loading it from KVStore on first access
+     * @note Interrupt safe once loaded. Before that, an interrupt gets the defaults.
+     */
+    mbed::Span<T,N> get(void) {
+        if(!_loaded && !core_util_is_isr_active()) {
+            this->load();
+        }
+        return mbed::make_Span(_array);
+    }
+
+    /** Returns one element */
+    T get(ptrdiff_t index) {
+        MBED_ASSERT(index >= 0 && index < N);
+        return this->get()[index];
+    }
+
+    /**
+     * Set one element, writing its chunk only if the value changed
+     * @retval 0 on success, or the KVStore error
+     * @note Not interrupt safe
+     */
+    int set(ptrdiff_t index, const T &value) {
+        return this->set(index, mbed::Span<const T>(&value, 1));
+    }
+
+    /**
+     * Set a range of elements, writing only the chunks that changed
+     * @param[in] first Index of the first element to set
+     * @param[in] values New values
+     * @retval 0 on success, or the first KVStore error
+     * @note Not interrupt safe
+     */
+    int set(ptrdiff_t first, mbed::Span<const T> values) {
+        MBED_ASSERT(first >= 0 && first + values.size() <= N);
+        this->get();
+
+        for(ptrdiff_t i = 0; i < values.size(); i++) {
+            ptrdiff_t index = first + i;
+            if(memcmp(&_array[index], &values[i], sizeof(T)) != 0) {
+                _array[index] = values[i];
+                this->mark_dirty(index / ChunkElements);
+            }
+        }
+
+        return this->sync();
+    }
+
+    /**
+     * Set the whole array, writing only the chunks that changed
+     * @retval 0 on success, or the first KVStore error
+     * @note Not interrupt safe
+     */
+    int set(mbed::Span<const T,N> new_value) {
+        return this->set(0, mbed::Span<const T>(new_value.data(), N));
+    }
+
+    /**
+     * Write every dirty chunk
+     * @retval 0 on success, or the first KVStore error
+     */
+    int sync(void) {
+        int result = 0;
+        bool wrote = false;
+        for(ptrdiff_t chunk = 0; chunk < CHUNK_COUNT; chunk++) {
+            if(!this->is_dirty(chunk)) {
+                continue;
+            }
+            wrote = true;
+            int err = this->write_chunk(chunk);
+            if(err && !result) {
+                result = err;
+            }
+        }
+        if(!wrote) {
+            _skipped_write_count++;
+        }
+        return result;
+    }
+
+    /** Number of chunk writes issued to KVStore */
+    uint32_t flash_write_count(void) const {
+        return _flash_write_count;
+    }
+
+    /** Number of value bytes written to KVStore */
+    uint32_t bytes_written(void) const {
+        return _bytes_written;
+    }
+
+    /** Number of updates that changed nothing and wrote nothing */
+    uint32_t skipped_write_count(void) const {
+        return _skipped_write_count;
+    }
+
+protected:
+
+    /** KVStore key length limit, including the chunk suffix */
+    static const size_t KEY_MAX = 64;
+
+    static size_t chunk_size(ptrdiff_t chunk) {
+        ptrdiff_t elements = N - (chunk * ChunkElements);
+        return ((elements < ChunkElements)? elements : ChunkElements) * sizeof(T);
+    }
+
+    void chunk_key(ptrdiff_t chunk, char *key) const {
+        snprintf(key, KEY_MAX, "%s.%d", _key, (int) chunk);
+    }
+
+    bool is_dirty(ptrdiff_t chunk) const {
+        return (_dirty[chunk / 32] & (1UL << (chunk % 32)));
+    }
+
+    void mark_dirty(ptrdiff_t chunk) {
+        _dirty[chunk / 32] |= (1UL << (chunk % 32));
+    }
+
+    int write_chunk(ptrdiff_t chunk) {
+        char key[KEY_MAX];
+        this->chunk_key(chunk, key);
+
+        int err = kv_set(key, &_array[chunk * ChunkElements], chunk_size(chunk), _flags);
+        if(err) {
+            mbed_tracef(TRACE_LEVEL_WARN, "PARR", "could not set entry \"%s\": %d", key, err);
+            return err;
+        }
+
+        _dirty[chunk / 32] &= ~(1UL << (chunk % 32));
+        _flash_write_count++;
+        _bytes_written += chunk_size(chunk);
+        return 0;
+    }
+
+    void load(void) {
+        char key[KEY_MAX];
+        bool found = false;
+
+        for(ptrdiff_t chunk = 0; chunk < CHUNK_COUNT; chunk++) {
+            this->chunk_key(chunk, key);
+            size_t actual_size = 0;
+            int err = kv_get(key, &_array[chunk * ChunkElements], chunk_size(chunk), &actual_size);
+            if(!err) {
+                found = true;
+                if(actual_size != chunk_size(chunk)) {
+                    mbed_tracef(TRACE_LEVEL_WARN, "PARR", "actual size (%u) of kvstore entry did not match expected size (%u)", actual_size, chunk_size(chunk));
+                }
+            } else if(err != MBED_ERROR_ITEM_NOT_FOUND) {
+                mbed_tracef(TRACE_LEVEL_WARN, "PARR", "could not get item \"%s\" from kvstore: %d", key, err);
+            }
+        }
+
+        if(!found) {
+            this->adopt_unchunked();
+        }
+
+        _loaded = true;
+    }
+
+    /** Take over a table stored whole by PersistentArray under the base key */
+    void adopt_unchunked(void) {
+        kv_info_t info;
+        if(kv_get_info(_key, &info) || info.size != N*sizeof(T)) {
+            return;
+        }
+
+        size_t actual_size = 0;
+        if(kv_get(_key, _array, N*sizeof(T), &actual_size)) {
+            return;
+        }
+
+        mbed_tracef(TRACE_LEVEL_INFO, "PARR", "converting \"%s\" to chunks", _key);
+        for(ptrdiff_t chunk = 0; chunk < CHUNK_COUNT; chunk++) {
+            this->mark_dirty(chunk);
+        }
+        if(!this->sync()) {
+            kv_remove(_key);
+        }
+    }
+
+protected:
+
+    T _array[N];
+    const char *_key;
+
+    uint32_t _flags;
+
+    bool _loaded;
+
+    /** One bit per chunk that differs from KVStore */
+    uint32_t _dirty[(CHUNK_COUNT + 31) / 32];
+
+    uint32_t _flash_write_count;
+    uint32_t _bytes_written;
+    uint32_t _skipped_write_count;
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_CHUNKEDPERSISTENTARRAY_H_ */
@@ -0,0 +1,273 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_DEFERREDCALLCHAIN_H_
+#define EP_OC_MCU_EXTENSIONS_DEFERREDCALLCHAIN_H_
+
+#include "extensions/CallChain.h"
+
+#include "events/EventQueue.h"
+#include "platform/mbed_atomic.h"
+#include "platform/mbed_critical.h"
+#include "platform/mbed_assert.h"
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ep {
+
+/**
+ * A CallChain that moves dispatch out of interrupt context.
+ *
+ * When called from an ISR (or through defer()), the arguments are copied into
+ * a preallocated lock-free ring and a single drain event is posted to the given
+ * EventQueue. The drain event dispatches every queued invocation in one batch
+ * on the EventQueue's thread. ISR time is therefore constant regardless of
+ * how many callbacks are attached.
+ *
+ * When called from thread context the chain is dispatched immediately.
+ *
+ * In coalescing mode only the latest arguments are kept, so handlers see at
+ * most one invocation per drain.
+ *
+ * Invocations dropped because the ring was full are counted, as are
+ * invocations replaced in coalescing mode.
+ *
+ * @tparam Depth Number of invocations the ring can hold, must be a power of 2
+ */
+template<size_t Depth, typename... ArgTs>
+class DeferredCallChain : public CallChain<ArgTs...>
+{
+
+    MBED_STATIC_ASSERT((Depth > 0) && ((Depth & (Depth - 1)) == 0), "DeferredCallChain depth must be a power of 2");
+
+public:
+
+    /**
+     * Construct a DeferredCallChain
+     * @param[in] queue EventQueue to dispatch deferred invocations on
+     * @param[in] coalesce If true, only the latest deferred arguments are dispatched
+     */
+    DeferredCallChain(events::EventQueue &queue, bool coalesce = false) :
+        CallChain<ArgTs...>(), _queue(queue), _coalesce(coalesce),
+        _enqueue_pos(0), _dequeue_pos(0), _latest_valid(false), _drain_pending(false),
+        _drain_id(0), _overflow_count(0), _coalesced_count(0), _post_fail_count(0) {
+        for(uint32_t i = 0; i < Depth; i++) {
+            _ring[i].sequence = i;
+        }
+    }
+
+    /**
+     * Cancels the posted drain event, if any
+     * @note Must not race with defer(), eg: disable the interrupt first
+     */
+    virtual ~DeferredCallChain() {
+        if(core_util_atomic_load_bool(&_drain_pending)) {
+            _queue.cancel(core_util_atomic_load_s32(&_drain_id));
+        }
+    }
+
+    /**
+     * Invoke all callbacks in this chain. From an ISR the invocation
+     * is deferred to the EventQueue, otherwise it is dispatched immediately.
+     * @param[in] args Arguments to pass to each callback in the chain
+     */
+    virtual void call(ArgTs... args) {
+        if(core_util_is_isr_active()) {
+            this->defer(args...);
+        } else {
+            CallChain<ArgTs...>::call(args...);
+        }
+    }
+
+    void operator()(ArgTs... args) {
+        call(args...);
+    }
+
+    /**
+     * Queue an invocation of this chain on the EventQueue
+     * @param[in] args Arguments to copy and later pass to each callback
+     * @retval true if queued, false if dropped because the ring was full
+     *
+     * @note Interrupt safe and constant time
+     */
+    bool defer(ArgTs... args) {
+
+        if(_coalesce) {
+            core_util_critical_section_enter();
+            if(_latest_valid) {
+                _coalesced_count++;
+            }
+            _latest = args_t(args...);
+            _latest_valid = true;
+            core_util_critical_section_exit();
+        } else if(!this->enqueue(args...)) {
+            core_util_atomic_incr_u32(&_overflow_count, 1);
+            return false;
+        }
+
+        /** Only one drain event is outstanding at a time */
+        if(!core_util_atomic_exchange_bool(&_drain_pending, true)) {
+            int id = _queue.call(this, &DeferredCallChain::drain);
+            core_util_atomic_store_s32(&_drain_id, id);
+            if(id == 0) {
+                core_util_atomic_incr_u32(&_post_fail_count, 1);
+                core_util_atomic_store_bool(&_drain_pending, false);
+            }
+        }
+
+        return true;
+    }
+
+    /** Number of invocations dropped because the ring was full */
+    uint32_t overflow_count(void) const {
+        return core_util_atomic_load_u32(&_overflow_count);
+    }
+
+    /** Number of invocations replaced by newer arguments in coalescing mode */
+    uint32_t coalesced_count(void) const {
+        return core_util_atomic_load_u32(&_coalesced_count);
+    }
+
+    /** Number of times the drain event could not be posted to the EventQueue */
+    uint32_t post_fail_count(void) const {
+        return core_util_atomic_load_u32(&_post_fail_count);
+    }
+
+    void reset_counters(void) {
+        core_util_atomic_store_u32(&_overflow_count, 0);
+        core_util_atomic_store_u32(&_coalesced_count, 0);
+        core_util_atomic_store_u32(&_post_fail_count, 0);
+    }
+
+protected:
+
+    typedef std::tuple<typename std::decay<ArgTs>::type...> args_t;
+
+    /** Ring cell, the sequence number tells producers and the consumer who owns it */
+    struct cell_t {
+        volatile uint32_t sequence;
+        args_t args;
+    };
+
+    /**
+     * Bounded multi-producer single-consumer enqueue
+     * @retval false if the ring is full
+     */
+    bool enqueue(ArgTs... args) {
+        uint32_t pos = core_util_atomic_load_u32(&_enqueue_pos);
+        while(true) {
+            cell_t &cell = _ring[pos & (Depth - 1)];
+            int32_t diff = (int32_t) (core_util_atomic_load_u32(&cell.sequence) - pos);
+            if(diff == 0) {
+                /** Cell is free, try to claim it. On failure pos is updated. */
+                if(core_util_atomic_cas_u32(&_enqueue_pos, &pos, pos + 1)) {
+                    cell.args = args_t(args...);
+                    core_util_atomic_store_u32(&cell.sequence, pos + 1);
+                    return true;
+                }
+            } else if(diff < 0) {
+                return false;
+            } else {
+                pos = core_util_atomic_load_u32(&_enqueue_pos);
+            }
+        }
+    }
+
+    /** Single consumer dequeue, only called from drain() */
+    bool dequeue(args_t &args) {
+        cell_t &cell = _ring[_dequeue_pos & (Depth - 1)];
+        if(core_util_atomic_load_u32(&cell.sequence) != (_dequeue_pos + 1)) {
+            return false;
+        }
+
+        args = cell.args;
+        core_util_atomic_store_u32(&cell.sequence, _dequeue_pos + Depth);
+        _dequeue_pos++;
+        return true;
+    }
+
+    /** Dispatch all queued invocations, runs on the EventQueue */
+    void drain(void) {
+
+        /** Clear first so anything queued from here on posts a new drain */
+        core_util_atomic_store_bool(&_drain_pending, false);
+
+        args_t args;
+
+        if(_coalesce) {
+            core_util_critical_section_enter();
+            bool valid = _latest_valid;
+            args = _latest;
+            _latest_valid = false;
+            core_util_critical_section_exit();
+
+            if(valid) {
+                this->dispatch(args, std::index_sequence_for<ArgTs...>());
+            }
+            return;
+        }
+
+        while(this->dequeue(args)) {
+            this->dispatch(args, std::index_sequence_for<ArgTs...>());
+        }
+    }
+
+    template<size_t... I>
+    void dispatch(args_t &args, std::index_sequence<I...>) {
+        CallChain<ArgTs...>::call(std::get<I>(args)...);
+    }
+
+protected:
+
+    events::EventQueue &_queue;
+
+    const bool _coalesce;
+
+    /** Lock-free ring of deferred invocations */
+    cell_t _ring[Depth];
+    volatile uint32_t _enqueue_pos;
+    uint32_t _dequeue_pos;
+
+    /** Latest arguments in coalescing mode */
+    args_t _latest;
+    bool _latest_valid;
+
+    /** True while a drain event is posted but has not started */
+    volatile bool _drain_pending;
+
+    /** Id of the last posted drain event */
+    volatile int32_t _drain_id;
+
+    volatile uint32_t _overflow_count;
+    volatile uint32_t _coalesced_count;
+    volatile uint32_t _post_fail_count;
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_DEFERREDCALLCHAIN_H_ */
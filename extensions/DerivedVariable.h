@@ -0,0 +1,296 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_DERIVEDVARIABLE_H_
+#define EP_OC_MCU_EXTENSIONS_DERIVEDVARIABLE_H_
+
+#include "extensions/BoundVariable.h"
+#include "extensions/Subscription.h"
+
+#include "platform/Callback.h"
+#include "platform/NonCopyable.h"
+#include "platform/mbed_assert.h"
+
+#include <cstring>
+#include <forward_list>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <stdint.h>
+
+namespace ep {
+
+/**
+ * Untyped part of a DerivedVariable: its place in the dependency graph
+ */
+class DerivedNode : private mbed::NonCopyable<DerivedNode>
+{
+
+public:
+
+    DerivedNode() : _validated_at(0) {
+    }
+
+    virtual ~DerivedNode() {
+    }
+
+protected:
+
+    /** Incremented whenever any input of any DerivedVariable changes */
+    static uint32_t &generation(void) {
+        static uint32_t current = 1;
+        return current;
+    }
+
+    /** Start of an update wave from a source BoundVariable */
+    void on_source_changed(void) {
+        generation()++;
+        this->propagate();
+    }
+
+    /**
+     * Notify this node's subscribers (if any) and then its dependents.
+     * Nodes reached twice in a diamond are only recomputed once since
+     * their inputs are unchanged the second time.
+     */
+    void propagate(void) {
+        this->notify_if_subscribed();
+        for(DerivedNode *dependent : _dependents) {
+            dependent->propagate();
+        }
+    }
+
+    void add_dependent(DerivedNode *node) {
+        _dependents.push_front(node);
+    }
+
+    void remove_dependent(DerivedNode *node) {
+        _dependents.remove(node);
+    }
+
+    static void add_dependent(DerivedNode &input, DerivedNode *node) {
+        input.add_dependent(node);
+    }
+
+    static void remove_dependent(DerivedNode &input, DerivedNode *node) {
+        input.remove_dependent(node);
+    }
+
+    virtual void notify_if_subscribed(void) = 0;
+
+protected:
+
+    /** DerivedVariables using this one as an input */
+    std::forward_list<DerivedNode *> _dependents;
+
+    /** Generation at which the inputs were last checked */
+    uint32_t _validated_at;
+
+};
+
+/**
+ * A read-only BoundVariable computed from other BoundVariables (or DerivedVariables).
+ *
+ * Recomputation is lazy: an input change only marks the node dirty. The value
+ * is recomputed when it is read, or right away if the node has subscribers,
+ * in which case they are notified with the new value.
+ *
+ * A node recomputes only if the values of its inputs differ from the ones it
+ * last computed with. Reading an input refreshes it first, so evaluation is
+ * always in topological order and glitch-free: in a diamond (A -> B, A -> C,
+ * B + C -> D) an update of A computes D once, with both B and C up to date.
+ *
+ * @code
+ * float dew_point(float t, float rh);
+ *
+ * ep::BoundVariable<float> temperature, humidity;
+ * ep::DerivedVariable<float, ep::BoundVariable<float>, ep::BoundVariable<float>>
+ *         dew(mbed::callback(dew_point), temperature, humidity);
+ * @endcode
+ *
+ * @tparam T Type of the derived value
+ * @tparam Inputs Types of the input variables (BoundVariable or DerivedVariable)
+ *
+ * @note Input values are compared bytewise, so struct inputs should have zeroed padding
+ * @note Not thread safe, the graph must be updated and read from one thread
+ */
+template<typename T, typename... Inputs>
+class DerivedVariable : public BoundVariable<T>, public DerivedNode
+{
+
+public:
+
+    typedef mbed::Callback<T(typename Inputs::value_type...)> compute_t;
+
+    /**
+     * Create a derived variable
+     * @param[in] compute Function computing the value from the input values
+     * @param[in] inputs Input variables, must outlive this DerivedVariable
+     */
+    DerivedVariable(compute_t compute, Inputs &... inputs) :
+        BoundVariable<T>(), DerivedNode(), _compute(compute), _inputs(inputs...),
+        _valid(false), _unnotified(false), _compute_count(0) {
+        this->connect(std::index_sequence_for<Inputs...>());
+    }
+
+    virtual ~DerivedVariable() {
+        this->disconnect(std::index_sequence_for<Inputs...>());
+    }
+
+    /** Derived values cannot be assigned */
+    T &operator=(const T &rhs) = delete;
+
+    /** Returns the current value, recomputing it if an input changed */
+    virtual T get(void) {
+        this->refresh();
+        return this->_value;
+    }
+
+    /** Derived values cannot be set, eg: through a BoundVariable reference */
+    virtual void set(T) {
+        MBED_ASSERT(false);
+    }
+
+    /** Number of times the value has been computed */
+    uint32_t compute_count(void) const {
+        return _compute_count;
+    }
+
+protected:
+
+    typedef std::tuple<typename Inputs::value_type...> values_t;
+
+    /** Recompute if the input values differ from the last computation */
+    void refresh(void) {
+        if(_valid && _validated_at == generation()) {
+            return;
+        }
+
+        values_t current = this->read_inputs(std::index_sequence_for<Inputs...>());
+        if(!_valid || !this->same_values(current, std::index_sequence_for<Inputs...>())) {
+            _values = current;
+            this->_value = this->compute(std::index_sequence_for<Inputs...>());
+            _valid = true;
+            _unnotified = true;
+            _compute_count++;
+        }
+
+        _validated_at = generation();
+    }
+
+    virtual void notify_if_subscribed(void) {
+        if(this->_callchain.empty()) {
+            return;
+        }
+
+        this->refresh();
+        if(_unnotified) {
+            _unnotified = false;
+            this->_callchain.call(this->_value);
+        }
+    }
+
+    template<size_t I>
+    void on_input_changed(typename std::tuple_element<I, values_t>::type) {
+        this->on_source_changed();
+    }
+
+    template<size_t... I>
+    values_t read_inputs(std::index_sequence<I...>) {
+        return values_t(std::get<I>(_inputs).get()...);
+    }
+
+    template<size_t... I>
+    bool same_values(const values_t &current, std::index_sequence<I...>) {
+        bool same = true;
+        int unused[] = { 0, (same = same && (memcmp(&std::get<I>(current), &std::get<I>(_values),
+                sizeof(typename std::tuple_element<I, values_t>::type)) == 0), 0)... };
+        (void) unused;
+        return same;
+    }
+
+    template<size_t... I>
+    T compute(std::index_sequence<I...>) {
+        return _compute(std::get<I>(_values)...);
+    }
+
+    /** DerivedVariable inputs propagate to us directly */
+    template<size_t I, typename Input>
+    void connect_input(Input &input, std::true_type) {
+        DerivedNode::add_dependent(input, this);
+    }
+
+    /** Plain BoundVariable inputs notify us through their callchain */
+    template<size_t I, typename Input>
+    void connect_input(Input &input, std::false_type) {
+        _source_subscriptions[I] = input.attach(mbed::callback(this, &DerivedVariable::template on_input_changed<I>));
+    }
+
+    template<size_t I, typename Input>
+    void disconnect_input(Input &input, std::true_type) {
+        DerivedNode::remove_dependent(input, this);
+    }
+
+    template<size_t I, typename Input>
+    void disconnect_input(Input &input, std::false_type) {
+        _source_subscriptions[I].reset();
+    }
+
+    template<size_t... I>
+    void connect(std::index_sequence<I...>) {
+        int unused[] = { 0, (this->template connect_input<I>(std::get<I>(_inputs),
+                std::is_base_of<DerivedNode, Inputs>()), 0)... };
+        (void) unused;
+    }
+
+    template<size_t... I>
+    void disconnect(std::index_sequence<I...>) {
+        int unused[] = { 0, (this->template disconnect_input<I>(std::get<I>(_inputs),
+                std::is_base_of<DerivedNode, Inputs>()), 0)... };
+        (void) unused;
+    }
+
+protected:
+
+    compute_t _compute;
+
+    std::tuple<Inputs &...> _inputs;
+
+    /** Input values used for the last computation */
+    values_t _values;
+
+    /** Subscriptions to plain BoundVariable inputs */
+    Subscription _source_subscriptions[sizeof...(Inputs)];
+
+    bool _valid;
+
+    /** Recomputed since subscribers were last notified */
+    bool _unnotified;
+
+    uint32_t _compute_count;
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_DERIVEDVARIABLE_H_ */
@@ -0,0 +1,142 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_EVENTBUS_H_
+#define EP_OC_MCU_EXTENSIONS_EVENTBUS_H_
+
+#include "extensions/CallChain.h"
+
+#include "platform/Callback.h"
+#include "platform/NonCopyable.h"
+
+#include <tuple>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ep {
+
+namespace detail {
+
+/** Compile-time index of Topic in Topics..., fails to compile if absent */
+template<typename Topic, typename... Topics>
+struct topic_index;
+
+template<typename Topic, typename... Rest>
+struct topic_index<Topic, Topic, Rest...> {
+    static constexpr size_t value = 0;
+};
+
+template<typename Topic, typename First, typename... Rest>
+struct topic_index<Topic, First, Rest...> {
+    static constexpr size_t value = 1 + topic_index<Topic, Rest...>::value;
+};
+
+}
+
+/**
+ * Publish/subscribe event bus with compile-time topics.
+ *
+ * A topic is a tag type that declares its payload type:
+ * @code
+ * struct IAQTopic { typedef float payload_t; };
+ * struct TemperatureTopic { typedef float payload_t; };
+ *
+ * ep::EventBus<IAQTopic, TemperatureTopic> bus;
+ * bus.subscribe<IAQTopic>(mbed::callback(&service, &BME680Service::set_iaq));
+ * bus.publish<IAQTopic>(output.iaq);
+ * @endcode
+ *
+ * Each topic is resolved to a slot in a table of CallChains at compile time,
+ * so publishing does not hash strings or touch the heap. Using a topic that is
+ * not part of the bus is a compile error.
+ *
+ * The bus counts how many times each topic has been published.
+ */
+template<typename... Topics>
+class EventBus : private mbed::NonCopyable<EventBus<Topics...>>
+{
+
+public:
+
+    /** Number of topics on this bus */
+    static constexpr size_t topic_count = sizeof...(Topics);
+
+    EventBus() {
+        for(size_t i = 0; i < topic_count; i++) {
+            _publish_count[i] = 0;
+        }
+    }
+
+    /**
+     * Subscribe to a topic
+     * @param[in] cb Callback to execute with each published payload
+     * @retval Token that can be converted into an ep::Subscription
+     */
+    template<typename Topic>
+    SubscriptionToken subscribe(const mbed::Callback<void(typename Topic::payload_t)> &cb) {
+        return this->template chain<Topic>().attach(cb);
+    }
+
+    /**
+     * Unsubscribe from a topic
+     * @param[in] cb Callback to remove
+     */
+    template<typename Topic>
+    void unsubscribe(const mbed::Callback<void(typename Topic::payload_t)> &cb) {
+        this->template chain<Topic>().detach(cb);
+    }
+
+    /**
+     * Publish a payload to every subscriber of a topic
+     * @param[in] payload Payload to pass to each subscriber
+     */
+    template<typename Topic>
+    void publish(typename Topic::payload_t payload) {
+        _publish_count[detail::topic_index<Topic, Topics...>::value]++;
+        this->template chain<Topic>().call(payload);
+    }
+
+    /** Number of times the topic has been published */
+    template<typename Topic>
+    uint32_t publish_count(void) const {
+        return _publish_count[detail::topic_index<Topic, Topics...>::value];
+    }
+
+    /** Underlying CallChain of a topic */
+    template<typename Topic>
+    CallChain<typename Topic::payload_t> &chain(void) {
+        return std::get<detail::topic_index<Topic, Topics...>::value>(_chains);
+    }
+
+protected:
+
+    /** One CallChain per topic, indexed at compile time */
+    std::tuple<CallChain<typename Topics::payload_t>...> _chains;
+
+    uint32_t _publish_count[sizeof...(Topics)];
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_EVENTBUS_H_ */
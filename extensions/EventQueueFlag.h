@@ -0,0 +1,141 @@
+/*
+ * Mbed-OS Microcontroller Library
+ * Copyright (c) 2021 Embedded Planet
+ * Copyright (c) 2021 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_EVENTQUEUEFLAG_H_
+#define EP_OC_MCU_EXTENSIONS_EVENTQUEUEFLAG_H_
+
+#include "TimeoutFlag.h"
+#include "events/EventQueue.h"
+#include "platform/Callback.h"
+#include "platform/NonCopyable.h"
+#include "platform/mbed_atomic.h"
+
+#include <chrono>
+
+namespace ep {
+
+/**
+ * Posts the expiry to an EventQueue, so an optional callback runs in the
+ * queue's thread instead of in interrupt context. wait() dispatches the
+ * queue until the timeout fires or is stopped, so it must be called from the
+ * thread that dispatches the queue, if at all.
+ *
+ * Restarting the timeout cancels the events posted for the previous start
+ * that have not been dispatched yet, including its callback.
+ *
+ * @code
+ * BasicTimeoutFlag<ep::EventQueueFlag> rx_timeout(ep::default_timer_wheel(), &queue, on_rx_timeout);
+ * @endcode
+ */
+class EventQueueFlag : private mbed::NonCopyable<EventQueueFlag>
+{
+
+public:
+
+    /**
+     * @param[in] queue Queue the expiry is posted to
+     * @param[in] on_timeout (optional) Callback run from the queue when the timeout fires
+     */
+    EventQueueFlag(events::EventQueue *queue, mbed::Callback<void()> on_timeout = nullptr) :
+        _queue(queue), _on_timeout(on_timeout), _flag(false), _waiting(false),
+        _event_id(0), _cancel_id(0) {
+    }
+
+    /** The queue may outlive the flag, drop the events that point to it */
+    ~EventQueueFlag() {
+        this->clear();
+    }
+
+    /** Called by start(): a stale event would break the next wait() early */
+    void clear(void) {
+        _flag = false;
+        this->cancel_posted(_event_id);
+        this->cancel_posted(_cancel_id);
+    }
+
+    void set(void) {
+        _flag = true;
+        core_util_atomic_store_s32(&_event_id, _queue->call(this, &EventQueueFlag::on_event));
+    }
+
+    void cancel(void) {
+        this->cancel_posted(_cancel_id);
+        core_util_atomic_store_s32(&_cancel_id, _queue->call(this, &EventQueueFlag::on_cancel));
+    }
+
+    bool is_set(void) const {
+        return _flag;
+    }
+
+    bool wait(std::chrono::milliseconds limit) {
+        if(_flag) {
+            return true;
+        }
+        _waiting = true;
+        _queue->dispatch_for(limit);
+        _waiting = false;
+        return _flag;
+    }
+
+protected:
+
+    void on_event(void) {
+        core_util_atomic_store_s32(&_event_id, 0);
+        if(_on_timeout) {
+            _on_timeout();
+        }
+        this->break_wait();
+    }
+
+    void on_cancel(void) {
+        core_util_atomic_store_s32(&_cancel_id, 0);
+        this->break_wait();
+    }
+
+    /** Only break a dispatch started by wait() */
+    void break_wait(void) {
+        if(_waiting) {
+            _queue->break_dispatch();
+        }
+    }
+
+    /** Cancel a posted event if it has not been dispatched yet */
+    void cancel_posted(volatile int32_t &id) {
+        int32_t posted = core_util_atomic_exchange_s32(&id, 0);
+        if(posted) {
+            _queue->cancel(posted);
+        }
+    }
+
+protected:
+
+    events::EventQueue *_queue;
+    mbed::Callback<void()> _on_timeout;
+    volatile bool _flag;
+    volatile bool _waiting;
+
+    /** Ids of the posted expiry and stop events, 0 if none */
+    volatile int32_t _event_id;
+    volatile int32_t _cancel_id;
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_EVENTQUEUEFLAG_H_ */
@@ -0,0 +1,273 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_FILTEREDBOUNDVARIABLE_H_
+#define EP_OC_MCU_EXTENSIONS_FILTEREDBOUNDVARIABLE_H_
+
+#include "extensions/BoundVariable.h"
+
+#include "events/EventQueue.h"
+#include "platform/mbed_critical.h"
+#include "rtos/Kernel.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+#include <stdint.h>
+
+namespace ep {
+
+/**
+ * A BoundVariable that only notifies its subscribers of meaningful changes.
+ *
+ * - Change suppression: setting the same value again does not notify.
+ * - Deadband (floating-point T only): the new value must differ from the last
+ *   *notified* value by more than an absolute amount and/or a fraction of
+ *   that value. Since the comparison is against the last notified value, slow
+ *   drift is still reported once it leaves the band, and noise around a
+ *   threshold does not chatter (hysteresis).
+ * - Rate limiting: notifications are at least a minimum interval apart.
+ *   Updates inside the interval are coalesced and the latest value is
+ *   notified once the interval expires. If an EventQueue is given the
+ *   pending value is flushed from it, otherwise on the next set() or flush().
+ *
+ * get() always returns the latest value set, whether it was notified or not.
+ *
+ * Non-arithmetic T (eg: structs) are compared bytewise, so padding should be
+ * zeroed for change suppression to be effective.
+ *
+ * The filter state is updated in a critical section, so set() may race the
+ * flush from the EventQueue's thread. Subscribers are called outside of it,
+ * from whichever of the two contexts notifies, so they may be called from
+ * either thread.
+ *
+ * @tparam Clock Clock used for rate limiting, eg: rtos::Kernel::Clock
+ */
+template<typename T, typename Clock = rtos::Kernel::Clock>
+class FilteredBoundVariable : public BoundVariable<T>
+{
+
+public:
+
+    /**
+     * Create a filtered BoundVariable
+     * @param[in] value Initial value, considered already notified
+     * @param[in] queue (optional) EventQueue used to flush rate-limited values
+     */
+    FilteredBoundVariable(const T &value = T(), events::EventQueue *queue = NULL) :
+        BoundVariable<T>(value), _queue(queue), _last_notified(value),
+        _abs_deadband(0.0f), _rel_deadband(0.0f), _min_interval(0),
+        _last_notify_time(), _pending(false), _flush_scheduled(false), _flush_id(0),
+        _notify_count(0), _suppressed_count(0), _rate_limited_count(0) {
+    }
+
+    /** Cancels the scheduled flush, if any. The pending value is not notified. */
+    ~FilteredBoundVariable() {
+        core_util_critical_section_enter();
+        bool scheduled = _flush_scheduled;
+        _flush_scheduled = false;
+        core_util_critical_section_exit();
+
+        if(scheduled) {
+            _queue->cancel(_flush_id);
+        }
+    }
+
+    using BoundVariable<T>::operator=;
+
+    /**
+     * Set the deadband. A change smaller than or equal to either limit is suppressed.
+     * @param[in] absolute Absolute deadband, 0 to disable
+     * @param[in] relative Deadband as a fraction of the last notified value, 0 to disable
+     */
+    void set_deadband(float absolute, float relative = 0.0f) {
+        static_assert(std::is_floating_point<T>::value, "deadband is only supported for floating-point types");
+        _abs_deadband = absolute;
+        _rel_deadband = relative;
+    }
+
+    /**
+     * Set the minimum interval between notifications
+     * @param[in] interval Minimum interval, 0 to disable rate limiting
+     */
+    void set_min_interval(typename Clock::duration interval) {
+        _min_interval = interval;
+    }
+
+    /**
+     * Set the variable, notifying subscribers if the change passes the filters
+     * @param[in] new_value New value
+     */
+    virtual void set(T new_value) {
+        typename Clock::time_point now = Clock::now();
+
+        core_util_critical_section_enter();
+        this->_value = new_value;
+        bool notify = this->filter(new_value, now);
+        core_util_critical_section_exit();
+
+        if(notify) {
+            this->_callchain.call(new_value);
+        }
+    }
+
+    /** Notify the pending rate-limited value now, if any */
+    void flush(void) {
+        typename Clock::time_point now = Clock::now();
+
+        core_util_critical_section_enter();
+        bool notify = _pending;
+        T value = this->_value;
+        if(notify) {
+            this->mark_notified(now);
+        }
+        core_util_critical_section_exit();
+
+        if(notify) {
+            this->_callchain.call(value);
+        }
+    }
+
+    /** Number of notifications sent to subscribers */
+    uint32_t notify_count(void) const {
+        return _notify_count;
+    }
+
+    /** Number of updates suppressed because the value did not change enough */
+    uint32_t suppressed_count(void) const {
+        return _suppressed_count;
+    }
+
+    /** Number of updates replaced by a newer value while rate limited */
+    uint32_t rate_limited_count(void) const {
+        return _rate_limited_count;
+    }
+
+protected:
+
+    /**
+     * Apply the filters to a new value, called in a critical section
+     * @retval true if subscribers should be notified of the value now
+     */
+    bool filter(const T &new_value, typename Clock::time_point now) {
+        if(!this->changed(new_value)) {
+            /** Back within the band of the last notified value, drop anything pending */
+            _pending = false;
+            _suppressed_count++;
+            return false;
+        }
+
+        if(_min_interval.count() > 0 && _notify_count > 0 &&
+                (now - _last_notify_time) < _min_interval) {
+            if(_pending) {
+                _rate_limited_count++;
+            }
+            _pending = true;
+            this->schedule_flush(_min_interval - (now - _last_notify_time));
+            return false;
+        }
+
+        this->mark_notified(now);
+        return true;
+    }
+
+    void mark_notified(typename Clock::time_point now) {
+        _pending = false;
+        _last_notified = this->_value;
+        _last_notify_time = now;
+        _notify_count++;
+    }
+
+    void schedule_flush(typename Clock::duration delay) {
+        if(_queue && !_flush_scheduled) {
+            _flush_id = _queue->call_in(std::chrono::duration_cast<std::chrono::milliseconds>(delay), this, &FilteredBoundVariable::on_flush_timeout);
+            if(_flush_id) {
+                _flush_scheduled = true;
+            }
+        }
+    }
+
+    void on_flush_timeout(void) {
+        core_util_critical_section_enter();
+        _flush_scheduled = false;
+        core_util_critical_section_exit();
+
+        this->flush();
+    }
+
+    bool changed(const T &new_value) {
+        return this->changed(new_value, std::is_floating_point<T>(), std::is_arithmetic<T>());
+    }
+
+    /** Floating point: apply deadband */
+    bool changed(const T &new_value, std::true_type, std::true_type) {
+        float delta = std::fabs((float) (new_value - _last_notified));
+        if(delta == 0.0f) {
+            return false;
+        }
+        if(_abs_deadband > 0.0f && delta <= _abs_deadband) {
+            return false;
+        }
+        if(_rel_deadband > 0.0f && delta <= _rel_deadband * std::fabs((float) _last_notified)) {
+            return false;
+        }
+        return true;
+    }
+
+    /** Integral types: exact comparison */
+    bool changed(const T &new_value, std::false_type, std::true_type) {
+        return (new_value != _last_notified);
+    }
+
+    /** Other types: bytewise comparison */
+    bool changed(const T &new_value, std::false_type, std::false_type) {
+        return (memcmp(&new_value, &_last_notified, sizeof(T)) != 0);
+    }
+
+protected:
+
+    events::EventQueue *_queue;
+
+    T _last_notified;
+
+    float _abs_deadband;
+    float _rel_deadband;
+
+    typename Clock::duration _min_interval;
+    typename Clock::time_point _last_notify_time;
+
+    /** A rate-limited value is waiting to be notified */
+    bool _pending;
+    bool _flush_scheduled;
+    int _flush_id;
+
+    uint32_t _notify_count;
+    uint32_t _suppressed_count;
+    uint32_t _rate_limited_count;
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_FILTEREDBOUNDVARIABLE_H_ */
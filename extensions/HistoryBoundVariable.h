@@ -0,0 +1,347 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_HISTORYBOUNDVARIABLE_H_
+#define EP_OC_MCU_EXTENSIONS_HISTORYBOUNDVARIABLE_H_
+
+#include "extensions/BoundVariable.h"
+
+#include "platform/mbed_assert.h"
+
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ep {
+
+namespace detail {
+
+template<typename...>
+struct history_void {
+    typedef void type;
+};
+
+/** T::component_type if declared, void otherwise */
+template<typename T, typename = void>
+struct history_component {
+    typedef void type;
+};
+
+template<typename T>
+struct history_component<T, typename history_void<typename T::component_type>::type> {
+    typedef typename T::component_type type;
+};
+
+}
+
+/**
+ * Describes how HistoryBoundVariable splits a value into the components
+ * it keeps statistics for.
+ *
+ * Arithmetic types have a single component. Other types must declare the
+ * type of their components and are treated as a packed sequence of them,
+ * which covers the tri-axis reading structs used by the sensor services:
+ *
+ * @code
+ * struct tri_axis_reading_t {
+ *     typedef float component_type;
+ *     float x, y, z;
+ * };
+ * @endcode
+ *
+ * Specialize this for anything else.
+ */
+template<typename T, bool = std::is_arithmetic<T>::value>
+struct history_traits {
+    static constexpr size_t components = 1;
+
+    static float component(const T &value, size_t) {
+        return (float) value;
+    }
+};
+
+template<typename T>
+struct history_traits<T, false> {
+    typedef typename detail::history_component<T>::type component_type;
+
+    static_assert(std::is_arithmetic<component_type>::value,
+            "declare T::component_type or specialize ep::history_traits for this type");
+    static_assert(std::is_trivially_copyable<T>::value && (sizeof(T) % sizeof(component_type)) == 0,
+            "T must be a packed sequence of component_type");
+
+    static constexpr size_t components = sizeof(T) / sizeof(component_type);
+
+    static float component(const T &value, size_t index) {
+        component_type result;
+        memcpy(&result, ((const uint8_t *) &value) + (index * sizeof(component_type)), sizeof(component_type));
+        return (float) result;
+    }
+};
+
+/**
+ * A BoundVariable that remembers its last N values and maintains rolling
+ * statistics over them.
+ *
+ * Every set() pushes the value into a fixed-capacity ring. The mean and
+ * variance of each component are updated incrementally (Welford's algorithm,
+ * adding the new sample and removing the evicted one) and the minimum and
+ * maximum are tracked with monotonic deques, so every query is O(1) and
+ * set() is amortized O(1) per component.
+ *
+ * Subscribers are notified after the history is updated, so they may query
+ * the statistics from their callback.
+ *
+ * @code
+ * ep::HistoryBoundVariable<float, 32> temperature;
+ * temperature = 21.5f;
+ * float avg = temperature.mean();
+ * @endcode
+ *
+ * @tparam T Type of the value
+ * @tparam N Number of values kept
+ * @tparam Traits Component access, see history_traits
+ */
+template<typename T, size_t N, typename Traits = history_traits<T>>
+class HistoryBoundVariable : public BoundVariable<T>
+{
+
+    static_assert(N > 0, "HistoryBoundVariable needs a capacity of at least 1");
+
+public:
+
+    static constexpr size_t components = Traits::components;
+
+    HistoryBoundVariable() : BoundVariable<T>() {
+        this->clear_history();
+    }
+
+    /** The initial value is not part of the history */
+    HistoryBoundVariable(const T &value) : BoundVariable<T>(value) {
+        this->clear_history();
+    }
+
+    using BoundVariable<T>::operator=;
+
+    /**
+     * Set the variable, add it to the history and notify subscribers
+     * @param[in] new_value New value
+     */
+    virtual void set(T new_value) {
+        this->push(new_value);
+        BoundVariable<T>::set(new_value);
+    }
+
+    /** Forget all values in the history */
+    void clear_history(void) {
+        _head = 0;
+        _count = 0;
+        for(size_t i = 0; i < components; i++) {
+            _stats[i].clear();
+        }
+    }
+
+    /** Number of values in the history */
+    size_t size(void) const {
+        return _count;
+    }
+
+    static constexpr size_t capacity(void) {
+        return N;
+    }
+
+    bool full(void) const {
+        return (_count == N);
+    }
+
+    /**
+     * Value from the history
+     * @param[in] age 0 for the newest value, size() - 1 for the oldest
+     */
+    const T &at(size_t age) const {
+        MBED_ASSERT(age < _count);
+        return _ring[(_head + N - 1 - age) % N];
+    }
+
+    /** Mean of a component over the history, 0 if empty */
+    float mean(size_t component = 0) const {
+        return _stats[component].mean;
+    }
+
+    /** Population variance of a component over the history, 0 if empty */
+    float variance(size_t component = 0) const {
+        if(_count == 0) {
+            return 0.0f;
+        }
+        float result = _stats[component].m2 / _count;
+        /** Rounding in the rolling update can leave a tiny negative residue */
+        return (result > 0.0f)? result : 0.0f;
+    }
+
+    float stddev(size_t component = 0) const {
+        return std::sqrt(this->variance(component));
+    }
+
+    /** Minimum of a component over the history, 0 if empty */
+    float min(size_t component = 0) const {
+        return _stats[component].min.front_value(*this, component);
+    }
+
+    /** Maximum of a component over the history, 0 if empty */
+    float max(size_t component = 0) const {
+        return _stats[component].max.front_value(*this, component);
+    }
+
+protected:
+
+    /**
+     * Ring indices of the history values that are candidates for the
+     * minimum (or maximum), oldest first, with strictly increasing (or
+     * decreasing) values
+     */
+    class MonotonicDeque
+    {
+    public:
+
+        void clear(void) {
+            _first = 0;
+            _length = 0;
+        }
+
+        /**
+         * Add the newest value, dropping the older ones it dominates
+         * @param[in] keep Returns true if an older value still beats the new one
+         */
+        void push(const HistoryBoundVariable &history, size_t component,
+                size_t index, float value, bool (*keep)(float, float)) {
+            while(_length > 0 && !keep(history.value_at(this->back(), component), value)) {
+                _length--;
+            }
+            _slots[(_first + _length) % N] = index;
+            _length++;
+        }
+
+        /** Drop the front if its ring slot is about to be overwritten */
+        void expire(size_t index) {
+            if(_length > 0 && _slots[_first] == index) {
+                _first = (_first + 1) % N;
+                _length--;
+            }
+        }
+
+        float front_value(const HistoryBoundVariable &history, size_t component) const {
+            if(_length == 0) {
+                return 0.0f;
+            }
+            return history.value_at(_slots[_first], component);
+        }
+
+    protected:
+
+        size_t back(void) const {
+            return _slots[(_first + _length - 1) % N];
+        }
+
+        size_t _slots[N];
+        size_t _first;
+        size_t _length;
+    };
+
+    struct component_stats_t {
+        float mean;
+        float m2;
+        MonotonicDeque min;
+        MonotonicDeque max;
+
+        void clear(void) {
+            mean = 0.0f;
+            m2 = 0.0f;
+            min.clear();
+            max.clear();
+        }
+    };
+
+    static bool less(float a, float b) {
+        return a < b;
+    }
+
+    static bool greater(float a, float b) {
+        return a > b;
+    }
+
+    float value_at(size_t index, size_t component) const {
+        return Traits::component(_ring[index], component);
+    }
+
+    void push(const T &value) {
+        size_t index = _head;
+        bool evict = (_count == N);
+
+        for(size_t i = 0; i < components; i++) {
+            component_stats_t &stats = _stats[i];
+            float x = Traits::component(value, i);
+
+            if(evict) {
+                /** Replace the evicted value, the count stays at N */
+                float old_x = Traits::component(_ring[index], i);
+                float old_mean = stats.mean;
+                stats.mean += (x - old_x) / N;
+                stats.m2 += (x - old_x) * ((x - stats.mean) + (old_x - old_mean));
+                stats.min.expire(index);
+                stats.max.expire(index);
+            } else {
+                float delta = x - stats.mean;
+                stats.mean += delta / (_count + 1);
+                stats.m2 += delta * (x - stats.mean);
+            }
+        }
+
+        _ring[index] = value;
+        _head = (_head + 1) % N;
+        if(!evict) {
+            _count++;
+        }
+
+        for(size_t i = 0; i < components; i++) {
+            float x = Traits::component(value, i);
+            _stats[i].min.push(*this, i, index, x, less);
+            _stats[i].max.push(*this, i, index, x, greater);
+        }
+    }
+
+protected:
+
+    T _ring[N];
+
+    /** Ring index the next value is written to */
+    size_t _head;
+    size_t _count;
+
+    component_stats_t _stats[components];
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_HISTORYBOUNDVARIABLE_H_ */
@@ -0,0 +1,199 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "JournaledCounter.h"
+
+#include "platform/mbed_assert.h"
+
+#include <cstring>
+
+using namespace ep;
+
+static uint32_t round_up(uint32_t size, uint32_t unit) {
+    return ((size + unit - 1) / unit) * unit;
+}
+
+JournaledCounter::JournaledCounter(mbed::BlockDevice &bd, mbed::bd_addr_t start, mbed::bd_size_t size) :
+        _bd(bd), _start(start), _size(size), _sector_size(0), _sector_count(0), _header_size(0),
+        _entry_size(0), _entries_per_sector(0), _erase_value(-1), _sector(0),
+        _sequence(0), _next_entry(0), _value(0), _append_count(0),
+        _compaction_count(0), _torn_count(0) {
+}
+
+int JournaledCounter::init(void) {
+
+    /** The geometry reads 0 until the block device is initialized (eg: FlashIAPBlockDevice) */
+    _sector_count = 0;
+    _sector_size = _bd.get_erase_size(_start);
+    uint32_t program_size = _bd.get_program_size();
+    if(_sector_size == 0 || program_size == 0) {
+        return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+    MBED_ASSERT((_start % _sector_size) == 0 && (_size % _sector_size) == 0);
+
+    _header_size = round_up(sizeof(header_t), program_size);
+    _entry_size = round_up(sizeof(entry_t), program_size);
+    if(_size / _sector_size < 2 || _header_size > MAX_SLOT_SIZE || _entry_size > MAX_SLOT_SIZE) {
+        return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+    _entries_per_sector = (_sector_size - _header_size) / _entry_size;
+
+    _erase_value = _bd.get_erase_value();
+    if(_erase_value < 0) {
+        return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+    _sector_count = _size / _sector_size;
+
+    _value = 0;
+    _append_count = 0;
+    _compaction_count = 0;
+    _torn_count = 0;
+
+    /** Find the newest sector (sequence numbers compared modulo 2^32) */
+    bool found = false;
+    header_t newest;
+    for(uint32_t sector = 0; sector < _sector_count; sector++) {
+        header_t header;
+        if(!this->read_header(sector, header)) {
+            continue;
+        }
+        if(!found || (int32_t) (header.sequence - newest.sequence) > 0) {
+            found = true;
+            newest = header;
+            _sector = sector;
+        }
+    }
+
+    if(!found) {
+        /** Fresh region */
+        _value = 0;
+        return this->start_sector(0, 1);
+    }
+
+    _sequence = newest.sequence;
+    _value = newest.base;
+    return this->replay();
+}
+
+int JournaledCounter::add(uint32_t delta) {
+
+    if(_sector_count == 0) {
+        /** Not mounted */
+        return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+
+    if(_next_entry >= _entries_per_sector) {
+        /** Compact: restart the next sector with a snapshot of the value */
+        int err = this->start_sector((_sector + 1) % _sector_count, _sequence + 1);
+        if(err) {
+            return err;
+        }
+        _compaction_count++;
+    }
+
+    uint8_t slot[MAX_SLOT_SIZE];
+    memset(slot, 0, _entry_size);
+    entry_t entry = { delta, ~delta };
+    memcpy(slot, &entry, sizeof(entry));
+
+    /** The slot is consumed even if programming fails part way */
+    mbed::bd_addr_t address = this->entry_address(_next_entry++);
+    int err = _bd.program(slot, address, _entry_size);
+    if(err) {
+        return err;
+    }
+
+    _value += delta;
+    _append_count++;
+    return 0;
+}
+
+bool JournaledCounter::read_header(uint32_t sector, header_t &header) {
+    uint8_t slot[MAX_SLOT_SIZE];
+    if(_bd.read(slot, this->sector_address(sector), _header_size)) {
+        return false;
+    }
+    memcpy(&header, slot, sizeof(header));
+    return (header.magic == MAGIC && (header.base ^ header.base_check) == 0xFFFFFFFF);
+}
+
+int JournaledCounter::start_sector(uint32_t sector, uint32_t sequence) {
+
+    int err = _bd.erase(this->sector_address(sector), _sector_size);
+    if(err) {
+        return err;
+    }
+
+    uint8_t slot[MAX_SLOT_SIZE];
+    memset(slot, 0, _header_size);
+    header_t header = { MAGIC, sequence, _value, ~_value };
+    memcpy(slot, &header, sizeof(header));
+
+    err = _bd.program(slot, this->sector_address(sector), _header_size);
+    if(err) {
+        return err;
+    }
+
+    _sector = sector;
+    _sequence = sequence;
+    _next_entry = 0;
+    return 0;
+}
+
+int JournaledCounter::replay(void) {
+
+    uint8_t slot[MAX_SLOT_SIZE];
+    _next_entry = _entries_per_sector;
+
+    for(uint32_t i = 0; i < _entries_per_sector; i++) {
+        int err = _bd.read(slot, this->entry_address(i), _entry_size);
+        if(err) {
+            return err;
+        }
+
+        if(this->is_erased(slot, _entry_size)) {
+            _next_entry = i;
+            break;
+        }
+
+        entry_t entry;
+        memcpy(&entry, slot, sizeof(entry));
+        if((entry.delta ^ entry.delta_check) != 0xFFFFFFFF) {
+            /** Torn by a power loss, its slot stays consumed */
+            _torn_count++;
+            continue;
+        }
+        _value += entry.delta;
+    }
+
+    return 0;
+}
+
+bool JournaledCounter::is_erased(const uint8_t *data, size_t size) const {
+    for(size_t i = 0; i < size; i++) {
+        if(data[i] != (uint8_t) _erase_value) {
+            return false;
+        }
+    }
+    return true;
+}
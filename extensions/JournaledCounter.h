@@ -0,0 +1,191 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_JOURNALEDCOUNTER_H_
+#define EP_OC_MCU_EXTENSIONS_JOURNALEDCOUNTER_H_
+
+#include "blockdevice/BlockDevice.h"
+#include "platform/NonCopyable.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ep {
+
+/**
+ * A wear-leveled persistent counter (eg: boot count, runtime hours) kept
+ * as an append-only journal in a BlockDevice region.
+ *
+ * Each update programs one small delta entry into already erased flash
+ * instead of rewriting a whole KVStore record. The region is a ring of
+ * erase sectors. Each sector starts with a header holding the counter
+ * value at the time the sector was started, followed by delta entries.
+ * When the current sector is full, the next one is erased and started with
+ * a snapshot of the value, which implicitly discards the oldest sector.
+ * This compaction happens lazily, costs one sector erase and one header
+ * write at most, and spreads erases evenly over all sectors.
+ *
+ * init() finds the newest sector by its header and replays its entries in
+ * a single pass. Entries torn by a power loss are detected and skipped.
+ *
+ * @code
+ * ep::JournaledCounter boot_count(flash, 0x70000, 4 * 4096);
+ * flash.init();
+ * boot_count.init();
+ * boot_count.increment();
+ * @endcode
+ *
+ * @note The block device must have a defined erase value (eg: NOR flash)
+ * and the region must be at least 2 uniform erase sectors
+ * @note Not thread safe
+ */
+class JournaledCounter : private mbed::NonCopyable<JournaledCounter>
+{
+
+public:
+
+    /**
+     * Create a counter in a region of a block device
+     * @param[in] bd Block device, it may be initialized later, before init()
+     * @param[in] start Start of the region, aligned to an erase sector
+     * @param[in] size Size of the region, a multiple of the erase size
+     */
+    JournaledCounter(mbed::BlockDevice &bd, mbed::bd_addr_t start, mbed::bd_size_t size);
+
+    /**
+     * Mount the journal, formatting the region if it holds no journal
+     *
+     * The geometry of the block device is read here, so the block device
+     * must be initialized first.
+     *
+     * @retval 0 on success, or a BlockDevice error (also returned if the
+     * geometry is not usable)
+     */
+    int init(void);
+
+    /** Current value */
+    uint32_t get(void) const {
+        return _value;
+    }
+
+    /**
+     * Add to the counter (modulo 2^32)
+     * @retval 0 on success, or a BlockDevice error (the value is then unchanged)
+     */
+    int add(uint32_t delta);
+
+    int increment(void) {
+        return this->add(1);
+    }
+
+    /** Set the counter to a value, journaled as a delta */
+    int set(uint32_t value) {
+        return this->add(value - _value);
+    }
+
+    /** Number of entries appended since init */
+    uint32_t append_count(void) const {
+        return _append_count;
+    }
+
+    /** Number of sectors erased and restarted since init */
+    uint32_t compaction_count(void) const {
+        return _compaction_count;
+    }
+
+    /** Number of torn entries skipped by init */
+    uint32_t torn_count(void) const {
+        return _torn_count;
+    }
+
+protected:
+
+    static const uint32_t MAGIC = 0x4A524E4C; /* "JRNL" */
+
+    /** Largest program size supported */
+    static const uint32_t MAX_SLOT_SIZE = 64;
+
+    struct header_t {
+        uint32_t magic;
+        uint32_t sequence;
+        uint32_t base;
+        uint32_t base_check;
+    };
+
+    struct entry_t {
+        uint32_t delta;
+        uint32_t delta_check;
+    };
+
+    mbed::bd_addr_t sector_address(uint32_t sector) const {
+        return _start + (sector * _sector_size);
+    }
+
+    mbed::bd_addr_t entry_address(uint32_t index) const {
+        return this->sector_address(_sector) + _header_size + (index * _entry_size);
+    }
+
+    /** Read a header, returns false if the sector holds no valid one */
+    bool read_header(uint32_t sector, header_t &header);
+
+    /** Erase a sector and start it with the current value */
+    int start_sector(uint32_t sector, uint32_t sequence);
+
+    /** Replay the entries of the current sector */
+    int replay(void);
+
+    bool is_erased(const uint8_t *data, size_t size) const;
+
+protected:
+
+    mbed::BlockDevice &_bd;
+    mbed::bd_addr_t _start;
+    mbed::bd_size_t _size;
+
+    /** Read from the block device by init(), _sector_count stays 0 until mounted */
+    mbed::bd_size_t _sector_size;
+    uint32_t _sector_count;
+
+    /** Header and entry sizes rounded up to the program size */
+    uint32_t _header_size;
+    uint32_t _entry_size;
+    uint32_t _entries_per_sector;
+
+    int _erase_value;
+
+    /** Current sector, its sequence number and the next free entry in it */
+    uint32_t _sector;
+    uint32_t _sequence;
+    uint32_t _next_entry;
+
+    uint32_t _value;
+
+    uint32_t _append_count;
+    uint32_t _compaction_count;
+    uint32_t _torn_count;
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_JOURNALEDCOUNTER_H_ */
@@ -0,0 +1,255 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "MappedImage.h"
+
+#include "platform/mbed_assert.h"
+
+#include <cstring>
+#include <stddef.h>
+
+using namespace ep;
+
+static uint32_t round_up(uint32_t size, uint32_t unit) {
+    return ((size + unit - 1) / unit) * unit;
+}
+
+/** CRC-32 (IEEE 802.3), one nibble at a time to keep the table small */
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t size) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    const uint8_t *bytes = (const uint8_t *) data;
+    crc = ~crc;
+    for(size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ bytes[i]) & 0x0F] ^ (crc >> 4);
+        crc = table[(crc ^ (bytes[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+MappedImage::MappedImage(mbed::BlockDevice &bd, const void *mapped, mbed::bd_addr_t start, mbed::bd_size_t size) :
+        _bd(bd), _mapped((const uint8_t *) mapped), _start(start), _slot_size(size / 2),
+        _data_offset(0), _program_size(0), _active(-1), _sequence(0), _size(0),
+        _target(-1), _target_size(0), _written(0), _crc(0), _pending_size(0),
+        _update_count(0) {
+}
+
+int MappedImage::init(void) {
+
+    _active = -1;
+    _sequence = 0;
+    _size = 0;
+    _target = -1;
+
+    /** The geometry is only known once the block device is initialized */
+    mbed::bd_size_t erase_size = _bd.get_erase_size(_start);
+    _program_size = _bd.get_program_size();
+    if(erase_size == 0 || _program_size == 0) {
+        _program_size = 0;
+        return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+    MBED_ASSERT((_start % erase_size) == 0 && (_slot_size % erase_size) == 0);
+
+    MBED_ASSERT(_program_size <= MAX_PROGRAM_SIZE);
+    _data_offset = round_up(sizeof(header_t), _program_size);
+    MBED_ASSERT(_data_offset <= MAX_PROGRAM_SIZE && _data_offset < _slot_size);
+
+    header_t headers[2];
+    bool valid[2];
+    for(int slot = 0; slot < 2; slot++) {
+        valid[slot] = this->read_header(slot, headers[slot]);
+    }
+
+    /** Newest valid slot, sequence numbers compared modulo 2^32 */
+    for(int slot = 0; slot < 2; slot++) {
+        if(valid[slot] && (_active < 0 || (int32_t) (headers[slot].sequence - _sequence) > 0)) {
+            _active = slot;
+            _sequence = headers[slot].sequence;
+            _size = headers[slot].size;
+        }
+    }
+
+    return 0;
+}
+
+const void *MappedImage::data(void) const {
+    if(_active < 0) {
+        return NULL;
+    }
+    return this->slot_mapped(_active) + _data_offset;
+}
+
+size_t MappedImage::size(void) const {
+    return (_active < 0)? 0 : _size;
+}
+
+int MappedImage::update(const void *data, size_t size) {
+    int err = this->begin_update(size);
+    if(!err) {
+        err = this->write(data, size);
+    }
+    if(!err) {
+        err = this->commit_update();
+    }
+    return err;
+}
+
+int MappedImage::begin_update(size_t size) {
+    MBED_ASSERT(_program_size > 0 && size <= this->capacity());
+
+    /** Never erase the active image */
+    _target = (_active < 0)? 0 : (1 - _active);
+    _target_size = size;
+    _written = 0;
+    _crc = 0;
+    _pending_size = 0;
+
+    int err = _bd.erase(this->slot_address(_target), _slot_size);
+    if(err) {
+        _target = -1;
+    }
+    return err;
+}
+
+int MappedImage::write(const void *data, size_t size) {
+    MBED_ASSERT(_written + size <= _target_size);
+    if(_target < 0) {
+        /** A previous step failed, or no update was started */
+        return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+
+    const uint8_t *bytes = (const uint8_t *) data;
+    _crc = crc32_update(_crc, bytes, size);
+
+    /** Complete a partially filled program unit first */
+    if(_pending_size > 0) {
+        size_t chunk = _program_size - _pending_size;
+        if(chunk > size) {
+            chunk = size;
+        }
+        memcpy(_pending + _pending_size, bytes, chunk);
+        _pending_size += chunk;
+        _written += chunk;
+        bytes += chunk;
+        size -= chunk;
+
+        if(_pending_size < _program_size) {
+            return 0;
+        }
+        int err = this->flush_pending();
+        if(err) {
+            return err;
+        }
+    }
+
+    /** Program whole units straight from the caller's buffer */
+    size_t whole = (size / _program_size) * _program_size;
+    if(whole > 0) {
+        int err = _bd.program(bytes, this->slot_address(_target) + _data_offset + _written, whole);
+        if(err) {
+            _target = -1;
+            return err;
+        }
+        _written += whole;
+        bytes += whole;
+        size -= whole;
+    }
+
+    memcpy(_pending, bytes, size);
+    _pending_size = size;
+    _written += size;
+    return 0;
+}
+
+int MappedImage::flush_pending(void) {
+    if(_pending_size == 0) {
+        return 0;
+    }
+
+    /** The padding is past the end of the image and not covered by the CRC */
+    memset(_pending + _pending_size, 0xFF, _program_size - _pending_size);
+    mbed::bd_addr_t address = this->slot_address(_target) + _data_offset + _written - _pending_size;
+    int err = _bd.program(_pending, address, _program_size);
+    _pending_size = 0;
+    if(err) {
+        _target = -1;
+    }
+    return err;
+}
+
+int MappedImage::commit_update(void) {
+    if(_target < 0) {
+        /** A previous step failed, or no update was started */
+        return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+    MBED_ASSERT(_written == _target_size);
+
+    int err = this->flush_pending();
+    if(err) {
+        return err;
+    }
+
+    header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MAGIC;
+    header.sequence = _sequence + 1;
+    header.size = _target_size;
+    header.data_crc = _crc;
+    header.header_crc = crc32_update(0, &header, offsetof(header_t, header_crc));
+
+    /** The header is programmed last, it is what makes the slot valid */
+    memset(_pending, 0xFF, _data_offset);
+    memcpy(_pending, &header, sizeof(header));
+    int target = _target;
+    _target = -1;
+    err = _bd.program(_pending, this->slot_address(target), _data_offset);
+    if(err) {
+        return err;
+    }
+
+    /** Check what actually landed in flash before switching to it */
+    if(!this->read_header(target, header)) {
+        return mbed::BD_ERROR_DEVICE_ERROR;
+    }
+
+    _active = target;
+    _sequence = header.sequence;
+    _size = header.size;
+    _update_count++;
+    return 0;
+}
+
+bool MappedImage::read_header(int slot, header_t &header) const {
+    const uint8_t *mapped = this->slot_mapped(slot);
+    memcpy(&header, mapped, sizeof(header));
+
+    if(header.magic != MAGIC ||
+            header.header_crc != crc32_update(0, &header, offsetof(header_t, header_crc)) ||
+            header.size > this->capacity()) {
+        return false;
+    }
+
+    return (header.data_crc == crc32_update(0, mapped + _data_offset, header.size));
+}
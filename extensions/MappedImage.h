@@ -0,0 +1,191 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_MAPPEDIMAGE_H_
+#define EP_OC_MCU_EXTENSIONS_MAPPEDIMAGE_H_
+
+#include "blockdevice/BlockDevice.h"
+#include "platform/NonCopyable.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ep {
+
+/**
+ * A read-mostly blob stored in a region of memory-mapped flash (eg: a
+ * FlashIAPBlockDevice over internal flash) and read in place, without a
+ * copy in RAM.
+ *
+ * The region is split into two slots, A and B. Each slot holds a header
+ * (magic, sequence number, size, CRC-32 of the data) followed by the data.
+ * An update erases the inactive slot, programs the data and programs the
+ * header last, so the new image only becomes active once it is complete. A
+ * power loss during an update leaves the previous image active.
+ *
+ * The data of the active slot is read through the mapped address, so
+ * pointers returned by data() stay valid until the next update starts
+ * (which erases the slot that was active before the last update).
+ *
+ * @note On targets with a flash cache or an instruction/data cache in front
+ * of flash, the cache must be coherent with the block device's writes.
+ * @note Not thread safe
+ */
+class MappedImage : private mbed::NonCopyable<MappedImage>
+{
+
+public:
+
+    /**
+     * Create an image in a region of a block device. The block device is
+     * not accessed until init(), so the image can be a global object.
+     * @param[in] bd Block device, initialized before init()
+     * @param[in] mapped Address at which address 0 of the block device is mapped
+     * @param[in] start Start of the region, aligned to an erase sector
+     * @param[in] size Size of the region, two slots of a multiple of the erase size each
+     */
+    MappedImage(mbed::BlockDevice &bd, const void *mapped, mbed::bd_addr_t start, mbed::bd_size_t size);
+
+    /**
+     * Read the block device's geometry and select the newest valid slot
+     * @retval 0 on success, even if no slot holds a valid image, or
+     * BD_ERROR_DEVICE_ERROR if the block device is not initialized
+     */
+    int init(void);
+
+    /** True if a valid image is active */
+    bool valid(void) const {
+        return (_active >= 0);
+    }
+
+    /** Data of the active image, in mapped flash, NULL if there is none */
+    const void *data(void) const;
+
+    /** Size in bytes of the active image, 0 if there is none */
+    size_t size(void) const;
+
+    /** Sequence number of the active image, incremented by each update */
+    uint32_t sequence(void) const {
+        return _sequence;
+    }
+
+    /** Largest image that fits in a slot, 0 before init() */
+    size_t capacity(void) const {
+        return (_program_size > 0)? (_slot_size - _data_offset) : 0;
+    }
+
+    /**
+     * Replace the image
+     * @param[in] data New image
+     * @param[in] size Size of the new image in bytes
+     * @retval 0 on success, or a BlockDevice error (the previous image is then still active)
+     */
+    int update(const void *data, size_t size);
+
+    /**
+     * Start a streamed update, erasing the inactive slot
+     * @param[in] size Total size of the new image in bytes
+     * @retval 0 on success, or a BlockDevice error
+     */
+    int begin_update(size_t size);
+
+    /**
+     * Append to the image being updated
+     * @retval 0 on success, or a BlockDevice error (also once a previous step of the update failed)
+     */
+    int write(const void *data, size_t size);
+
+    /**
+     * Complete a streamed update and make it the active image
+     * @retval 0 on success, or a BlockDevice error (the previous image is then still active)
+     */
+    int commit_update(void);
+
+    /** Number of updates committed since init */
+    uint32_t update_count(void) const {
+        return _update_count;
+    }
+
+protected:
+
+    static const uint32_t MAGIC = 0x474D494D; /* "MIMG" */
+
+    /** Largest program size supported */
+    static const uint32_t MAX_PROGRAM_SIZE = 64;
+
+    struct header_t {
+        uint32_t magic;
+        uint32_t sequence;
+        uint32_t size;
+        uint32_t data_crc;
+        uint32_t reserved[3];
+        uint32_t header_crc;
+    };
+
+    mbed::bd_addr_t slot_address(int slot) const {
+        return _start + (slot * _slot_size);
+    }
+
+    const uint8_t *slot_mapped(int slot) const {
+        return _mapped + this->slot_address(slot);
+    }
+
+    /** Returns true if the slot holds a complete image with matching CRCs */
+    bool read_header(int slot, header_t &header) const;
+
+    /** Program the buffered bytes, padded to a program unit */
+    int flush_pending(void);
+
+protected:
+
+    mbed::BlockDevice &_bd;
+    const uint8_t *_mapped;
+    mbed::bd_addr_t _start;
+    mbed::bd_size_t _slot_size;
+
+    /** Offset of the data in a slot, the header rounded up to a program unit */
+    uint32_t _data_offset;
+    uint32_t _program_size;
+
+    /** Active slot, -1 if none */
+    int _active;
+    uint32_t _sequence;
+    uint32_t _size;
+
+    /** Streamed update: slot, expected size, bytes written and running CRC */
+    int _target;
+    uint32_t _target_size;
+    uint32_t _written;
+    uint32_t _crc;
+
+    /** Bytes not programmed yet because they do not fill a program unit */
+    uint8_t _pending[MAX_PROGRAM_SIZE];
+    uint32_t _pending_size;
+
+    uint32_t _update_count;
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_MAPPEDIMAGE_H_ */
@@ -0,0 +1,116 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_MAPPEDPERSISTENTARRAY_H_
+#define EP_OC_MCU_EXTENSIONS_MAPPEDPERSISTENTARRAY_H_
+
+#include "MappedImage.h"
+
+#include "platform/Span.h"
+#include "platform/NonCopyable.h"
+
+#include <type_traits>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ep {
+
+/**
+ * Read-mostly persistent array read in place from memory-mapped flash.
+ *
+ * Unlike PersistentArray, get() does not copy the array into RAM: it returns
+ * a span pointing into the active image of a MappedImage, or into the
+ * (typically const, so also in flash) default array if no valid image of
+ * the right size is stored. This suits large tables such as calibration
+ * curves or sensor configuration blobs, which would otherwise cost their
+ * size twice in RAM.
+ *
+ * @code
+ * static const float default_curve[64] = { ... };
+ *
+ * FlashIAPBlockDevice bd(CALIBRATION_ADDRESS, CALIBRATION_SIZE);
+ * ep::MappedImage image(bd, (const void *) CALIBRATION_ADDRESS, 0, CALIBRATION_SIZE);
+ * ep::MappedPersistentArray<float, 64> curve(image, default_curve);
+ *
+ * bd.init();
+ * image.init();
+ * float first = curve.get()[0];
+ * @endcode
+ *
+ * @note A span returned by get() stays valid until the second set() after it,
+ * since set() only erases the inactive image
+ * @note Not thread safe
+ */
+template<typename T, ptrdiff_t N>
+class MappedPersistentArray : private mbed::NonCopyable<MappedPersistentArray<T, N>>
+{
+
+    static_assert(std::is_trivially_copyable<T>::value, "MappedPersistentArray requires a trivially copyable type");
+
+public:
+
+    /**
+     * Create a mapped persistent array
+     * @param[in] image Image holding the array, initialized before the first get()
+     * @param[in] default_array Values used while the image holds no valid array,
+     * must outlive this object
+     */
+    MappedPersistentArray(MappedImage &image, mbed::Span<const T, N> default_array) :
+        _image(image), _default(default_array) {
+    }
+
+    /**
+     * Returns the stored array, or the default one if none is stored
+     * @note Interrupt safe, nothing is copied
+     */
+    mbed::Span<const T, N> get(void) const {
+        if(!this->stored()) {
+            return _default;
+        }
+        return mbed::Span<const T, N>((const T *) _image.data(), N);
+    }
+
+    /**
+     * Store a new array through an A/B image update
+     * @retval 0 on success, or a BlockDevice error (the previous array is then still stored)
+     */
+    int set(mbed::Span<const T, N> new_array) {
+        return _image.update(new_array.data(), N * sizeof(T));
+    }
+
+    /** True if a valid array is stored, false if get() returns the default */
+    bool stored(void) const {
+        return (_image.valid() && _image.size() == N * sizeof(T));
+    }
+
+protected:
+
+    MappedImage &_image;
+
+    mbed::Span<const T, N> _default;
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_MAPPEDPERSISTENTARRAY_H_ */
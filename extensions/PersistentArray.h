@@ -21,6 +21,8 @@
 #define EP_OC_MCU_EXTENSIONS_PERSISTENTARRAY_H_
 
 #include "kvstore_global_api.h"
+#include "PersistentGroup.h"
+#include "PersistentRegistry.h"
 #include "platform/mbed_error.h"
 #include "platform/mbed_assert.h"
 #include "platform/Span.h"
@@ -37,9 +39,25 @@ namespace ep {
  * Templatized Persistent Array built on top of Mbed's
  * KVStore API. If KVStore is not available the API will fall back to
  * non-volatile storage with a default initialized
+ *
+ * In cached mode, reads are served from RAM once the value has been loaded
+ * from (or written to) KVStore, and writes of bytes identical to the
+ * persisted ones are skipped. The cache assumes nothing else writes the key
+ * behind this object's back; call invalidate() or invalidate_all_caches()
+ * if something does (eg: after kv_reset).
+ *
+ * In write-behind mode (see set_writer, RTOS builds only), set() only updates the RAM copy and
+ * returns; a PersistentWriter thread writes it to KVStore later. Reads are
+ * then served from RAM as in cached mode.
+ *
+ * An array added to a PersistentGroup is stored in the group's packed
+ * record instead of its own key, see PersistentGroup.
+ *
+ * An array added to the PersistentRegistry is loaded at boot by
+ * PersistentRegistry::load_all and then read from RAM, as in cached mode.
  */
 template<typename T, ptrdiff_t N>
-class PersistentArray
+class PersistentArray : public PersistentEntry
 {
 public:
 
@@ -47,11 +65,15 @@ public:
      * Initialize a persistent array with a default array of values
      * @param[in] default_array Array of default values to use
      * @param[in] key Key to use for kvstore
+     * @param[in] flags Creation flags for kvstore API (eg: WRITE_ONCE_FLAG)
+     * @param[in] cached Serve reads from RAM and skip identical writes
      *
      * @note This value is only used if the persistent variable has not
      * been accessed before or if the kvstore is unavailable for some reason
      */
-    PersistentArray(mbed::Span<T,N> default_array, const char *key, uint32_t flags = 0) : _key(key), _flags(flags) {
+    PersistentArray(mbed::Span<T,N> default_array, const char *key, uint32_t flags = 0, bool cached = false) :
+        _key(key), _flags(flags), _cached(cached), _cache_generation(0),
+        _hit_count(0), _skipped_write_count(0), _flash_write_count(0) {
         memcpy(_array, default_array.data(), N*sizeof(T));
     }
 
@@ -59,16 +81,34 @@ public:
      * Initialize a persistent array with a default value
      * @param[in] default_value The default value of the array. Every array element will be set to this value.
      * @param[in] key Key to use for kvstore
+     * @param[in] flags Creation flags for kvstore API (eg: WRITE_ONCE_FLAG)
+     * @param[in] cached Serve reads from RAM and skip identical writes
      *
      * @note This value is only used if the persistent variable has not
      * been accessed before or if the kvstore is unavailable for some reason
      */
-    PersistentArray(T default_value, const char *key, uint32_t flags = 0) : _key(key), _flags(flags) {
-        memset(_array, default_value, N*sizeof(T));
+    PersistentArray(T default_value, const char *key, uint32_t flags = 0, bool cached = false) :
+        _key(key), _flags(flags), _cached(cached), _cache_generation(0),
+        _hit_count(0), _skipped_write_count(0), _flash_write_count(0) {
+        for(ptrdiff_t i = 0; i < N; i++) {
+            _array[i] = default_value;
+        }
     }
 
     /** Destructor */
     ~PersistentArray(void) {
+#if defined(MBED_CONF_RTOS_PRESENT)
+        /* Never leave a dangling pointer on the writer's dirty list */
+        if(_writer) {
+            this->remove_from_writer();
+        }
+#endif
+        if(_group) {
+            _group->remove(*this);
+        }
+        if(_registered) {
+            PersistentRegistry::remove(*this);
+        }
     }
 
     /**
@@ -78,9 +118,31 @@ public:
      */
     mbed::Span<T,N> get(void)   {
 
+        /* Serve the RAM copy if it is known to be current */
+        if(this->ram_is_current()) {
+            _hit_count++;
+            return mbed::make_Span(_array);
+        }
+
         /* If we're in an ISR, just return the cached value */
         if(!core_util_is_isr_active()) {
 
+            /* Members of a group are loaded with the whole packed record */
+            if(_group) {
+                _group->load();
+                if(this->ram_is_current()) {
+                    return mbed::make_Span(_array);
+                }
+            }
+
+            /* Registered entries are (re)loaded with their migrations applied */
+            if(_registered) {
+                PersistentRegistry::load(*this);
+                if(this->ram_is_current()) {
+                    return mbed::make_Span(_array);
+                }
+            }
+
             // Try to access the KVStore partition
             size_t actual_size;
             int err = kv_get(_key, _array, N*sizeof(T), &actual_size);
@@ -93,6 +155,11 @@ public:
 
                 this->set(mbed::make_Span(_array));
 
+                /* Persisted through a group, not under our own key */
+                if(_group && this->ram_is_current()) {
+                    return mbed::make_Span(_array);
+                }
+
                 // Now try to get the key... if this doesn't work we will return default
                 err = kv_get(_key, _array, N*sizeof(T), &actual_size);
             }
@@ -103,6 +170,13 @@ public:
 
             if(actual_size != N*sizeof(T)) {
                 mbed_tracef(TRACE_LEVEL_WARN, "PARR", "actual size (%u) of kvstore entry did not match expected size (%u)", actual_size, N*sizeof(T));
+            } else if(!err) {
+                this->validate_cache();
+
+                /* Not in the packed record yet, the group moves it there on its next write */
+                if(_group) {
+                    _in_own_key = true;
+                }
             }
         }
 
@@ -113,22 +187,68 @@ public:
      * Attempts to set the underlying value in KVStore
      * @param[in] value Value to set
      *
-     * @note Not interrupt safe
+     * @note Not interrupt safe, except in write-behind mode
      */
     void set(mbed::Span<T,N> new_value)  {
 
+        /* Persisted (or pending) bytes are known, skip identical writes */
+        if(this->uses_ram_copy() && this->cache_valid() &&
+                memcmp(_array, new_value.data(), N*sizeof(T)) == 0) {
+            _skipped_write_count++;
+            return;
+        }
+
+        if(_group) {
+            /* The group writes its packed record now or at commit */
+            memcpy(_array, new_value.data(), new_value.size()*sizeof(T));
+            this->validate_cache();
+            if(_group->on_member_set(*this)) {
+                /* RAM no longer matches what is persisted */
+                this->invalidate();
+            }
+            return;
+        }
+
+#if defined(MBED_CONF_RTOS_PRESENT)
+        if(_writer) {
+            /* Write-behind: update RAM and let the writer persist it */
+            core_util_critical_section_enter();
+            memcpy(_array, new_value.data(), new_value.size()*sizeof(T));
+            core_util_critical_section_exit();
+            this->validate_cache();
+            this->mark_dirty();
+            return;
+        }
+#endif
+
         memcpy(_array, new_value.data(), new_value.size()*sizeof(T));
 
         /**
          * Try to access the KVStore partition
          * If this doesn't work value stays default
          */
-        int err = kv_set(_key, _array, N*sizeof(T), _flags);
+        if(this->write_kv(_array)) {
+            /* RAM no longer matches what is persisted */
+            this->invalidate();
+        } else {
+            this->validate_cache();
+        }
+    }
 
-        if(err) {
-            mbed_tracef(TRACE_LEVEL_WARN, "PARR", "could not set entry \"%s\": %d", _key, err);
+#if defined(MBED_CONF_RTOS_PRESENT)
+    /**
+     * Switch to write-behind mode
+     * @param[in] writer Writer persisting this array, NULL to go back to
+     * synchronous writes. A value still pending on the previous writer is written first.
+     * @note Not interrupt safe
+     */
+    void set_writer(PersistentWriter *writer) {
+        if(_writer && _writer != writer) {
+            this->remove_from_writer();
         }
+        _writer = writer;
     }
+#endif
 
     /**
      * Checks if the given PersistentVariable already exists in KVStore
@@ -139,6 +259,9 @@ public:
         /* This API cannot be called from an ISR, assert here if so
          * Otherwise it will assert later on and be harder to find. */
         assert(!core_util_is_isr_active());
+        if(this->ram_is_current()) {
+            return true;
+        }
         size_t actual_size;
         int err = kv_get(_key, _array, sizeof(T), &actual_size);
         if(err) {
@@ -149,12 +272,126 @@ public:
         }
     }
 
+    /** Force the next access to go to KVStore */
+    void invalidate(void) {
+        _cache_generation = 0;
+    }
+
+    /** Force every cached PersistentArray to reload from KVStore */
+    static void invalidate_all_caches(void) {
+        persistent_cache_generation()++;
+    }
+
+    /** Number of reads served from RAM in cached mode */
+    uint32_t hit_count(void) const {
+        return _hit_count;
+    }
+
+    /** Number of writes skipped because the value was already persisted */
+    uint32_t skipped_write_count(void) const {
+        return _skipped_write_count;
+    }
+
+    /** Number of writes issued to KVStore */
+    uint32_t flash_write_count(void) const {
+        return _flash_write_count;
+    }
+
+protected:
+
+    /**
+     * Write-behind: called by the writer, persists a snapshot of the RAM copy.
+     * The writer keeps the entry dirty if the write fails, so reads still
+     * return the RAM copy instead of reloading the old value.
+     */
+    virtual int write_back(void) {
+        uint8_t data[N*sizeof(T)];
+
+        core_util_critical_section_enter();
+        memcpy(data, _array, sizeof(data));
+        core_util_critical_section_exit();
+
+        /**
+         * On failure RAM no longer matches what is persisted. Invalidate so
+         * the next set() is not skipped as identical and writes it again.
+         */
+        int err = this->write_kv(data);
+        if(err) {
+            this->invalidate();
+        }
+        return err;
+    }
+
+    virtual const char *entry_key(void) const {
+        return _key;
+    }
+
+    virtual size_t entry_size(void) const {
+        return N*sizeof(T);
+    }
+
+    virtual bool entry_loaded(void) const {
+        return this->cache_valid();
+    }
+
+    virtual void snapshot(void *out) {
+        core_util_critical_section_enter();
+        memcpy(out, _array, N*sizeof(T));
+        core_util_critical_section_exit();
+    }
+
+    virtual void restore(const void *data) {
+        memcpy(_array, data, N*sizeof(T));
+        this->validate_cache();
+    }
+
+    int write_kv(const void *data) {
+        int err = kv_set(_key, data, N*sizeof(T), _flags);
+        _flash_write_count++;
+
+        if(err) {
+            mbed_tracef(TRACE_LEVEL_WARN, "PARR", "could not set entry \"%s\": %d", _key, err);
+        }
+        return err;
+    }
+
+    /** True if reads are served from RAM once loaded */
+    bool uses_ram_copy(void) const {
+        return (_cached || _writer || _group || _registered);
+    }
+
+    /**
+     * True if _array is current: loaded in cached or group mode, or newer
+     * than KVStore in write-behind mode
+     */
+    bool ram_is_current(void) const {
+        return (this->uses_ram_copy() && this->cache_valid()) || _dirty;
+    }
+
+    /** True if _array holds the bytes persisted in KVStore */
+    bool cache_valid(void) const {
+        return (_cache_generation == persistent_cache_generation());
+    }
+
+    void validate_cache(void) {
+        _cache_generation = persistent_cache_generation();
+    }
+
 protected:
 
     T _array[N];
     const char *_key;
 
     uint32_t _flags;
+
+    bool _cached;
+
+    /** persistent_cache_generation() when _array was last known to match KVStore, 0 if never */
+    uint32_t _cache_generation;
+
+    uint32_t _hit_count;
+    uint32_t _skipped_write_count;
+    uint32_t _flash_write_count;
 };
 
 }
@@ -0,0 +1,163 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_PERSISTENTENTRY_H_
+#define EP_OC_MCU_EXTENSIONS_PERSISTENTENTRY_H_
+
+#include "platform/Callback.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ep {
+
+class PersistentWriter;
+class PersistentGroup;
+class PersistentRegistry;
+
+/**
+ * Generation of the KVStore contents as seen by cached PersistentArrays.
+ * Bumping it (see PersistentArray::invalidate_all_caches) forces every
+ * cached PersistentArray to reload from KVStore on its next access.
+ */
+inline uint32_t &persistent_cache_generation(void) {
+    static uint32_t generation = 1;
+    return generation;
+}
+
+/**
+ * Untyped view of a PersistentArray, used by PersistentWriter,
+ * PersistentGroup and PersistentRegistry to persist it without knowing its type
+ */
+class PersistentEntry
+{
+
+public:
+
+    /**
+     * Migration of a stored value whose schema version or size differs from
+     * the current one, see PersistentRegistry::add
+     * @param[in] stored Stored value
+     * @param[in] stored_size Size of the stored value in bytes
+     * @param[in] stored_version Schema version the value was stored with
+     * @param[in,out] value Current value, holding the default on entry
+     * @retval true if value was migrated, false to keep the default
+     */
+    typedef mbed::Callback<bool(const void *, size_t, uint16_t, void *)> migrate_t;
+
+    PersistentEntry() : _writer(NULL), _next_dirty(NULL), _dirty(false), _queued(false),
+        _group(NULL), _next_in_group(NULL), _in_own_key(false), _registered(false),
+        _registry_write(false), _schema_current(false), _schema_version(0), _next_registered(NULL) {
+    }
+
+    virtual ~PersistentEntry() {
+    }
+
+protected:
+
+    friend class PersistentWriter;
+    friend class PersistentGroup;
+    friend class PersistentRegistry;
+
+    /**
+     * Write the current RAM copy to KVStore.
+     * Called from the writer's thread (or a flush() caller) with the writer locked.
+     * @retval 0 on success, or the KVStore error
+     */
+    virtual int write_back(void) = 0;
+
+    /** KVStore key of the entry */
+    virtual const char *entry_key(void) const = 0;
+
+    /** Size of the entry's value in bytes */
+    virtual size_t entry_size(void) const = 0;
+
+    /** True if the RAM copy is known to be current */
+    virtual bool entry_loaded(void) const = 0;
+
+    /** Copy the RAM copy out, entry_size() bytes */
+    virtual void snapshot(void *out) = 0;
+
+    /** Replace the RAM copy with a value loaded from KVStore, entry_size() bytes */
+    virtual void restore(const void *data) = 0;
+
+#if defined(MBED_CONF_RTOS_PRESENT)
+    /**
+     * Queue the entry on its writer, see PersistentWriter::mark_dirty.
+     * Out of line so users of PersistentArray only need the forward declaration.
+     */
+    void mark_dirty(void);
+
+    /** Leave the writer before destruction, see PersistentWriter::remove */
+    void remove_from_writer(void);
+#endif
+
+protected:
+
+    /** Writer this entry is written back by, NULL to write synchronously */
+    PersistentWriter *_writer;
+
+    /** Next entry in the writer's dirty list */
+    PersistentEntry *_next_dirty;
+
+    /** True while the RAM copy is newer than KVStore, until the writer persists it */
+    volatile bool _dirty;
+
+    /** True while the entry is on the writer's dirty list */
+    volatile bool _queued;
+
+    /** Group this entry is stored in, NULL if it has its own key */
+    PersistentGroup *_group;
+
+    /** Next member of the group */
+    PersistentEntry *_next_in_group;
+
+    /** Group member loaded from its own key, removed once it is in the packed record */
+    bool _in_own_key;
+
+    /** True if the entry is in the PersistentRegistry */
+    bool _registered;
+
+    /** The registry rewrites the entry at the end of its load pass */
+    bool _registry_write;
+
+    /**
+     * The stored value is known to have the current size and schema version,
+     * so reloading it after an invalidation needs no schema or migration record
+     */
+    bool _schema_current;
+
+    /** Schema version the entry is stored with */
+    uint16_t _schema_version;
+
+    /** Migration of values stored with another schema version or size */
+    migrate_t _migrate;
+
+    /** Next entry in the registry */
+    PersistentEntry *_next_registered;
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_PERSISTENTENTRY_H_ */
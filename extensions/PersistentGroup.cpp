@@ -0,0 +1,245 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "PersistentGroup.h"
+
+#include "kvstore_global_api.h"
+#include "platform/mbed_error.h"
+#include "platform/mbed_assert.h"
+#include "mbed-trace/mbed_trace.h"
+
+#include <cstring>
+#include <new>
+
+using namespace ep;
+
+PersistentGroup::PersistentGroup(const char *key, uint32_t flags) :
+        _key(key), _flags(flags), _members(NULL), _depth(0), _changed(false),
+        _loaded_generation(0), _commit_count(0), _bytes_written(0) {
+}
+
+PersistentGroup::~PersistentGroup() {
+    while(_members) {
+        this->remove(*_members);
+    }
+}
+
+void PersistentGroup::add(PersistentEntry &entry) {
+    MBED_ASSERT(strlen(entry.entry_key()) <= UINT8_MAX);
+    MBED_ASSERT(entry.entry_size() <= UINT16_MAX);
+    entry._group = this;
+    entry._next_in_group = _members;
+    _members = &entry;
+}
+
+void PersistentGroup::remove(PersistentEntry &entry) {
+    for(PersistentEntry **link = &_members; *link; link = &(*link)->_next_in_group) {
+        if(*link == &entry) {
+            *link = entry._next_in_group;
+            break;
+        }
+    }
+    entry._group = NULL;
+    entry._next_in_group = NULL;
+}
+
+int PersistentGroup::load(void) {
+
+    if(_loaded_generation == persistent_cache_generation()) {
+        return 0;
+    }
+    _loaded_generation = persistent_cache_generation();
+
+    return this->load_record();
+}
+
+int PersistentGroup::load_record(void) {
+
+    kv_info_t info;
+    int err = kv_get_info(_key, &info);
+    if(err) {
+        if(err != MBED_ERROR_ITEM_NOT_FOUND) {
+            mbed_tracef(TRACE_LEVEL_WARN, "PGRP", "could not get info of \"%s\": %d", _key, err);
+        }
+        return err;
+    }
+
+    uint8_t *record = new (std::nothrow) uint8_t[info.size];
+    if(!record) {
+        return MBED_ERROR_ENOMEM;
+    }
+
+    size_t actual_size;
+    err = kv_get(_key, record, info.size, &actual_size);
+    if(err || actual_size < sizeof(header_t)) {
+        mbed_tracef(TRACE_LEVEL_WARN, "PGRP", "could not get \"%s\": %d", _key, err);
+        delete[] record;
+        return err? err : MBED_ERROR_INVALID_SIZE;
+    }
+
+    header_t header;
+    memcpy(&header, record, sizeof(header));
+    if(header.magic != MAGIC || header.version != VERSION) {
+        mbed_tracef(TRACE_LEVEL_WARN, "PGRP", "\"%s\" is not a packed record", _key);
+        delete[] record;
+        return MBED_ERROR_INVALID_DATA_DETECTED;
+    }
+
+    /** One pass over the record, matching each stored key to a member */
+    const uint8_t *p = record + sizeof(header_t);
+    const uint8_t *end = record + actual_size;
+    for(uint16_t i = 0; i < header.count; i++) {
+        if(p + 1 > end || p + 1 + p[0] + sizeof(uint16_t) > end) {
+            break;
+        }
+        uint8_t key_len = p[0];
+        const char *key = (const char *) (p + 1);
+        uint16_t size;
+        memcpy(&size, p + 1 + key_len, sizeof(size));
+        const uint8_t *value = p + 1 + key_len + sizeof(size);
+        if(value + size > end) {
+            break;
+        }
+
+        for(PersistentEntry *member = _members; member; member = member->_next_in_group) {
+            const char *member_key = member->entry_key();
+            if(strlen(member_key) == key_len && memcmp(member_key, key, key_len) == 0) {
+                /** Never overwrite a newer value set before the load */
+                if(member->entry_size() == size && !member->entry_loaded()) {
+                    member->restore(value);
+                }
+                break;
+            }
+        }
+
+        p = value + size;
+    }
+
+    delete[] record;
+    return 0;
+}
+
+void PersistentGroup::begin(void) {
+    _depth++;
+}
+
+int PersistentGroup::commit(void) {
+    MBED_ASSERT(_depth > 0);
+    if(--_depth > 0 || !_changed) {
+        return 0;
+    }
+    return this->write();
+}
+
+int PersistentGroup::on_member_set(PersistentEntry &) {
+    _changed = true;
+    if(_depth == 0) {
+        return this->write();
+    }
+    return 0;
+}
+
+size_t PersistentGroup::packed_size(void) const {
+    size_t size = sizeof(header_t);
+    for(PersistentEntry *member = _members; member; member = member->_next_in_group) {
+        if(member->entry_loaded()) {
+            size += 1 + strlen(member->entry_key()) + sizeof(uint16_t) + member->entry_size();
+        }
+    }
+    return size;
+}
+
+int PersistentGroup::write(void) {
+
+    /**
+     * Members not loaded in RAM (eg: never read since boot, or invalidated)
+     * would be left out of the new record, take their stored value first
+     */
+    for(PersistentEntry *member = _members; member; member = member->_next_in_group) {
+        if(!member->entry_loaded()) {
+            int err = this->load_record();
+            if(err && err != MBED_ERROR_ITEM_NOT_FOUND) {
+                return err;
+            }
+            break;
+        }
+    }
+
+    size_t size = this->packed_size();
+    uint8_t *record = new (std::nothrow) uint8_t[size];
+    if(!record) {
+        return MBED_ERROR_ENOMEM;
+    }
+
+    header_t header = { MAGIC, VERSION, 0 };
+    uint8_t *p = record + sizeof(header_t);
+
+    /**
+     * Members that were never loaded are left out, so a value still in
+     * its own key is not shadowed by a default in the packed record
+     */
+    for(PersistentEntry *member = _members; member; member = member->_next_in_group) {
+        if(!member->entry_loaded()) {
+            continue;
+        }
+        const char *key = member->entry_key();
+        uint8_t key_len = strlen(key);
+        uint16_t value_size = member->entry_size();
+
+        *p++ = key_len;
+        memcpy(p, key, key_len);
+        p += key_len;
+        memcpy(p, &value_size, sizeof(value_size));
+        p += sizeof(value_size);
+        member->snapshot(p);
+        p += value_size;
+        header.count++;
+    }
+    memcpy(record, &header, sizeof(header));
+
+    int err = kv_set(_key, record, size, _flags);
+    delete[] record;
+
+    if(err) {
+        mbed_tracef(TRACE_LEVEL_WARN, "PGRP", "could not set \"%s\": %d", _key, err);
+        return err;
+    }
+
+    _changed = false;
+    _commit_count++;
+    _bytes_written += size;
+
+    /** Values moved from their own key are now in the packed record */
+    for(PersistentEntry *member = _members; member; member = member->_next_in_group) {
+        if(member->_in_own_key && member->entry_loaded()) {
+            err = kv_remove(member->entry_key());
+            if(err && err != MBED_ERROR_ITEM_NOT_FOUND) {
+                mbed_tracef(TRACE_LEVEL_WARN, "PGRP", "could not remove \"%s\": %d", member->entry_key(), err);
+            } else {
+                member->_in_own_key = false;
+            }
+        }
+    }
+
+    return 0;
+}
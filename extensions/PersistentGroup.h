@@ -0,0 +1,182 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_PERSISTENTGROUP_H_
+#define EP_OC_MCU_EXTENSIONS_PERSISTENTGROUP_H_
+
+#include "PersistentEntry.h"
+
+#include "platform/NonCopyable.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ep {
+
+/**
+ * Stores many PersistentArrays/PersistentVariables in one packed KVStore
+ * record, so saving a configuration costs one KVStore write (one record
+ * header, one possible garbage collection) instead of one per variable.
+ *
+ * Members are read and written as usual. Outside a transaction, setting a
+ * member rewrites the packed record right away. Between begin() and commit(),
+ * sets only update RAM and commit() writes every member in one atomic
+ * kv_set; nothing is written if no member changed.
+ *
+ * @code
+ * ep::PersistentGroup config("config");
+ * ep::PersistentVariable<float> setpoint(20.0f, "setpoint");
+ * ep::PersistentVariable<float> gain(1.0f, "gain");
+ *
+ * config.add(setpoint);
+ * config.add(gain);
+ *
+ * config.begin();
+ * setpoint = 21.5f;
+ * gain = 0.8f;
+ * config.commit();
+ * @endcode
+ *
+ * The packed record is loaded in one pass the first time any member is
+ * read. A member missing from the record (eg: stored by a firmware that
+ * did not use groups) falls back to its own key, and moves into the packed
+ * record the next time the record is written. Its own key is then removed.
+ *
+ * Writing the record never drops a member that is not loaded in RAM: its
+ * stored value is reloaded from the record first.
+ *
+ * Record layout: a header (magic, version, member count) followed by, for
+ * each member, the key length, the key, the value size and the value.
+ * Members whose stored size differs from their current size are ignored.
+ *
+ * @note Not thread safe, use a group from one thread
+ */
+class PersistentGroup : private mbed::NonCopyable<PersistentGroup>
+{
+
+public:
+
+    /**
+     * Create a group
+     * @param[in] key Key of the packed record
+     * @param[in] flags Creation flags for kvstore API
+     */
+    PersistentGroup(const char *key, uint32_t flags = 0);
+
+    /** Members outliving the group go back to their own key */
+    ~PersistentGroup();
+
+    /**
+     * Add a member, before it is first read or written
+     * @note Keys of members must be unique and at most 255 characters long,
+     * and values smaller than 64 KiB
+     */
+    void add(PersistentEntry &entry);
+
+    /**
+     * Remove a member, called when it is destroyed. Its value is left out
+     * of the record the next time the record is written.
+     */
+    void remove(PersistentEntry &entry);
+
+    /**
+     * Load the packed record into every member that is not loaded yet
+     * @retval 0 on success, or the KVStore error
+     */
+    int load(void);
+
+    /** Start a transaction, transactions may be nested */
+    void begin(void);
+
+    /**
+     * End a transaction, writing the packed record if any member changed
+     * and this is the outermost transaction
+     * @retval 0 on success, or the KVStore error
+     */
+    int commit(void);
+
+    bool in_transaction(void) const {
+        return (_depth > 0);
+    }
+
+    /**
+     * Called by a member after its RAM copy changed
+     * @retval 0 on success or inside a transaction, or the KVStore error
+     */
+    int on_member_set(PersistentEntry &entry);
+
+    /** Number of packed record writes */
+    uint32_t commit_count(void) const {
+        return _commit_count;
+    }
+
+    /** Number of bytes written to KVStore, not counting KVStore's own overhead */
+    uint32_t bytes_written(void) const {
+        return _bytes_written;
+    }
+
+protected:
+
+    static const uint32_t MAGIC = 0x50475250; /* "PGRP" */
+    static const uint16_t VERSION = 1;
+
+    struct header_t {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t count;
+    };
+
+    /**
+     * Restore every member that is not loaded from the stored record
+     * @retval 0 on success, or the KVStore error
+     */
+    int load_record(void);
+
+    /** Size of the packed record holding the given members */
+    size_t packed_size(void) const;
+
+    int write(void);
+
+protected:
+
+    const char *_key;
+    uint32_t _flags;
+
+    PersistentEntry *_members;
+
+    uint32_t _depth;
+
+    /** A member changed since the last commit */
+    bool _changed;
+
+    /** persistent_cache_generation() when the record was last loaded, 0 if never */
+    uint32_t _loaded_generation;
+
+    uint32_t _commit_count;
+    uint32_t _bytes_written;
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_PERSISTENTGROUP_H_ */
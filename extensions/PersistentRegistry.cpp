@@ -0,0 +1,553 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "PersistentRegistry.h"
+#include "PersistentGroup.h"
+
+#include "kvstore_global_api.h"
+#include "platform/mbed_error.h"
+#include "platform/mbed_assert.h"
+#include "mbed-trace/mbed_trace.h"
+
+#include <cstring>
+#include <new>
+
+using namespace ep;
+
+const char *const PersistentRegistry::SCHEMA_KEY = "persistent_schema";
+const char *const PersistentRegistry::MIGRATION_KEY = "persistent_migration";
+
+void PersistentRegistry::add(PersistentEntry &entry, uint16_t version, PersistentEntry::migrate_t migrate) {
+    MBED_ASSERT(!entry._registered);
+    MBED_ASSERT(strlen(entry.entry_key()) <= UINT8_MAX);
+    entry._registered = true;
+    entry._schema_current = false;
+    entry._schema_version = version;
+    entry._migrate = migrate;
+    entry._next_registered = head();
+    head() = &entry;
+}
+
+void PersistentRegistry::remove(PersistentEntry &entry) {
+    for(PersistentEntry **link = &head(); *link; link = &(*link)->_next_registered) {
+        if(*link == &entry) {
+            *link = entry._next_registered;
+            break;
+        }
+    }
+    entry._registered = false;
+    entry._next_registered = NULL;
+}
+
+int PersistentRegistry::load_all(void) {
+    return load_entries(NULL);
+}
+
+int PersistentRegistry::load(PersistentEntry &entry) {
+    MBED_ASSERT(entry._registered);
+
+    /** Members of a group are loaded with the whole packed record */
+    if(entry._group) {
+        return entry._group->load();
+    }
+
+    /** Already stored with its current version, no record needs to be read */
+    if(entry._schema_current) {
+        return 0;
+    }
+    return load_entries(&entry);
+}
+
+int PersistentRegistry::load_entries(PersistentEntry *only) {
+
+    /** Finish a migration interrupted by a power loss before reading any value */
+    int result = finish_migration();
+    bool migration_pending = (result != 0);
+
+    /** Scratch buffer for values, as large as the largest entry to load */
+    size_t max_size = only ? only->entry_size() : 0;
+    for(PersistentEntry *entry = only ? NULL : head(); entry; entry = entry->_next_registered) {
+        if(entry->entry_size() > max_size) {
+            max_size = entry->entry_size();
+        }
+    }
+
+    uint8_t *buffer = new (std::nothrow) uint8_t[max_size];
+    if(!buffer) {
+        return MBED_ERROR_ENOMEM;
+    }
+
+    /** A missing or unreadable schema record lists no versions */
+    size_t schema_size;
+    uint8_t *schema = read_record(SCHEMA_KEY, SCHEMA_MAGIC, schema_size);
+
+    /** First pass: read every value */
+    bool schema_changed = false;
+    for(PersistentEntry *entry = head(); entry; entry = entry->_next_registered) {
+        if(only && entry != only) {
+            continue;
+        }
+        if(entry->_group) {
+            entry->_group->load();
+            continue;
+        }
+        /** Never overwrite a newer value set before the load */
+        if(entry->entry_loaded() || entry->_dirty) {
+            continue;
+        }
+        int err = load_entry(*entry, schema, schema_size, buffer, schema_changed);
+        if(err && !result) {
+            result = err;
+        }
+    }
+
+    /**
+     * Values rewritten with a new version are logged first. Without the log,
+     * a power loss between the value and schema writes would leave migrated
+     * values listed with their old version, to be migrated again or reset.
+     */
+    if(schema_changed) {
+        int err = write_migration();
+        if(err) {
+            /** Nothing is rewritten, the stored values are migrated again on the next load */
+            for(PersistentEntry *entry = head(); entry; entry = entry->_next_registered) {
+                entry->_registry_write = false;
+            }
+            if(!result) {
+                result = err;
+            }
+            schema_changed = false;
+        }
+    }
+
+    /** Second pass: write the missing defaults and the migrated values together */
+    bool rewritten = true;
+    for(PersistentEntry *entry = head(); entry; entry = entry->_next_registered) {
+        if(!entry->_registry_write) {
+            continue;
+        }
+        int err = entry->write_back();
+        if(err) {
+            rewritten = false;
+            if(!result) {
+                result = err;
+            }
+        }
+    }
+
+    /** On failure, the migration record is left for the next load to finish */
+    if(schema_changed && rewritten) {
+        int err = write_schema(schema, schema_size, NULL, 0);
+        if(!err) {
+            err = kv_remove(MIGRATION_KEY);
+        }
+        if(err && !result) {
+            result = err;
+        }
+        rewritten = !err;
+    }
+
+    /** Rewritten values are stored with their current version once the schema record lists it */
+    for(PersistentEntry *entry = head(); entry; entry = entry->_next_registered) {
+        if(entry->_registry_write) {
+            entry->_registry_write = false;
+            entry->_schema_current = rewritten && entry->entry_loaded();
+        }
+        /** The schema record may still list old versions, read it again on the next load */
+        if(migration_pending) {
+            entry->_schema_current = false;
+        }
+    }
+
+    delete[] schema;
+    delete[] buffer;
+    return result;
+}
+
+int PersistentRegistry::load_entry(PersistentEntry &entry, const uint8_t *schema, size_t schema_size,
+        uint8_t *buffer, bool &schema_changed) {
+
+    const char *key = entry.entry_key();
+    size_t size = entry.entry_size();
+    uint16_t version = stored_version(schema, schema_size, key);
+
+    kv_info_t info;
+    int err = kv_get_info(key, &info);
+    if(err == MBED_ERROR_ITEM_NOT_FOUND) {
+        /** Write the default, which is in RAM until the entry is loaded */
+        entry.snapshot(buffer);
+        entry.restore(buffer);
+        entry._registry_write = true;
+        stats().default_writes++;
+        schema_changed |= (version != entry._schema_version);
+        return 0;
+    }
+    if(err) {
+        mbed_tracef(TRACE_LEVEL_WARN, "PREG", "could not get info of \"%s\": %d", key, err);
+        return err;
+    }
+
+    if(info.size == size && version == entry._schema_version) {
+        size_t actual_size;
+        err = kv_get(key, buffer, size, &actual_size);
+        if(err) {
+            mbed_tracef(TRACE_LEVEL_WARN, "PREG", "could not get \"%s\": %d", key, err);
+            return err;
+        }
+        entry.restore(buffer);
+        entry._schema_current = true;
+        return 0;
+    }
+
+    /** Stored with another size or version: migrate it, or fall back to the default */
+    uint8_t *stored = new (std::nothrow) uint8_t[info.size];
+    if(!stored) {
+        return MBED_ERROR_ENOMEM;
+    }
+
+    size_t actual_size;
+    err = kv_get(key, stored, info.size, &actual_size);
+    if(err) {
+        mbed_tracef(TRACE_LEVEL_WARN, "PREG", "could not get \"%s\": %d", key, err);
+        delete[] stored;
+        return err;
+    }
+
+    entry.snapshot(buffer);
+    if(!entry._migrate || !entry._migrate(stored, actual_size, version, buffer)) {
+        mbed_tracef(TRACE_LEVEL_WARN, "PREG", "\"%s\" (version %u, %u bytes) reset to default (version %u, %u bytes)",
+                key, version, actual_size, entry._schema_version, size);
+        entry.snapshot(buffer);
+    }
+    delete[] stored;
+
+    entry.restore(buffer);
+    entry._registry_write = true;
+    stats().migrations++;
+    schema_changed |= (version != entry._schema_version);
+    return 0;
+}
+
+uint8_t *PersistentRegistry::read_record(const char *key, uint32_t magic, size_t &size) {
+
+    size = 0;
+
+    kv_info_t info;
+    if(kv_get_info(key, &info) != 0 || info.size < sizeof(header_t)) {
+        return NULL;
+    }
+
+    uint8_t *record = new (std::nothrow) uint8_t[info.size];
+    if(!record) {
+        return NULL;
+    }
+
+    header_t header;
+    if(kv_get(key, record, info.size, &size) != 0 || size < sizeof(header_t)) {
+        size = 0;
+    } else {
+        memcpy(&header, record, sizeof(header));
+        if(header.magic != magic || header.version != VERSION) {
+            mbed_tracef(TRACE_LEVEL_WARN, "PREG", "\"%s\" is not a registry record", key);
+            size = 0;
+        }
+    }
+
+    if(!size) {
+        delete[] record;
+        return NULL;
+    }
+    return record;
+}
+
+bool PersistentRegistry::parse_item(const uint8_t *&p, const uint8_t *end, bool with_value, item_t &item) {
+
+    if(p >= end || (size_t) (end - p) < 1 + p[0] + sizeof(uint16_t)) {
+        return false;
+    }
+
+    item.key_len = p[0];
+    item.key = (const char *) (p + 1);
+    memcpy(&item.version, p + 1 + item.key_len, sizeof(item.version));
+    item.size = 0;
+    item.value = NULL;
+    p += 1 + item.key_len + sizeof(uint16_t);
+
+    if(with_value) {
+        if((size_t) (end - p) < sizeof(uint32_t)) {
+            return false;
+        }
+        memcpy(&item.size, p, sizeof(item.size));
+        p += sizeof(uint32_t);
+        if((size_t) (end - p) < item.size) {
+            return false;
+        }
+        item.value = p;
+        p += item.size;
+    }
+    return true;
+}
+
+bool PersistentRegistry::find_item(const uint8_t *record, size_t size, bool with_value,
+        const char *key, size_t key_len, item_t &item) {
+
+    if(!record) {
+        return false;
+    }
+
+    const uint8_t *p = record + sizeof(header_t);
+    for(uint16_t i = 0; i < count(record, size) && parse_item(p, record + size, with_value, item); i++) {
+        if(item.key_len == key_len && memcmp(item.key, key, key_len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint16_t PersistentRegistry::count(const uint8_t *record, size_t size) {
+    if(size < sizeof(header_t)) {
+        return 0;
+    }
+    header_t header;
+    memcpy(&header, record, sizeof(header));
+    return header.count;
+}
+
+PersistentEntry *PersistentRegistry::registered(const char *key, size_t key_len) {
+    for(PersistentEntry *entry = head(); entry; entry = entry->_next_registered) {
+        const char *entry_key = entry->entry_key();
+        if(!entry->_group && strlen(entry_key) == key_len && memcmp(entry_key, key, key_len) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+uint16_t PersistentRegistry::stored_version(const uint8_t *schema, size_t schema_size, const char *key) {
+    item_t item;
+    return find_item(schema, schema_size, false, key, strlen(key), item) ? item.version : 0;
+}
+
+size_t PersistentRegistry::item_size(const char *key) {
+    return 1 + strlen(key) + sizeof(uint16_t);
+}
+
+void PersistentRegistry::append_version(uint8_t *&p, header_t &header,
+        const char *key, size_t key_len, uint16_t version) {
+    if(version == 0) {
+        return;
+    }
+    *p++ = key_len;
+    memcpy(p, key, key_len);
+    p += key_len;
+    memcpy(p, &version, sizeof(version));
+    p += sizeof(version);
+    header.count++;
+}
+
+int PersistentRegistry::write_migration(void) {
+
+    size_t size = sizeof(header_t);
+    for(PersistentEntry *entry = head(); entry; entry = entry->_next_registered) {
+        if(entry->_registry_write) {
+            size += item_size(entry->entry_key()) + sizeof(uint32_t) + entry->entry_size();
+        }
+    }
+
+    uint8_t *record = new (std::nothrow) uint8_t[size];
+    if(!record) {
+        return MBED_ERROR_ENOMEM;
+    }
+
+    header_t header = { MIGRATION_MAGIC, VERSION, 0 };
+    uint8_t *p = record + sizeof(header_t);
+    for(PersistentEntry *entry = head(); entry; entry = entry->_next_registered) {
+        if(!entry->_registry_write) {
+            continue;
+        }
+        const char *key = entry->entry_key();
+        uint8_t key_len = strlen(key);
+        uint32_t value_size = entry->entry_size();
+        *p++ = key_len;
+        memcpy(p, key, key_len);
+        p += key_len;
+        memcpy(p, &entry->_schema_version, sizeof(uint16_t));
+        p += sizeof(uint16_t);
+        memcpy(p, &value_size, sizeof(value_size));
+        p += sizeof(value_size);
+        entry->snapshot(p);
+        p += value_size;
+        header.count++;
+    }
+    memcpy(record, &header, sizeof(header));
+
+    int err = kv_set(MIGRATION_KEY, record, size, 0);
+    delete[] record;
+
+    if(err) {
+        mbed_tracef(TRACE_LEVEL_WARN, "PREG", "could not set \"%s\": %d", MIGRATION_KEY, err);
+    }
+    return err;
+}
+
+int PersistentRegistry::finish_migration(void) {
+
+    size_t migration_size;
+    uint8_t *migration = read_record(MIGRATION_KEY, MIGRATION_MAGIC, migration_size);
+    if(!migration) {
+        return 0;
+    }
+
+    size_t schema_size;
+    uint8_t *schema = read_record(SCHEMA_KEY, SCHEMA_MAGIC, schema_size);
+
+    const uint8_t *end = migration + migration_size;
+    uint16_t items = count(migration, migration_size);
+
+    /**
+     * The schema record is written after every value. If it already lists
+     * each logged version, only the removal of the migration record was lost.
+     */
+    bool pending = false;
+    item_t item;
+    const uint8_t *p = migration + sizeof(header_t);
+    for(uint16_t i = 0; i < items && parse_item(p, end, true, item); i++) {
+        item_t stored;
+        uint16_t version = find_item(schema, schema_size, false, item.key, item.key_len, stored) ?
+                stored.version : 0;
+        pending |= (version != item.version);
+    }
+
+    int result = 0;
+    if(pending) {
+        p = migration + sizeof(header_t);
+        for(uint16_t i = 0; i < items && parse_item(p, end, true, item); i++) {
+            /** An entry loaded since holds the logged value or a newer one */
+            PersistentEntry *entry = registered(item.key, item.key_len);
+            int err;
+            if(entry && (entry->entry_loaded() || entry->_dirty)) {
+                err = entry->write_back();
+            } else {
+                char key[UINT8_MAX + 1];
+                memcpy(key, item.key, item.key_len);
+                key[item.key_len] = '\0';
+                err = kv_set(key, item.value, item.size, 0);
+                if(err) {
+                    mbed_tracef(TRACE_LEVEL_WARN, "PREG", "could not set \"%s\": %d", key, err);
+                }
+            }
+            if(err) {
+                result = err;
+                break;
+            }
+        }
+        if(!result) {
+            result = write_schema(schema, schema_size, migration, migration_size);
+        }
+    }
+
+    if(!result) {
+        result = kv_remove(MIGRATION_KEY);
+        if(result) {
+            mbed_tracef(TRACE_LEVEL_WARN, "PREG", "could not remove \"%s\": %d", MIGRATION_KEY, result);
+        }
+    }
+
+    delete[] schema;
+    delete[] migration;
+    return result;
+}
+
+int PersistentRegistry::write_schema(const uint8_t *schema, size_t schema_size,
+        const uint8_t *migration, size_t migration_size) {
+
+    /**
+     * Only versions different from 0 are listed. Registered entries that are
+     * not loaded yet, and keys no entry is registered for (yet), keep their
+     * logged or stored version so they are still migrated when loaded.
+     */
+    size_t size = sizeof(header_t) + schema_size + migration_size;
+    for(PersistentEntry *entry = head(); entry; entry = entry->_next_registered) {
+        size += item_size(entry->entry_key());
+    }
+
+    uint8_t *record = new (std::nothrow) uint8_t[size];
+    if(!record) {
+        return MBED_ERROR_ENOMEM;
+    }
+
+    header_t header = { SCHEMA_MAGIC, VERSION, 0 };
+    uint8_t *p = record + sizeof(header_t);
+    item_t item;
+
+    for(PersistentEntry *entry = head(); entry; entry = entry->_next_registered) {
+        if(entry->_group) {
+            continue;
+        }
+        const char *key = entry->entry_key();
+        size_t key_len = strlen(key);
+        uint16_t version;
+        if(entry->entry_loaded()) {
+            version = entry->_schema_version;
+        } else if(find_item(migration, migration_size, true, key, key_len, item)) {
+            version = item.version;
+        } else {
+            version = stored_version(schema, schema_size, key);
+        }
+        append_version(p, header, key, key_len, version);
+    }
+
+    /** Stored keys of no registered entry, unless a newer version is logged */
+    if(schema) {
+        const uint8_t *q = schema + sizeof(header_t);
+        uint16_t items = count(schema, schema_size);
+        for(uint16_t i = 0; i < items && parse_item(q, schema + schema_size, false, item); i++) {
+            item_t logged;
+            if(!registered(item.key, item.key_len) &&
+                    !find_item(migration, migration_size, true, item.key, item.key_len, logged)) {
+                append_version(p, header, item.key, item.key_len, item.version);
+            }
+        }
+    }
+
+    /** Logged keys of no registered entry */
+    if(migration) {
+        const uint8_t *q = migration + sizeof(header_t);
+        uint16_t items = count(migration, migration_size);
+        for(uint16_t i = 0; i < items && parse_item(q, migration + migration_size, true, item); i++) {
+            if(!registered(item.key, item.key_len)) {
+                append_version(p, header, item.key, item.key_len, item.version);
+            }
+        }
+    }
+    memcpy(record, &header, sizeof(header));
+
+    size = p - record;
+    int err = kv_set(SCHEMA_KEY, record, size, 0);
+    delete[] record;
+
+    if(err) {
+        mbed_tracef(TRACE_LEVEL_WARN, "PREG", "could not set \"%s\": %d", SCHEMA_KEY, err);
+    }
+    return err;
+}
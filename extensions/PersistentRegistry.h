@@ -0,0 +1,228 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_PERSISTENTREGISTRY_H_
+#define EP_OC_MCU_EXTENSIONS_PERSISTENTREGISTRY_H_
+
+#include "PersistentEntry.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ep {
+
+/**
+ * Registry of PersistentArrays/PersistentVariables loaded together at boot.
+ *
+ * Without the registry, each variable reads its key on first access and,
+ * if it is missing, writes its default and reads it back. With dozens of
+ * variables that scatters flash accesses over the first seconds after boot.
+ *
+ * load_all() instead reads every registered key in one sequential pass into
+ * RAM, then writes all missing defaults together. Registered variables are
+ * then read from RAM, as in cached mode.
+ *
+ * Each registered variable has a schema version. Versions are kept in one
+ * small schema record next to the values, so values keep their plain
+ * layout. A stored value is used as is only if its size and version match
+ * the current ones. Otherwise the migration given to add() converts it, or
+ * the default is used, and the result is written back during load_all(). The
+ * mismatch is therefore handled once at boot instead of on every access.
+ *
+ * @code
+ * ep::PersistentArray<uint16_t, 8> thresholds(0, "thresholds");
+ *
+ * // Version 1 stored 4 uint8_t thresholds
+ * bool migrate_thresholds(const void *stored, size_t size, uint16_t version, void *value) {
+ *     if(version != 0 || size != 4) {
+ *         return false;
+ *     }
+ *     for(size_t i = 0; i < 4; i++) {
+ *         ((uint16_t *) value)[i] = ((const uint8_t *) stored)[i];
+ *     }
+ *     return true;
+ * }
+ *
+ * int main() {
+ *     ep::PersistentRegistry::add(thresholds, 1, mbed::callback(migrate_thresholds));
+ *     ep::PersistentRegistry::load_all();
+ * }
+ * @endcode
+ *
+ * Before rewriting migrated values, load_all() logs them with their new
+ * versions in a migration record, and removes it once the schema record is
+ * written. If a power loss interrupts the rewrite, the next load finishes it
+ * from that record, so a value is never migrated twice nor reset. Versions
+ * of keys that are not registered are kept in the schema record.
+ *
+ * @note Members of a PersistentGroup are loaded through their group, without schema versions
+ * @note Not thread safe, register and load at boot before starting other threads
+ */
+class PersistentRegistry
+{
+
+public:
+
+    /** Key of the schema record */
+    static const char *const SCHEMA_KEY;
+
+    /** Key of the record of a migration in progress */
+    static const char *const MIGRATION_KEY;
+
+    /**
+     * Register an entry, before it is first read or written
+     * @param[in] entry Entry to register, unregistered when destroyed
+     * @param[in] version Current schema version of the entry's value,
+     * values stored before the entry was registered have version 0
+     * @param[in] migrate (optional) Migration of values stored with another
+     * version or size. Without one, such values are replaced by the default.
+     */
+    static void add(PersistentEntry &entry, uint16_t version = 0,
+            PersistentEntry::migrate_t migrate = PersistentEntry::migrate_t());
+
+    /** Unregister an entry */
+    static void remove(PersistentEntry &entry);
+
+    /**
+     * Load every registered entry that is not loaded yet, then write the
+     * missing defaults, the migrated values and the schema record
+     * @retval 0 on success, or the first KVStore error. If a rewrite failed,
+     * the next load finishes it from the migration record.
+     */
+    static int load_all(void);
+
+    /**
+     * Load one registered entry, as load_all() would
+     *
+     * An entry that a previous load found (or left) stored with its current
+     * version is not read here: its key can be read as is, so the caller
+     * reloads only that key, without the schema and migration records.
+     *
+     * @retval 0 on success, or the first KVStore error
+     */
+    static int load(PersistentEntry &entry);
+
+    /** Number of values converted or reset because of a version or size change */
+    static uint32_t migration_count(void) {
+        return stats().migrations;
+    }
+
+    /** Number of missing values written with their default */
+    static uint32_t default_write_count(void) {
+        return stats().default_writes;
+    }
+
+protected:
+
+    static const uint32_t SCHEMA_MAGIC = 0x48435350; /* "PSCH" */
+    static const uint32_t MIGRATION_MAGIC = 0x47494D50; /* "PMIG" */
+    static const uint16_t VERSION = 1;
+
+    /**
+     * Header of the schema and migration records. Each item is the key
+     * length, the key and the version, followed in a migration record by the
+     * value size (uint32_t) and the value.
+     */
+    struct header_t {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t count;
+    };
+
+    struct item_t {
+        const char *key;
+        uint8_t key_len;
+        uint16_t version;
+        uint32_t size;
+        const uint8_t *value;
+    };
+
+    struct stats_t {
+        uint32_t migrations;
+        uint32_t default_writes;
+    };
+
+    static PersistentEntry *&head(void) {
+        static PersistentEntry *registered = NULL;
+        return registered;
+    }
+
+    static stats_t &stats(void) {
+        static stats_t counters = { 0, 0 };
+        return counters;
+    }
+
+    /** Load the registered entries, or only the given one */
+    static int load_entries(PersistentEntry *only);
+
+    /** Read one value, marking it for rewrite if it is missing or migrated */
+    static int load_entry(PersistentEntry &entry, const uint8_t *schema, size_t schema_size,
+            uint8_t *buffer, bool &schema_changed);
+
+    /**
+     * Read a schema or migration record
+     * @param[out] size Size of the record, 0 if it is missing or invalid
+     * @retval record to delete[], NULL if it is missing or invalid
+     */
+    static uint8_t *read_record(const char *key, uint32_t magic, size_t &size);
+
+    /** Parse the item at p, and advance p to the next one */
+    static bool parse_item(const uint8_t *&p, const uint8_t *end, bool with_value, item_t &item);
+
+    /** Number of items in a record, 0 if it is missing */
+    static uint16_t count(const uint8_t *record, size_t size);
+
+    /** Find the item of a key in a record */
+    static bool find_item(const uint8_t *record, size_t size, bool with_value,
+            const char *key, size_t key_len, item_t &item);
+
+    /** Registered entry stored under a key, NULL if there is none */
+    static PersistentEntry *registered(const char *key, size_t key_len);
+
+    /** Stored schema version of a key, 0 if the record does not list it */
+    static uint16_t stored_version(const uint8_t *schema, size_t schema_size, const char *key);
+
+    /** Append a schema record item, unless the version is 0 */
+    static void append_version(uint8_t *&p, header_t &header, const char *key, size_t key_len, uint16_t version);
+
+    /** Log the values to rewrite with their new versions in the migration record */
+    static int write_migration(void);
+
+    /** Finish a migration interrupted by a power loss, then remove its record */
+    static int finish_migration(void);
+
+    /**
+     * Write the current versions of the loaded entries. Other keys keep the
+     * version logged in the migration record if any, or else the stored one.
+     */
+    static int write_schema(const uint8_t *schema, size_t schema_size,
+            const uint8_t *migration, size_t migration_size);
+
+    /** Size in bytes of a schema record item for the key */
+    static size_t item_size(const char *key);
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_PERSISTENTREGISTRY_H_ */
@@ -26,8 +26,6 @@
 
 #include "PersistentArray.h"
 
-// TODO think about checking if the value is the same during ::set to prevent unnecessary writes to flash
-
 namespace ep
 {
 
@@ -45,12 +43,13 @@ public:
      * @param[in] default_value The default value of this persistent variable
      * @param[in] key Key to store the persistent variable under
      * @param[in] flags Creation flags for kvstore API (eg: WRITE_ONCE_FLAG)
+     * @param[in] cached Serve reads from RAM and skip identical writes, see PersistentArray
      *
      * @note This value is only used if the persistent variable has not
      * been accessed before or if the kvstore is unavailable for some reason
      */
-    PersistentVariable(T default_value, const char* key, uint32_t flags = 0) :
-        PersistentArray<T, 1>(default_value, key, flags) {
+    PersistentVariable(T default_value, const char* key, uint32_t flags = 0, bool cached = false) :
+        PersistentArray<T, 1>(default_value, key, flags, cached) {
     }
 
     /** Destructor */
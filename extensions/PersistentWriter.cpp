@@ -0,0 +1,246 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "PersistentWriter.h"
+
+#if defined(MBED_CONF_RTOS_PRESENT)
+
+#include "platform/mbed_critical.h"
+#include "platform/mbed_atomic.h"
+#include "platform/mbed_assert.h"
+
+using namespace ep;
+
+void PersistentEntry::mark_dirty(void) {
+    _writer->mark_dirty(this);
+}
+
+void PersistentEntry::remove_from_writer(void) {
+    _writer->remove(this);
+}
+
+PersistentWriter::PersistentWriter(std::chrono::milliseconds holdoff,
+        osPriority priority, uint32_t stack_size, std::chrono::milliseconds retry_delay) :
+        _thread(priority, stack_size, NULL, "PersistentWriter"),
+        _holdoff(holdoff), _retry_delay(retry_delay), _started(false), _retry(false),
+        _dirty_head(NULL), _halted(false),
+        _pending_count(0), _write_count(0), _coalesced_count(0), _failed_write_count(0) {
+}
+
+PersistentWriter::~PersistentWriter() {
+    /** The worker must be gone before _flags and _mutex are destroyed */
+    if(_started) {
+        _flags.set(FLAG_STOP);
+        _thread.join();
+    }
+    this->write_dirty();
+}
+
+osStatus PersistentWriter::start(void) {
+    osStatus status = _thread.start(mbed::callback(this, &PersistentWriter::worker));
+    _started = (status == osOK);
+    return status;
+}
+
+void PersistentWriter::mark_dirty(PersistentEntry *entry) {
+
+    bool queued = false;
+
+    core_util_critical_section_enter();
+    entry->_dirty = true;
+    if(entry->_queued) {
+        /** The pending write will pick up the latest value */
+        _coalesced_count++;
+    } else {
+        this->enqueue(entry);
+        queued = true;
+    }
+    core_util_critical_section_exit();
+
+    if(queued && !_halted) {
+        _flags.set(FLAG_DIRTY);
+    }
+}
+
+void PersistentWriter::enqueue(PersistentEntry *entry) {
+    entry->_queued = true;
+    entry->_next_dirty = _dirty_head;
+    _dirty_head = entry;
+    _pending_count++;
+}
+
+void PersistentWriter::flush(void) {
+    MBED_ASSERT(!core_util_is_isr_active());
+
+    if(this->write_dirty() && _started) {
+        _flags.set(FLAG_RETRY);
+    }
+}
+
+bool PersistentWriter::write_dirty(void) {
+    _mutex.lock();
+    bool failed = this->write_list(this->take_dirty());
+    _retry = failed;
+    _mutex.unlock();
+    return failed;
+}
+
+void PersistentWriter::remove(PersistentEntry *entry) {
+    MBED_ASSERT(!core_util_is_isr_active());
+
+    /** Holding the lock, the entry is not in a list being written */
+    _mutex.lock();
+
+    bool pending = false;
+    core_util_critical_section_enter();
+    if(entry->_queued) {
+        for(PersistentEntry **link = &_dirty_head; *link; link = &(*link)->_next_dirty) {
+            if(*link == entry) {
+                *link = entry->_next_dirty;
+                break;
+            }
+        }
+        entry->_queued = false;
+        entry->_next_dirty = NULL;
+        _pending_count--;
+        pending = true;
+    }
+    core_util_critical_section_exit();
+
+    if(pending) {
+        entry->write_back();
+        _write_count++;
+    }
+    entry->_dirty = false;
+
+    _mutex.unlock();
+}
+
+void PersistentWriter::on_power_fail(void) {
+    _flags.set(FLAG_POWER_FAIL);
+}
+
+void PersistentWriter::worker(void) {
+
+    const uint32_t wake_flags = FLAG_DIRTY | FLAG_POWER_FAIL | FLAG_STOP | FLAG_RETRY;
+
+    while(true) {
+
+        uint32_t flags = _retry ? _flags.wait_any_for(wake_flags, _retry_delay) :
+                _flags.wait_any(wake_flags);
+        if(flags == osFlagsErrorTimeout) {
+            /** Write the entries that failed again */
+            flags = FLAG_DIRTY;
+        } else if(flags & osFlagsError) {
+            continue;
+        }
+
+        if(!(flags & (FLAG_POWER_FAIL | FLAG_STOP)) && _holdoff.count() > 0) {
+            /** Let a burst of sets coalesce, but not past a power failure */
+            uint32_t more = _flags.wait_any_for(FLAG_POWER_FAIL | FLAG_STOP, _holdoff);
+            if(!(more & osFlagsError)) {
+                flags |= more;
+            }
+        }
+
+        if(!this->process(flags)) {
+            return;
+        }
+    }
+}
+
+bool PersistentWriter::process(uint32_t flags) {
+
+    if(flags & FLAG_POWER_FAIL) {
+        _thread.set_priority(osPriorityRealtime);
+        this->write_dirty();
+        _halted = true;
+        return false;
+    }
+
+    /** The destructor writes what is left */
+    if(flags & FLAG_STOP) {
+        return false;
+    }
+
+    /** FLAG_RETRY alone only starts waiting for the retry delay */
+    if(flags & FLAG_DIRTY) {
+        this->write_dirty();
+    }
+    return true;
+}
+
+PersistentEntry *PersistentWriter::take_dirty(void) {
+
+    core_util_critical_section_enter();
+    PersistentEntry *list = _dirty_head;
+    _dirty_head = NULL;
+    core_util_critical_section_exit();
+
+    /** Reverse so entries are written in the order they became dirty */
+    PersistentEntry *ordered = NULL;
+    while(list) {
+        PersistentEntry *next = list->_next_dirty;
+        list->_next_dirty = ordered;
+        ordered = list;
+        list = next;
+    }
+
+    return ordered;
+}
+
+bool PersistentWriter::write_list(PersistentEntry *list) {
+
+    bool failed = false;
+
+    while(list) {
+        PersistentEntry *entry = list;
+        list = entry->_next_dirty;
+
+        /** From here, a set() puts the entry on the new dirty list */
+        core_util_critical_section_enter();
+        entry->_queued = false;
+        core_util_critical_section_exit();
+
+        int err = entry->write_back();
+        _write_count++;
+        core_util_atomic_decr_u32(&_pending_count, 1);
+
+        core_util_critical_section_enter();
+        if(entry->_queued) {
+            /** Set again during the write, written again with the new value */
+        } else if(err) {
+            /** Keep the value in RAM and write it again later */
+            this->enqueue(entry);
+            _failed_write_count++;
+            failed = true;
+        } else {
+            entry->_dirty = false;
+        }
+        core_util_critical_section_exit();
+    }
+
+    return failed;
+}
+
+#endif /* MBED_CONF_RTOS_PRESENT */
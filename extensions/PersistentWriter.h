@@ -0,0 +1,210 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_PERSISTENTWRITER_H_
+#define EP_OC_MCU_EXTENSIONS_PERSISTENTWRITER_H_
+
+#if defined(MBED_CONF_RTOS_PRESENT)
+
+#include "PersistentEntry.h"
+
+#include "rtos/Thread.h"
+#include "rtos/EventFlags.h"
+#include "platform/PlatformMutex.h"
+#include "platform/NonCopyable.h"
+
+#include <chrono>
+#include <stdint.h>
+
+namespace ep {
+
+/**
+ * Low priority worker thread that writes PersistentArrays back to KVStore.
+ *
+ * A PersistentArray in write-behind mode only updates its RAM copy in set()
+ * and marks itself dirty, which is ISR safe and never blocks. The writer then
+ * writes dirty entries to KVStore from its own thread. Repeated sets of the
+ * same entry before it is written are coalesced into one write of the latest
+ * value. An optional holdoff delays writing after the first set to coalesce
+ * bursts (eg: a setpoint dragged on a UI).
+ *
+ * @code
+ * ep::PersistentWriter writer;
+ * ep::PersistentVariable<float> setpoint(20.0f, "setpoint");
+ *
+ * writer.start();
+ * setpoint.set_writer(&writer);
+ * setpoint = 21.5f;   // returns immediately
+ * @endcode
+ *
+ * A failed write leaves the entry dirty: reads keep returning the new value
+ * and the worker writes it again after the retry delay.
+ *
+ * On power failure, call on_power_fail() (ISR safe). The worker raises its
+ * priority, writes everything still dirty and stops writing so flash is not
+ * left half-written as the supply collapses.
+ */
+class PersistentWriter : private mbed::NonCopyable<PersistentWriter>
+{
+
+public:
+
+    /**
+     * Create a writer
+     * @param[in] holdoff Delay between an entry becoming dirty and being written
+     * @param[in] priority Priority of the worker thread
+     * @param[in] stack_size Stack size of the worker thread, must fit the
+     * largest PersistentArray as it is copied on the stack before writing
+     * @param[in] retry_delay Delay before writing entries again after a failed write
+     */
+    PersistentWriter(std::chrono::milliseconds holdoff = std::chrono::milliseconds(0),
+            osPriority priority = osPriorityLow, uint32_t stack_size = OS_STACK_SIZE,
+            std::chrono::milliseconds retry_delay = std::chrono::milliseconds(1000));
+
+    /** Stop the worker thread, then write what is still dirty */
+    ~PersistentWriter();
+
+    /** Start the worker thread */
+    osStatus start(void);
+
+    /**
+     * Mark an entry dirty and wake the worker
+     * @note ISR safe
+     */
+    void mark_dirty(PersistentEntry *entry);
+
+    /**
+     * Write every entry that is dirty at the time of the call in the
+     * caller's context and return once they are all written. Entries
+     * whose write failed stay dirty and are retried by the worker.
+     * @note Not ISR safe
+     */
+    void flush(void);
+
+    /**
+     * Forget an entry that is about to be destroyed, writing its pending
+     * value first. Waits for a write in progress.
+     * @note Not ISR safe
+     */
+    void remove(PersistentEntry *entry);
+
+    /**
+     * Power-fail hook: the worker writes everything that is dirty right
+     * away at realtime priority, then stops writing
+     * @note ISR safe
+     */
+    void on_power_fail(void);
+
+    /** True once the power-fail flush has completed */
+    bool halted(void) const {
+        return _halted;
+    }
+
+    /** Number of entries currently waiting to be written */
+    uint32_t pending_count(void) const {
+        return _pending_count;
+    }
+
+    /** Number of KVStore writes issued */
+    uint32_t write_count(void) const {
+        return _write_count;
+    }
+
+    /** Number of sets coalesced into an already pending write */
+    uint32_t coalesced_count(void) const {
+        return _coalesced_count;
+    }
+
+    /** Number of KVStore writes that failed and were queued again */
+    uint32_t failed_write_count(void) const {
+        return _failed_write_count;
+    }
+
+protected:
+
+    static const uint32_t FLAG_DIRTY = (1 << 0);
+    static const uint32_t FLAG_POWER_FAIL = (1 << 1);
+    static const uint32_t FLAG_STOP = (1 << 2);
+
+    /** Wakes the worker to wait for the retry delay, after a failed flush() */
+    static const uint32_t FLAG_RETRY = (1 << 3);
+
+    void worker(void);
+
+    /**
+     * Handle the flags the worker woke up with
+     * @retval false once the power-fail flush is done, or on stop, and the worker must stop
+     */
+    bool process(uint32_t flags);
+
+    /**
+     * Write the dirty entries
+     * @retval true if a write failed and the entry is queued again
+     */
+    bool write_dirty(void);
+
+    /** Put an entry on the dirty list, in a critical section */
+    void enqueue(PersistentEntry *entry);
+
+    /** Take the whole dirty list, in the order entries became dirty */
+    PersistentEntry *take_dirty(void);
+
+    /**
+     * Write back a list returned by take_dirty, writer must be locked
+     * @retval true if a write failed and the entry is queued again
+     */
+    bool write_list(PersistentEntry *list);
+
+protected:
+
+    rtos::Thread _thread;
+    rtos::EventFlags _flags;
+
+    /** Held while writing to KVStore, so flush() waits for writes in progress */
+    PlatformMutex _mutex;
+
+    std::chrono::milliseconds _holdoff;
+    std::chrono::milliseconds _retry_delay;
+
+    bool _started;
+
+    /** A write failed, the worker retries after _retry_delay */
+    volatile bool _retry;
+
+    /** Dirty list, most recently dirtied first */
+    PersistentEntry *_dirty_head;
+
+    volatile bool _halted;
+
+    volatile uint32_t _pending_count;
+    uint32_t _write_count;
+    volatile uint32_t _coalesced_count;
+    uint32_t _failed_write_count;
+
+};
+
+}
+
+#endif /* MBED_CONF_RTOS_PRESENT */
+
+#endif /* EP_OC_MCU_EXTENSIONS_PERSISTENTWRITER_H_ */
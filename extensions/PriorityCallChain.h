@@ -0,0 +1,272 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_PRIORITYCALLCHAIN_H_
+#define EP_OC_MCU_EXTENSIONS_PRIORITYCALLCHAIN_H_
+
+#include "extensions/CallChain.h"
+
+#include "platform/Callback.h"
+#include "platform/NonCopyable.h"
+#include "platform/mbed_assert.h"
+
+#include <new>
+#include <type_traits>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ep {
+
+/**
+ * A fixed-capacity CallChain that dispatches its links in priority order.
+ *
+ * Each link is attached with a priority in [0, P). Priority 0 is dispatched
+ * first (eg: safety shut-off handlers), P-1 last (eg: logging). Links with
+ * the same priority are dispatched in the order they were attached.
+ *
+ * Each priority level is a bucket holding a singly-linked list of slots with
+ * a tail index, so attach is O(1) and call is linear in the number of links
+ * with no sorting at call time.
+ *
+ * @note Attach does not check for duplicates. Attaching an equivalent link
+ * twice will dispatch it twice.
+ *
+ * @note Attaching or detaching while the chain is being called is not supported
+ */
+template<size_t N, size_t P, typename... ArgTs>
+class PriorityCallChain : private mbed::NonCopyable<PriorityCallChain<N, P, ArgTs...>>
+{
+
+    MBED_STATIC_ASSERT(N < 0xFFFF, "PriorityCallChain capacity must be less than 65535");
+    MBED_STATIC_ASSERT(P > 0, "PriorityCallChain needs at least one priority level");
+
+public:
+
+    typedef CallChainLink<ArgTs...> link_t;
+
+    PriorityCallChain() {
+        this->reset();
+    }
+
+    ~PriorityCallChain() {
+        this->detach_all();
+    }
+
+    /**
+     * Attach an application-owned link to the callchain
+     * @param[in] link Link to attach. Must outlive its membership in the chain.
+     * @param[in] priority Priority bucket of the link, 0 is dispatched first
+     * @retval true on success, false if the chain is full or priority is out of range
+     */
+    bool attach(link_t &link, uint8_t priority) {
+        if(priority >= P) {
+            return false;
+        }
+
+        index_t slot = this->alloc_slot();
+        if(slot == NIL) {
+            return false;
+        }
+
+        _links[slot] = &link;
+        this->push_back(slot, priority);
+        return true;
+    }
+
+    /**
+     * Attach a callback to the callchain, storing its link in the internal pool
+     * @param[in] cb Callback to attach to the callchain
+     * @param[in] priority Priority bucket of the callback, 0 is dispatched first
+     * @retval true on success, false if the chain is full or priority is out of range
+     */
+    bool attach(const mbed::Callback<void(ArgTs...)> &cb, uint8_t priority) {
+        if(priority >= P) {
+            return false;
+        }
+
+        index_t slot = this->alloc_slot();
+        if(slot == NIL) {
+            return false;
+        }
+
+        _owned[slot] = true;
+        _links[slot] = new (&_pool[slot]) link_t(cb);
+        this->push_back(slot, priority);
+        return true;
+    }
+
+    /**
+     * Detach the first equivalent link found in the given priority bucket
+     * @param[in] link Link to remove from the callchain
+     * @param[in] priority Priority bucket the link was attached with
+     *
+     * @note Equivalency is based on CallChainLink comparison, not pointer comparison
+     * @note Does nothing if priority is out of range
+     */
+    void detach(const link_t &link, uint8_t priority) {
+        if(priority >= P) {
+            return;
+        }
+
+        index_t prev = NIL;
+        for(index_t slot = _head[priority]; slot != NIL; slot = _next[slot]) {
+            if(*_links[slot] == link) {
+                if(prev == NIL) {
+                    _head[priority] = _next[slot];
+                } else {
+                    _next[prev] = _next[slot];
+                }
+
+                if(_tail[priority] == slot) {
+                    _tail[priority] = prev;
+                }
+
+                this->free_slot(slot);
+                return;
+            }
+            prev = slot;
+        }
+    }
+
+    /**
+     * Detach, initializing with a Callback instance
+     * @param[in] cb Callback to remove from the callchain
+     * @param[in] priority Priority bucket the callback was attached with
+     */
+    void detach(const mbed::Callback<void(ArgTs...)> &cb, uint8_t priority) {
+        this->detach(link_t(cb), priority);
+    }
+
+    void detach_all(void) {
+        for(size_t slot = 0; slot < N; slot++) {
+            if(_owned[slot]) {
+                _links[slot]->~link_t();
+            }
+        }
+        this->reset();
+    }
+
+    /**
+     * Invoke all links in this chain, highest priority first
+     * @param[in] args Arguments to pass to each link in the chain
+     */
+    void call(ArgTs... args) {
+        for(size_t priority = 0; priority < P; priority++) {
+            for(index_t slot = _head[priority]; slot != NIL; slot = _next[slot]) {
+                _links[slot]->call(args...);
+            }
+        }
+    }
+
+    void operator()(ArgTs... args) {
+        call(args...);
+    }
+
+    /** Number of links currently attached */
+    size_t size(void) const {
+        return _count;
+    }
+
+    bool full(void) const {
+        return (_free == NIL);
+    }
+
+protected:
+
+    typedef uint16_t index_t;
+
+    static const index_t NIL = 0xFFFF;
+
+    void reset(void) {
+        for(size_t priority = 0; priority < P; priority++) {
+            _head[priority] = NIL;
+            _tail[priority] = NIL;
+        }
+
+        /** Thread every slot onto the free list */
+        for(size_t slot = 0; slot < N; slot++) {
+            _next[slot] = (slot + 1 < N) ? (slot + 1) : NIL;
+            _owned[slot] = false;
+        }
+        _free = (N > 0) ? 0 : NIL;
+        _count = 0;
+    }
+
+    index_t alloc_slot(void) {
+        index_t slot = _free;
+        if(slot != NIL) {
+            _free = _next[slot];
+            _count++;
+        }
+        return slot;
+    }
+
+    void free_slot(index_t slot) {
+        if(_owned[slot]) {
+            _links[slot]->~link_t();
+            _owned[slot] = false;
+        }
+        _next[slot] = _free;
+        _free = slot;
+        _count--;
+    }
+
+    /** Append the slot to the end of its bucket */
+    void push_back(index_t slot, uint8_t priority) {
+        MBED_ASSERT(priority < P);
+
+        _next[slot] = NIL;
+        if(_tail[priority] == NIL) {
+            _head[priority] = slot;
+        } else {
+            _next[_tail[priority]] = slot;
+        }
+        _tail[priority] = slot;
+    }
+
+protected:
+
+    /** Links by slot */
+    link_t *_links[N];
+
+    /** Next slot in the same bucket (or free list) */
+    index_t _next[N];
+
+    /** First and last slot of each priority bucket */
+    index_t _head[P];
+    index_t _tail[P];
+
+    /** First free slot */
+    index_t _free;
+
+    size_t _count;
+
+    /** Storage for links attached by Callback */
+    typename std::aligned_storage<sizeof(link_t), alignof(link_t)>::type _pool[N];
+    bool _owned[N];
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_PRIORITYCALLCHAIN_H_ */
@@ -0,0 +1,213 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_QUEUEDBOUNDVARIABLE_H_
+#define EP_OC_MCU_EXTENSIONS_QUEUEDBOUNDVARIABLE_H_
+
+#include "extensions/BoundVariable.h"
+
+#include "events/EventQueue.h"
+#include "platform/mbed_critical.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ep {
+
+/**
+ * A BoundVariable whose subscribers can run on their own EventQueue
+ * instead of in the context of the thread calling set().
+ *
+ * Subscribers attached with a target queue are grouped per queue. set()
+ * posts at most one event to each queue that has subscribers; if an event is
+ * already pending on a queue, only the value it will deliver is updated. The
+ * cost of set() is therefore bounded by the number of target queues rather
+ * than the number of subscribers, and a slow subscriber only delays its own
+ * queue. Queued subscribers receive the latest value, intermediate values
+ * may be skipped.
+ *
+ * Subscribers attached without a queue are still called inline by set().
+ *
+ * @code
+ * ep::QueuedBoundVariable<float> temperature;
+ * temperature.attach(mbed::callback(&logger, &Logger::log), logging_queue);
+ * temperature.attach(mbed::callback(&service, &Service::update), ble_queue);
+ * @endcode
+ *
+ * @tparam T Type of the value
+ * @tparam MaxQueues Maximum number of distinct target queues
+ *
+ * @note set() may be called from an ISR if T is cheap to copy, since the
+ * latest value is exchanged with the dispatching thread in a critical section
+ */
+template<typename T, size_t MaxQueues = 4>
+class QueuedBoundVariable : public BoundVariable<T>
+{
+
+public:
+
+    QueuedBoundVariable() : BoundVariable<T>(), _post_fail_count(0) {
+    }
+
+    QueuedBoundVariable(const T &value) : BoundVariable<T>(value), _post_fail_count(0) {
+    }
+
+    /** Cancels events still pending on the target queues */
+    virtual ~QueuedBoundVariable() {
+        for(size_t i = 0; i < MaxQueues; i++) {
+            if(_targets[i].queue && _targets[i].event_id > 0) {
+                _targets[i].queue->cancel(_targets[i].event_id);
+            }
+        }
+    }
+
+    using BoundVariable<T>::attach;
+    using BoundVariable<T>::detach;
+    using BoundVariable<T>::operator=;
+
+    /**
+     * Attach a callback to be executed on the given queue when the variable is set
+     * @param[in] cb Callback to attach
+     * @param[in] queue Queue the callback is dispatched from
+     * @retval Token that can be converted into an ep::Subscription, invalid if
+     * the callback is a duplicate or MaxQueues distinct queues are already in use
+     */
+    SubscriptionToken attach(const mbed::Callback<void(T)> &cb, events::EventQueue &queue) {
+        target_t *target = this->find_target(queue, true);
+        if(!target) {
+            return SubscriptionToken();
+        }
+        return target->chain.attach(cb);
+    }
+
+    /**
+     * Detach a callback attached with a target queue
+     * @param[in] cb Callback to detach
+     * @param[in] queue Queue it was attached with
+     */
+    void detach(const mbed::Callback<void(T)> &cb, events::EventQueue &queue) {
+        target_t *target = this->find_target(queue, false);
+        if(target) {
+            target->chain.detach(cb);
+        }
+    }
+
+    /**
+     * Set the variable, call the inline subscribers and post one event
+     * per target queue
+     * @param[in] new_value New value
+     */
+    virtual void set(T new_value) {
+        BoundVariable<T>::set(new_value);
+
+        for(size_t i = 0; i < MaxQueues; i++) {
+            target_t &target = _targets[i];
+            if(!target.queue || target.chain.empty()) {
+                continue;
+            }
+
+            core_util_critical_section_enter();
+            target.latest = new_value;
+            bool post = (target.event_id == 0);
+            if(post) {
+                /** Claim the slot so a concurrent set() only updates the value */
+                target.event_id = -1;
+            }
+            core_util_critical_section_exit();
+
+            if(post) {
+                int id = target.queue->call(this, &QueuedBoundVariable::dispatch, &target);
+                core_util_critical_section_enter();
+                if(id == 0) {
+                    target.event_id = 0;
+                    _post_fail_count++;
+                } else if(target.event_id == -1) {
+                    /** Otherwise the event already ran */
+                    target.event_id = id;
+                }
+                core_util_critical_section_exit();
+            }
+        }
+    }
+
+    /** Number of times an event could not be posted because a queue was full */
+    uint32_t post_fail_count(void) const {
+        return _post_fail_count;
+    }
+
+protected:
+
+    struct target_t {
+        target_t() : queue(NULL), event_id(0) {
+        }
+
+        events::EventQueue *queue;
+        CallChain<T> chain;
+
+        /** Value delivered by the pending event */
+        T latest;
+
+        /** Pending event, -1 while it is being posted, 0 if none */
+        int event_id;
+    };
+
+    target_t *find_target(events::EventQueue &queue, bool create) {
+        target_t *free_slot = NULL;
+        for(size_t i = 0; i < MaxQueues; i++) {
+            if(_targets[i].queue == &queue) {
+                return &_targets[i];
+            }
+            if(!_targets[i].queue && !free_slot) {
+                free_slot = &_targets[i];
+            }
+        }
+
+        if(create && free_slot) {
+            /** Slots stay bound to their queue, a pending event may still refer to it */
+            free_slot->queue = &queue;
+            return free_slot;
+        }
+        return NULL;
+    }
+
+    /** Runs on the target queue */
+    void dispatch(target_t *target) {
+        core_util_critical_section_enter();
+        T value = target->latest;
+        target->event_id = 0;
+        core_util_critical_section_exit();
+
+        target->chain.call(value);
+    }
+
+protected:
+
+    target_t _targets[MaxQueues];
+
+    uint32_t _post_fail_count;
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_QUEUEDBOUNDVARIABLE_H_ */
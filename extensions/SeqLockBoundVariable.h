@@ -0,0 +1,125 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_SEQLOCKBOUNDVARIABLE_H_
+#define EP_OC_MCU_EXTENSIONS_SEQLOCKBOUNDVARIABLE_H_
+
+#include "extensions/BoundVariable.h"
+
+#include "platform/mbed_critical.h"
+
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+#include <stdint.h>
+
+namespace ep {
+
+/**
+ * A BoundVariable whose storage is protected by a sequence lock, so
+ * multi-word values (eg: tri-axis readings) are never read torn.
+ *
+ * The writer bumps the sequence number to an odd value, copies the new value
+ * in and bumps it back to even. Readers copy the value out and retry if the
+ * sequence number was odd or changed in the meantime. Writers never wait and
+ * readers never block the writer.
+ *
+ * Only one writer may run at a time. With IsrSafeWriter, set() runs inside a
+ * critical section, which serializes writers from any context and lets ISRs
+ * read without ever observing a write in progress.
+ *
+ * @note Without IsrSafeWriter, get() must not be called from an ISR that can
+ * preempt set(), since the ISR would spin until the write it interrupted completes.
+ *
+ * @tparam T Trivially copyable value type
+ * @tparam IsrSafeWriter Run set() in a critical section
+ */
+template<typename T, bool IsrSafeWriter = false>
+class SeqLockBoundVariable : public BoundVariable<T>
+{
+
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLockBoundVariable requires a trivially copyable type");
+
+public:
+
+    SeqLockBoundVariable() : BoundVariable<T>(), _sequence(0) {
+    }
+
+    SeqLockBoundVariable(const T &value) : BoundVariable<T>(value), _sequence(0) {
+    }
+
+    using BoundVariable<T>::operator=;
+
+    /**
+     * Read a consistent copy of the value
+     * @note Lock-free, retries while a write is in progress
+     */
+    virtual T get(void) {
+        T copy;
+        uint32_t before, after;
+        do {
+            before = _sequence.load(std::memory_order_acquire);
+            memcpy(&copy, &this->_value, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = _sequence.load(std::memory_order_relaxed);
+        } while((before & 1) || (before != after));
+        return copy;
+    }
+
+    /**
+     * Write the value and notify subscribers
+     * @note Wait-free. Subscribers are called in the writer's context.
+     */
+    virtual void set(T new_value) {
+        if(IsrSafeWriter) {
+            core_util_critical_section_enter();
+        }
+
+        uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+        _sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&this->_value, &new_value, sizeof(T));
+        _sequence.store(sequence + 2, std::memory_order_release);
+
+        if(IsrSafeWriter) {
+            core_util_critical_section_exit();
+        }
+
+        this->_callchain.call(new_value);
+    }
+
+    /** Number of completed writes */
+    uint32_t version(void) const {
+        return _sequence.load(std::memory_order_acquire) >> 1;
+    }
+
+protected:
+
+    /** Odd while a write is in progress */
+    std::atomic<uint32_t> _sequence;
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_SEQLOCKBOUNDVARIABLE_H_ */
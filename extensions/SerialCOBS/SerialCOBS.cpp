@@ -28,7 +28,49 @@
 
 #include "cobsr.h"
 
-SerialCOBS::SerialCOBS(mbed::FileHandle& fh) : _fh(fh), _staging_index(0) {
+#include <string.h>
+#include <stdint.h>
+
+/**
+ * Returns a pointer to the first zero byte in [data, data + size), or NULL.
+ *
+ * The bulk of the buffer is tested a 32-bit word at a time: a word has a
+ * zero byte iff (w - 0x01010101) & ~w & 0x80808080 is nonzero.
+ */
+static const char *find_delimiter(const char *data, size_t size) {
+    const char *end = data + size;
+
+    /** Bytes up to the first word boundary */
+    while(data < end && ((uintptr_t) data & (sizeof(uint32_t) - 1))) {
+        if(*data == '\0') {
+            return data;
+        }
+        data++;
+    }
+
+    /** Skip whole words without a zero byte */
+    while((size_t) (end - data) >= sizeof(uint32_t)) {
+        uint32_t word;
+        memcpy(&word, data, sizeof(word));
+        if((word - 0x01010101UL) & ~word & 0x80808080UL) {
+            break;
+        }
+        data += sizeof(uint32_t);
+    }
+
+    /** Locate the zero byte in the word that has one, or check the tail */
+    while(data < end) {
+        if(*data == '\0') {
+            return data;
+        }
+        data++;
+    }
+
+    return NULL;
+}
+
+SerialCOBS::SerialCOBS(mbed::FileHandle& fh) : _fh(fh), _staging_index(0),
+        _discarding(false) {
 }
 
 ssize_t SerialCOBS::write(const void* buffer, size_t size) {
@@ -94,10 +136,7 @@ ssize_t SerialCOBS::read(void* buffer, size_t size) {
         read_and_decode();
     }
 
-    while (data_read < size && !_output_buf.empty()) {
-        _output_buf.pop(*ptr++);
-        data_read++;
-    }
+    data_read = _output_buf.pop(ptr, size);
 
     _mutex.unlock();
 
@@ -106,38 +145,63 @@ ssize_t SerialCOBS::read(void* buffer, size_t size) {
 
 void SerialCOBS::read_and_decode() {
 
-    /** Read underlying file handle into staging buffer */
-    char rx_byte;
-    _fh.read(&rx_byte, 1);
+    /** Read whatever is available into the free end of the staging buffer */
+    ssize_t count = _fh.read(_staging_buf + _staging_index,
+            MBED_CONF_SERIALCOBS_RXBUF_SIZE - _staging_index);
 
-    // If this is a 0-byte delimeter, stop here and decode
-    if(rx_byte == '\0') {
-        char decode_buf[MBED_CONF_SERIALCOBS_RXBUF_SIZE];
-        cobsr_decode_result result = cobsr_decode(
-                decode_buf, MBED_CONF_SERIALCOBS_RXBUF_SIZE,
-                _staging_buf, _staging_index);
+    if(count <= 0) {
+        return;
+    }
 
-        if(result.status != COBSR_DECODE_OK) {
-            _staging_index = 0;
-            return;
-        }
+    const char *frame = _staging_buf;
+    const char *end = _staging_buf + _staging_index + count;
 
-        // Push the decoded buffer to the output buffer
-        for(unsigned int i = 0; i < result.out_len; i++) {
-            _output_buf.push(decode_buf[i]);
+    /** Only the new bytes need scanning, the staged ones have no delimiter */
+    const char *delimiter = find_delimiter(_staging_buf + _staging_index, count);
+
+    while(delimiter != NULL) {
+        if(_discarding) {
+            // End of an overflowed frame, resynchronized
+            _discarding = false;
+        } else {
+            decode_frame(frame, delimiter - frame);
         }
 
-        // Reset index
+        frame = delimiter + 1;
+        delimiter = find_delimiter(frame, end - frame);
+    }
+
+    if(_discarding) {
         _staging_index = 0;
+        return;
+    }
 
-    } else {
-        // Otherwise, just add it into the staging buffer
-        _staging_buf[_staging_index++] = rx_byte;
-        if(_staging_index > MBED_CONF_SERIALCOBS_RXBUF_SIZE) {
-            // Overflow! TODO - trace
-            _staging_index = 0;
-        }
+    // Keep the incomplete frame at the start of the staging buffer
+    _staging_index = end - frame;
+    if(frame != _staging_buf) {
+        memmove(_staging_buf, frame, _staging_index);
+    }
+
+    if(_staging_index == MBED_CONF_SERIALCOBS_RXBUF_SIZE) {
+        // Overflow! Drop the frame up to the next delimiter. TODO - trace
+        _staging_index = 0;
+        _discarding = true;
+    }
+}
+
+void SerialCOBS::decode_frame(const char *frame, size_t size) {
+
+    char decode_buf[MBED_CONF_SERIALCOBS_RXBUF_SIZE];
+    cobsr_decode_result result = cobsr_decode(
+            decode_buf, MBED_CONF_SERIALCOBS_RXBUF_SIZE,
+            frame, size);
+
+    if(result.status != COBSR_DECODE_OK) {
+        return;
     }
+
+    // Push the decoded frame to the output buffer
+    _output_buf.push(decode_buf, result.out_len);
 }
 
 //short SerialCOBS::poll(short events) const {
@@ -138,8 +138,19 @@ public:
 
 protected:
 
+    /**
+     * Read whatever the underlying file handle has available into the
+     * staging buffer and decode every complete frame it contains
+     */
     void read_and_decode(void);
 
+    /**
+     * Decode one COBS-encoded frame and push it to the output buffer
+     * @param[in] frame Encoded frame, without the delimiter
+     * @param[in] size Size of the encoded frame
+     */
+    void decode_frame(const char *frame, size_t size);
+
 protected:
 
     /** Internal file handle that is wrapped with COBS encoding/decoding */
@@ -153,9 +164,12 @@ protected:
     /** Staging buffer for reading in complete COBS-encoded packets */
     char _staging_buf[MBED_CONF_SERIALCOBS_RXBUF_SIZE];
 
-    /** Staging buffer write index */
+    /** Staging buffer write index, bytes of the incomplete frame held in it */
     size_t _staging_index;
 
+    /** Dropping an overflowed frame until the next delimiter */
+    bool _discarding;
+
     /** Output buffer to pass on decoded COBS packets */
     mbed::CircularBuffer<char, MBED_CONF_SERIALCOBS_RXBUF_SIZE> _output_buf;
 
@@ -0,0 +1,380 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_SNAPSHOTCALLCHAIN_H_
+#define EP_OC_MCU_EXTENSIONS_SNAPSHOTCALLCHAIN_H_
+
+#include "extensions/CallChain.h"
+
+#include "platform/Callback.h"
+#include "platform/NonCopyable.h"
+#include "platform/mbed_atomic.h"
+#include "platform/mbed_critical.h"
+
+#include <new>
+#include <type_traits>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ep {
+
+/**
+ * A fixed-capacity CallChain that may be modified from any context,
+ * including from within its own callbacks and from ISRs while call()
+ * is running in a thread.
+ *
+ * call() walks an immutable snapshot (version) of the link array.
+ * attach/detach copy the current version into a spare one, modify it and
+ * publish it with a single atomic store. Dispatch never takes a lock: it
+ * only pins the version it is walking with an atomic reader count, so
+ * dispatch latency is linear in the number of links regardless of
+ * concurrent subscribes and unsubscribes.
+ *
+ * Writers are serialized with a critical section that only lasts for the
+ * O(N) copy of the link pointers.
+ *
+ * Three versions are kept, which allows a handler to modify the chain any
+ * number of times from within a (non-nested) dispatch. If every spare
+ * version is pinned by in-progress dispatches, attach/detach fail and
+ * return false instead of blocking.
+ *
+ * @note A link detached during a dispatch may still be called by
+ * that dispatch. An application-owned link must not be destroyed
+ * until is_quiescent() returns true after detaching it.
+ */
+template<size_t N, typename... ArgTs>
+class SnapshotCallChain : private mbed::NonCopyable<SnapshotCallChain<N, ArgTs...>>
+{
+
+public:
+
+    typedef CallChainLink<ArgTs...> link_t;
+
+    SnapshotCallChain() : _current(0) {
+        for(size_t v = 0; v < VERSIONS; v++) {
+            _sizes[v] = 0;
+            _readers[v] = 0;
+        }
+        for(size_t slot = 0; slot < N; slot++) {
+            _pool_state[slot] = SLOT_FREE;
+        }
+    }
+
+    ~SnapshotCallChain() {
+        for(size_t slot = 0; slot < N; slot++) {
+            if(_pool_state[slot] != SLOT_FREE) {
+                this->pool_link(slot)->~link_t();
+            }
+        }
+    }
+
+    /**
+     * Attach an application-owned link to the callchain
+     * @param[in] link Link to attach
+     * @retval true if the link is in the chain, false if the chain is full or
+     * no spare version is available
+     *
+     * @note Interrupt safe
+     */
+    bool attach(link_t &link) {
+        core_util_critical_section_enter();
+        bool result = this->publish_attach(&link, -1);
+        core_util_critical_section_exit();
+        return result;
+    }
+
+    /**
+     * Attach a callback to the callchain, storing its link in the internal pool
+     * @param[in] cb Callback to attach to the callchain
+     * @retval true if the callback is in the chain, false if the chain is full or
+     * no spare version is available
+     *
+     * @note Interrupt safe
+     */
+    bool attach(const mbed::Callback<void(ArgTs...)> &cb) {
+        bool result = false;
+
+        core_util_critical_section_enter();
+
+        int slot = this->alloc_slot();
+        if(slot >= 0) {
+            new (&_pool[slot]) link_t(cb);
+            result = this->publish_attach(this->pool_link(slot), slot);
+        }
+
+        core_util_critical_section_exit();
+        return result;
+    }
+
+    /**
+     * Detach
+     * @param[in] link Link to remove from the callchain
+     * @retval true if the link is no longer in the chain, false if no spare version
+     * is available
+     *
+     * @note Interrupt safe
+     */
+    bool detach(const link_t &link) {
+        core_util_critical_section_enter();
+
+        bool result = true;
+        uint32_t cur = _current;
+        int index = this->find(cur, link);
+        if(index >= 0) {
+            int spare = this->spare_version();
+            if(spare < 0) {
+                result = false;
+            } else {
+                link_t *removed = _snapshots[cur][index];
+                size_t count = 0;
+                for(size_t i = 0; i < _sizes[cur]; i++) {
+                    if(i != (size_t) index) {
+                        _snapshots[spare][count++] = _snapshots[cur][i];
+                    }
+                }
+                _sizes[spare] = count;
+                core_util_atomic_store_u32(&_current, spare);
+                this->retire(removed);
+            }
+        }
+
+        core_util_critical_section_exit();
+        return result;
+    }
+
+    /**
+     * Detach, initializing with a Callback instance
+     * @param[in] cb Callback to remove from the callchain
+     */
+    bool detach(const mbed::Callback<void(ArgTs...)> &cb) {
+        return this->detach(link_t(cb));
+    }
+
+    /**
+     * Detach all links
+     * @retval true on success, false if no spare version is available
+     */
+    bool detach_all(void) {
+        core_util_critical_section_enter();
+
+        bool result = true;
+        uint32_t cur = _current;
+        int spare = this->spare_version();
+        if(spare < 0) {
+            result = false;
+        } else {
+            _sizes[spare] = 0;
+            core_util_atomic_store_u32(&_current, spare);
+            for(size_t i = 0; i < _sizes[cur]; i++) {
+                this->retire(_snapshots[cur][i]);
+            }
+        }
+
+        core_util_critical_section_exit();
+        return result;
+    }
+
+    /**
+     * Invoke all links in the current snapshot of this chain, in attach order
+     * @param[in] args Arguments to pass to each link in the chain
+     *
+     * @note Lock-free. Changes published during the call take effect on the next call.
+     */
+    void call(ArgTs... args) {
+
+        /** Pin the current version. Re-check after pinning in case a writer
+         * published (and started rewriting) a new version in between. */
+        uint32_t version;
+        while(true) {
+            version = core_util_atomic_load_u32(&_current);
+            core_util_atomic_incr_u32(&_readers[version], 1);
+            if(core_util_atomic_load_u32(&_current) == version) {
+                break;
+            }
+            core_util_atomic_decr_u32(&_readers[version], 1);
+        }
+
+        link_t *const *links = _snapshots[version];
+        size_t size = _sizes[version];
+        for(size_t i = 0; i < size; i++) {
+            links[i]->call(args...);
+        }
+
+        core_util_atomic_decr_u32(&_readers[version], 1);
+    }
+
+    void operator()(ArgTs... args) {
+        call(args...);
+    }
+
+    /** Number of links in the current snapshot */
+    size_t size(void) const {
+        return _sizes[core_util_atomic_load_u32(&_current)];
+    }
+
+    /**
+     * Returns true if no dispatch is walking an outdated snapshot.
+     * Once true, links detached before this call will not be called again.
+     */
+    bool is_quiescent(void) const {
+        uint32_t cur = core_util_atomic_load_u32(&_current);
+        for(uint32_t v = 0; v < VERSIONS; v++) {
+            if(v != cur && core_util_atomic_load_u32(&_readers[v]) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+protected:
+
+    static const uint32_t VERSIONS = 3;
+
+    enum slot_state_t {
+        SLOT_FREE,          /** Slot holds no link */
+        SLOT_LIVE,          /** Slot holds an attached link */
+        SLOT_RETIRED        /** Slot holds a detached link that may still be in use */
+    };
+
+    link_t *pool_link(size_t slot) {
+        return reinterpret_cast<link_t *>(&_pool[slot]);
+    }
+
+    /** Returns the index of an equivalent link in the given version, or -1 */
+    int find(uint32_t version, const link_t &link) {
+        for(size_t i = 0; i < _sizes[version]; i++) {
+            if(*_snapshots[version][i] == link) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    /** Returns true if any pinned version still references the link */
+    bool in_use(const link_t *link) {
+        for(uint32_t v = 0; v < VERSIONS; v++) {
+            if(v == _current || core_util_atomic_load_u32(&_readers[v]) != 0) {
+                for(size_t i = 0; i < _sizes[v]; i++) {
+                    if(_snapshots[v][i] == link) {
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    /** Returns a version that is neither current nor pinned, or -1 */
+    int spare_version(void) {
+        for(uint32_t v = 0; v < VERSIONS; v++) {
+            if(v != _current && core_util_atomic_load_u32(&_readers[v]) == 0) {
+                return v;
+            }
+        }
+        return -1;
+    }
+
+    /** Find a pool slot for a new link, recycling retired links no longer in use */
+    int alloc_slot(void) {
+        for(size_t slot = 0; slot < N; slot++) {
+            if(_pool_state[slot] == SLOT_FREE) {
+                return slot;
+            }
+        }
+        for(size_t slot = 0; slot < N; slot++) {
+            if(_pool_state[slot] == SLOT_RETIRED && !this->in_use(this->pool_link(slot))) {
+                this->pool_link(slot)->~link_t();
+                _pool_state[slot] = SLOT_FREE;
+                return slot;
+            }
+        }
+        return -1;
+    }
+
+    /** Mark a pool link as detached. Its storage is recycled lazily. */
+    void retire(link_t *link) {
+        for(size_t slot = 0; slot < N; slot++) {
+            if(_pool_state[slot] == SLOT_LIVE && link == this->pool_link(slot)) {
+                _pool_state[slot] = SLOT_RETIRED;
+                return;
+            }
+        }
+    }
+
+    /**
+     * Publish a new version with the given link appended
+     * @param[in] slot Pool slot of the link, or -1 if application-owned
+     */
+    bool publish_attach(link_t *link, int slot) {
+        uint32_t cur = _current;
+        int spare = -1;
+
+        /** Make sure a duplicate isn't being added */
+        bool duplicate = (this->find(cur, *link) >= 0);
+        if(!duplicate && _sizes[cur] < N) {
+            spare = this->spare_version();
+        }
+
+        if(spare < 0) {
+            if(slot >= 0) {
+                link->~link_t();
+                _pool_state[slot] = SLOT_FREE;
+            }
+            return duplicate;
+        }
+
+        for(size_t i = 0; i < _sizes[cur]; i++) {
+            _snapshots[spare][i] = _snapshots[cur][i];
+        }
+        _snapshots[spare][_sizes[cur]] = link;
+        _sizes[spare] = _sizes[cur] + 1;
+
+        if(slot >= 0) {
+            _pool_state[slot] = SLOT_LIVE;
+        }
+
+        core_util_atomic_store_u32(&_current, spare);
+        return true;
+    }
+
+protected:
+
+    /** Link arrays, one per version */
+    link_t *_snapshots[VERSIONS][N];
+    size_t _sizes[VERSIONS];
+
+    /** Number of dispatches walking each version */
+    volatile uint32_t _readers[VERSIONS];
+
+    /** Index of the published version */
+    volatile uint32_t _current;
+
+    /** Storage for links attached by Callback */
+    typename std::aligned_storage<sizeof(link_t), alignof(link_t)>::type _pool[N];
+    uint8_t _pool_state[N];
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_SNAPSHOTCALLCHAIN_H_ */
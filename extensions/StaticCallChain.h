@@ -0,0 +1,225 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_STATICCALLCHAIN_H_
+#define EP_OC_MCU_EXTENSIONS_STATICCALLCHAIN_H_
+
+#include "extensions/CallChain.h"
+
+#include "platform/Callback.h"
+#include "platform/NonCopyable.h"
+
+#include <new>
+#include <type_traits>
+#include <stddef.h>
+
+namespace ep {
+
+/**
+ * A CallChain with a compile-time capacity that never allocates.
+ *
+ * The chain stores pointers to its links, so links are dispatched by reference
+ * and any CallChainLink subclass keeps its virtual behavior.
+ *
+ * Links can be attached in two ways:
+ * - By reference to an application-owned CallChainLink (intrusive). The
+ *   application must keep the link alive until it is detached.
+ * - By mbed::Callback. A plain CallChainLink is constructed in a slot of
+ *   the chain's internal pool.
+ *
+ * Unlike CallChain, links are dispatched in the order they were attached.
+ *
+ * @note Attaching or detaching while the chain is being called is not supported
+ */
+template<size_t N, typename... ArgTs>
+class StaticCallChain : private mbed::NonCopyable<StaticCallChain<N, ArgTs...>>
+{
+
+public:
+
+    typedef CallChainLink<ArgTs...> link_t;
+
+    StaticCallChain() : _count(0) {
+        for(size_t i = 0; i < N; i++) {
+            _pool_used[i] = false;
+        }
+    }
+
+    ~StaticCallChain() {
+        this->detach_all();
+    }
+
+    /**
+     * Attach an application-owned link to the callchain
+     * @param[in] link Link to attach. Must outlive its membership in the chain.
+     * @retval true if the link is in the chain, false if the chain is full
+     *
+     * @note Attaching a link equivalent to one already in the chain does nothing
+     */
+    bool attach(link_t &link) {
+
+        /** Make sure a duplicate isn't being added */
+        if(this->find(link) >= 0) {
+            return true;
+        }
+
+        if(_count >= N) {
+            return false;
+        }
+
+        _links[_count++] = &link;
+        return true;
+    }
+
+    /**
+     * Attach a callback to the callchain, storing its link in the internal pool
+     * @param[in] cb Callback to attach to the callchain
+     * @retval true if the callback is in the chain, false if the chain is full
+     */
+    bool attach(const mbed::Callback<void(ArgTs...)> &cb) {
+
+        link_t tmp(cb);
+        if(this->find(tmp) >= 0) {
+            return true;
+        }
+
+        if(_count >= N) {
+            return false;
+        }
+
+        /** A free pool slot always exists if the chain is not full */
+        size_t slot = 0;
+        while(_pool_used[slot]) {
+            slot++;
+        }
+
+        _pool_used[slot] = true;
+        _links[_count++] = new (&_pool[slot]) link_t(cb);
+        return true;
+    }
+
+    /**
+     * Detach
+     * @param[in] link Link to remove from the callchain
+     *
+     * @note Equivalency is based on CallChainLink comparison, not pointer comparison
+     */
+    void detach(const link_t &link) {
+
+        int index = this->find(link);
+        if(index < 0) {
+            return;
+        }
+
+        this->release(_links[index]);
+
+        /** Shift the remaining links down to preserve dispatch order */
+        for(size_t i = index; i + 1 < _count; i++) {
+            _links[i] = _links[i + 1];
+        }
+        _count--;
+    }
+
+    /**
+     * Detach, initializing with a Callback instance
+     * @param[in] cb Callback to remove from the callchain
+     */
+    void detach(const mbed::Callback<void(ArgTs...)> &cb) {
+        this->detach(link_t(cb));
+    }
+
+    void detach_all(void) {
+        for(size_t i = 0; i < _count; i++) {
+            this->release(_links[i]);
+        }
+        _count = 0;
+    }
+
+    /**
+     * Invoke all links in this chain, in attach order
+     * @param[in] args Arguments to pass to each link in the chain
+     */
+    void call(ArgTs... args) {
+        for(size_t i = 0; i < _count; i++) {
+            _links[i]->call(args...);
+        }
+    }
+
+    void operator()(ArgTs... args) {
+        call(args...);
+    }
+
+    /** Number of links currently attached */
+    size_t size(void) const {
+        return _count;
+    }
+
+    /** Maximum number of links this chain can hold */
+    constexpr size_t capacity(void) const {
+        return N;
+    }
+
+    bool full(void) const {
+        return (_count >= N);
+    }
+
+protected:
+
+    /** Returns the index of the link equivalent to the given one, or -1 */
+    int find(const link_t &link) {
+        for(size_t i = 0; i < _count; i++) {
+            if(*_links[i] == link) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    /** Destroys the given link if it lives in the internal pool */
+    void release(link_t *link) {
+        for(size_t slot = 0; slot < N; slot++) {
+            if(_pool_used[slot] && (link == reinterpret_cast<link_t *>(&_pool[slot]))) {
+                link->~link_t();
+                _pool_used[slot] = false;
+                return;
+            }
+        }
+    }
+
+protected:
+
+    /** Links in dispatch order */
+    link_t *_links[N];
+
+    /** Number of valid entries in _links */
+    size_t _count;
+
+    /** Storage for links attached by Callback */
+    typename std::aligned_storage<sizeof(link_t), alignof(link_t)>::type _pool[N];
+    bool _pool_used[N];
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_STATICCALLCHAIN_H_ */
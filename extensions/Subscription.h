@@ -0,0 +1,209 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_SUBSCRIPTION_H_
+#define EP_OC_MCU_EXTENSIONS_SUBSCRIPTION_H_
+
+#include <stddef.h>
+
+namespace ep {
+
+class Subscription;
+
+/**
+ * Interface implemented by anything that hands out Subscriptions (eg: CallChain)
+ */
+class Subscribable
+{
+
+protected:
+
+    friend class Subscription;
+
+    virtual ~Subscribable() { }
+
+    /** Remove the given node. Must be O(1). */
+    virtual void unsubscribe(void *node) = 0;
+
+    /** Record which Subscription (or NULL) owns the given node */
+    virtual void set_owner(void *node, Subscription *owner) = 0;
+
+    /** Tell a Subscription its node was removed by other means */
+    static void orphan(Subscription *owner);
+
+};
+
+/**
+ * Non-owning reference to an attached callback, returned by attach().
+ *
+ * Ignoring it keeps the callback attached until it is detached explicitly.
+ * Converting it into a Subscription ties the lifetime of the callback to
+ * the Subscription.
+ *
+ * Tokens are move-only and converting one into a Subscription empties it,
+ * so a callback can only ever be owned by one Subscription.
+ *
+ * @note A token is only valid until the callback is detached. Convert it
+ * into a Subscription right away rather than storing it.
+ */
+class SubscriptionToken
+{
+
+public:
+
+    SubscriptionToken() : _host(NULL), _node(NULL) {
+    }
+
+    SubscriptionToken(Subscribable *host, void *node) : _host(host), _node(node) {
+    }
+
+    SubscriptionToken(SubscriptionToken &&other) : _host(other._host), _node(other._node) {
+        other._host = NULL;
+        other._node = NULL;
+    }
+
+    SubscriptionToken &operator=(SubscriptionToken &&other) {
+        if(this != &other) {
+            _host = other._host;
+            _node = other._node;
+            other._host = NULL;
+            other._node = NULL;
+        }
+        return *this;
+    }
+
+    SubscriptionToken(const SubscriptionToken &) = delete;
+    SubscriptionToken &operator=(const SubscriptionToken &) = delete;
+
+    /** False if attach did not add a new callback (eg: duplicate or full) */
+    bool is_valid(void) const {
+        return (_host != NULL);
+    }
+
+private:
+
+    friend class Subscription;
+
+    Subscribable *_host;
+    void *_node;
+
+};
+
+/**
+ * RAII handle to an attached callback. The callback is detached in O(1)
+ * when the Subscription is destroyed or reset.
+ *
+ * Subscriptions are movable but not copyable. They may be destroyed from
+ * within a dispatch of the chain they are subscribed to.
+ *
+ * @code
+ * ep::Subscription sub = variable.attach(mbed::callback(this, &Service::on_update));
+ * @endcode
+ */
+class Subscription
+{
+
+public:
+
+    Subscription() : _host(NULL), _node(NULL) {
+    }
+
+    /** Take ownership of an attached callback, the token is emptied */
+    Subscription(SubscriptionToken &&token) : _host(token._host), _node(token._node) {
+        token._host = NULL;
+        token._node = NULL;
+        if(_host) {
+            _host->set_owner(_node, this);
+        }
+    }
+
+    Subscription(Subscription &&other) : _host(other._host), _node(other._node) {
+        other._host = NULL;
+        other._node = NULL;
+        if(_host) {
+            _host->set_owner(_node, this);
+        }
+    }
+
+    Subscription &operator=(Subscription &&other) {
+        if(this != &other) {
+            this->reset();
+            _host = other._host;
+            _node = other._node;
+            other._host = NULL;
+            other._node = NULL;
+            if(_host) {
+                _host->set_owner(_node, this);
+            }
+        }
+        return *this;
+    }
+
+    Subscription(const Subscription &) = delete;
+    Subscription &operator=(const Subscription &) = delete;
+
+    ~Subscription() {
+        this->reset();
+    }
+
+    /** Detach the callback now */
+    void reset(void) {
+        if(_host) {
+            Subscribable *host = _host;
+            _host = NULL;
+            host->unsubscribe(_node);
+            _node = NULL;
+        }
+    }
+
+    /** Stop tracking the callback without detaching it */
+    void release(void) {
+        if(_host) {
+            _host->set_owner(_node, NULL);
+            _host = NULL;
+            _node = NULL;
+        }
+    }
+
+    /** True while the callback is attached */
+    bool is_active(void) const {
+        return (_host != NULL);
+    }
+
+private:
+
+    friend class Subscribable;
+
+    Subscribable *_host;
+    void *_node;
+
+};
+
+inline void Subscribable::orphan(Subscription *owner) {
+    owner->_host = NULL;
+    owner->_node = NULL;
+}
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_SUBSCRIPTION_H_ */
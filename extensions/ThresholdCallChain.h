@@ -0,0 +1,286 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_THRESHOLDCALLCHAIN_H_
+#define EP_OC_MCU_EXTENSIONS_THRESHOLDCALLCHAIN_H_
+
+#include "extensions/CallChain.h"
+
+#include "platform/Callback.h"
+#include "platform/NonCopyable.h"
+
+#include <algorithm>
+#include <stddef.h>
+
+namespace ep {
+
+/**
+ * A CallChainLink that is triggered when a value crosses its threshold.
+ *
+ * The link is "above" once the value rises to or past the threshold and
+ * goes back "below" once the value falls under (threshold - hysteresis).
+ * The callback is executed on the transitions selected by the edge mask
+ * and can check is_above() to tell them apart.
+ */
+template<typename T>
+class ThresholdLink : public CallChainLink<T>
+{
+
+public:
+
+    enum edge_t {
+        RISING  = 0x1,  /** Call when the value rises to or past the threshold */
+        FALLING = 0x2,  /** Call when the value falls below threshold - hysteresis */
+        BOTH    = 0x3
+    };
+
+    /**
+     * Create a threshold link
+     * @param[in] cb Callback to execute on a crossing, receives the new value
+     * @param[in] threshold Rising threshold
+     * @param[in] hysteresis Distance below the threshold the value must fall to re-arm
+     * @param[in] edges Which crossings execute the callback
+     */
+    ThresholdLink(mbed::Callback<void(T)> cb, T threshold, T hysteresis = T(), edge_t edges = BOTH) :
+        CallChainLink<T>(cb), _threshold(threshold), _hysteresis(hysteresis), _edges(edges), _above(false) {
+    }
+
+    T threshold(void) const {
+        return _threshold;
+    }
+
+    /** Value the input must fall below to re-arm the link */
+    T release_threshold(void) const {
+        return _threshold - _hysteresis;
+    }
+
+    /** True if the value is considered above the threshold */
+    bool is_above(void) const {
+        return _above;
+    }
+
+    /** Called by ThresholdCallChain when the value crosses the threshold upwards */
+    virtual void on_rising(T value) {
+        if(!_above) {
+            _above = true;
+            if(_edges & RISING) {
+                this->call(value);
+            }
+        }
+    }
+
+    /** Called by ThresholdCallChain when the value crosses the release threshold downwards */
+    virtual void on_falling(T value) {
+        if(_above) {
+            _above = false;
+            if(_edges & FALLING) {
+                this->call(value);
+            }
+        }
+    }
+
+    /** Sets the state of the link without executing the callback */
+    void prime(T value) {
+        _above = (value >= _threshold);
+    }
+
+protected:
+
+    T _threshold;
+    T _hysteresis;
+    edge_t _edges;
+    bool _above;
+
+};
+
+/**
+ * A chain of ThresholdLinks indexed by threshold.
+ *
+ * Rising and release thresholds are each kept in a sorted array. On every new
+ * value only the links whose thresholds lie between the previous and the new
+ * value are visited, so dispatch costs O(log N + crossings) instead of O(N).
+ *
+ * The first value primes every link without executing any callbacks.
+ *
+ * Typical use is to attach call() to a BoundVariable:
+ * @code
+ * ep::ThresholdCallChain<float, 8> thresholds;
+ * temperature.attach(mbed::callback(&thresholds, &ep::ThresholdCallChain<float, 8>::call));
+ * @endcode
+ *
+ * @note Links are owned by the application and must be detached before being destroyed.
+ * @note Attaching or detaching while the chain is being called is not supported
+ */
+template<typename T, size_t N>
+class ThresholdCallChain : private mbed::NonCopyable<ThresholdCallChain<T, N>>
+{
+
+public:
+
+    typedef ThresholdLink<T> link_t;
+
+    ThresholdCallChain() : _count(0), _primed(false) {
+    }
+
+    /**
+     * Attach a threshold link. O(N) to keep the index sorted.
+     * @param[in] link Link to attach
+     * @retval true on success, false if the chain is full
+     */
+    bool attach(link_t &link) {
+
+        /** Make sure a duplicate isn't being added */
+        for(size_t i = 0; i < _count; i++) {
+            if(_rising[i] == &link) {
+                return true;
+            }
+        }
+
+        if(_count >= N) {
+            return false;
+        }
+
+        if(_primed) {
+            link.prime(_last);
+        }
+
+        insert(_rising, &link, link.threshold(), rising_key);
+        insert(_falling, &link, link.release_threshold(), falling_key);
+        _count++;
+        return true;
+    }
+
+    /**
+     * Detach a threshold link
+     * @param[in] link Link to remove
+     */
+    void detach(link_t &link) {
+        if(remove(_rising, &link)) {
+            remove(_falling, &link);
+            _count--;
+        }
+    }
+
+    void detach_all(void) {
+        _count = 0;
+    }
+
+    /**
+     * Process a new value, calling every link whose threshold was crossed
+     * since the previous value
+     * @param[in] value New value
+     */
+    void call(T value) {
+
+        if(!_primed) {
+            for(size_t i = 0; i < _count; i++) {
+                _rising[i]->prime(value);
+            }
+            _primed = true;
+        } else if(value > _last) {
+            /** Rising thresholds in (last, value], in ascending order */
+            link_t **it = std::upper_bound(_rising, _rising + _count, _last, value_before_rising);
+            for(; it != _rising + _count && (*it)->threshold() <= value; it++) {
+                (*it)->on_rising(value);
+            }
+        } else if(value < _last) {
+            /** Release thresholds in (value, last], in descending order */
+            link_t **lo = std::upper_bound(_falling, _falling + _count, value, value_before_falling);
+            link_t **it = std::upper_bound(lo, _falling + _count, _last, value_before_falling);
+            while(it != lo) {
+                it--;
+                (*it)->on_falling(value);
+            }
+        }
+
+        _last = value;
+    }
+
+    void operator()(T value) {
+        call(value);
+    }
+
+    /** Number of links currently attached */
+    size_t size(void) const {
+        return _count;
+    }
+
+protected:
+
+    static T rising_key(const link_t *link) {
+        return link->threshold();
+    }
+
+    static T falling_key(const link_t *link) {
+        return link->release_threshold();
+    }
+
+    static bool value_before_rising(const T &value, const link_t *link) {
+        return value < link->threshold();
+    }
+
+    static bool value_before_falling(const T &value, const link_t *link) {
+        return value < link->release_threshold();
+    }
+
+    /** Insert the link keeping the array sorted by key, stable for equal keys */
+    void insert(link_t **index, link_t *link, T key, T (*key_of)(const link_t *)) {
+        size_t pos = _count;
+        while(pos > 0 && key < key_of(index[pos - 1])) {
+            index[pos] = index[pos - 1];
+            pos--;
+        }
+        index[pos] = link;
+    }
+
+    bool remove(link_t **index, link_t *link) {
+        for(size_t i = 0; i < _count; i++) {
+            if(index[i] == link) {
+                for(; i + 1 < _count; i++) {
+                    index[i] = index[i + 1];
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+protected:
+
+    /** Links sorted by rising threshold */
+    link_t *_rising[N];
+
+    /** Links sorted by release threshold */
+    link_t *_falling[N];
+
+    size_t _count;
+
+    /** Previous value */
+    T _last;
+    bool _primed;
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_THRESHOLDCALLCHAIN_H_ */
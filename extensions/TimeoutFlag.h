@@ -20,19 +20,159 @@
 #ifndef EP_OC_MCU_EXTENSIONS_TIMEOUTFLAG_H_
 #define EP_OC_MCU_EXTENSIONS_TIMEOUTFLAG_H_
 
-#include "drivers/Timeout.h"
+#include "TimerWheel/TimeoutTimerWheel.h"
 #include "platform/Callback.h"
+#include "platform/NonCopyable.h"
+#include "rtos/Kernel.h"
+#include "rtos/ThisThread.h"
 
 #include <chrono>
+#include <utility>
+
+namespace ep {
+
+/**
+ * Flag backends for BasicTimeoutFlag. A backend provides:
+ * - void clear(): reset the flag and any cancellation, called by start()
+ * - void set(): set the flag, called from the timer interrupt
+ * - void cancel(): wake waiters without setting the flag, called by stop()
+ * - bool is_set() const
+ * - bool wait(std::chrono::milliseconds limit): block until the flag is set
+ *   or cancelled or the limit elapses, returns is_set()
+ */
+
+/**
+ * Plain volatile bool. wait() polls every millisecond with
+ * ThisThread::sleep_for, so the MCU sleeps between polls.
+ */
+class VolatileBoolFlag
+{
+
+public:
+
+    void clear(void) {
+        _flag = false;
+        _cancelled = false;
+    }
+
+    void set(void) {
+        _flag = true;
+    }
+
+    void cancel(void) {
+        _cancelled = true;
+    }
+
+    bool is_set(void) const {
+        return _flag;
+    }
+
+    bool wait(std::chrono::milliseconds limit) {
+        rtos::Kernel::Clock::time_point deadline = rtos::Kernel::Clock::now() + limit;
+        while(!_flag && !_cancelled && rtos::Kernel::Clock::now() < deadline) {
+            rtos::ThisThread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return _flag;
+    }
+
+protected:
+
+    volatile bool _flag = false;
+    volatile bool _cancelled = false;
+
+};
+
+}
+
+#if defined(MBED_CONF_RTOS_PRESENT) // For baremetal builds
+
+#include "rtos/EventFlags.h"
+
+namespace ep {
+
+/**
+ * rtos::EventFlags, so wait() blocks the calling thread until the timeout
+ * fires or is stopped. Any number of threads may wait.
+ */
+class EventFlagsFlag : private mbed::NonCopyable<EventFlagsFlag>
+{
+
+public:
+
+    void clear(void) {
+        _flags.clear(FLAG_SET | FLAG_CANCELLED);
+    }
+
+    void set(void) {
+        _flags.set(FLAG_SET);
+    }
+
+    void cancel(void) {
+        _flags.set(FLAG_CANCELLED);
+    }
+
+    bool is_set(void) const {
+        return (_flags.get() & FLAG_SET);
+    }
+
+    bool wait(std::chrono::milliseconds limit) {
+        /** Flags are left set so is_set() and other waiters still see them */
+        _flags.wait_any_for(FLAG_SET | FLAG_CANCELLED, limit, false);
+        return this->is_set();
+    }
 
-/* TODO extend this so that it supports both volatile bool and rtos flags. Use templating and create generic flag API + default implementations */
+protected:
+
+    static const uint32_t FLAG_SET = (1 << 0);
+    static const uint32_t FLAG_CANCELLED = (1 << 1);
+
+    rtos::EventFlags _flags;
+
+};
 
-/** Class encapsulating a flag that is set/reset by an IRQ timeout */
-class TimeoutFlag
+}
+
+#endif // defined(MBED_CONF_RTOS_PRESENT)
+
+/**
+ * Class encapsulating a flag that is set/reset by an IRQ timeout
+ *
+ * The timeout is a SoftTimer on a shared ep::TimerWheel, so any number of
+ * TimeoutFlags use a single hardware timeout. It has the resolution of the
+ * wheel's tick (MBED_CONF_TIMERWHEEL_TICK_US) and never expires early.
+ *
+ * The flag itself is a backend (see ep::VolatileBoolFlag): with
+ * ep::EventFlagsFlag (RTOS builds only) or ep::EventQueueFlag (see
+ * EventQueueFlag.h, needs mbed-events), a thread can block in wait_for()
+ * instead of polling is_set(), which lets the MCU sleep.
+ *
+ * @code
+ * BasicTimeoutFlag<ep::EventFlagsFlag> tx_timeout;
+ *
+ * tx_timeout.start(10ms);
+ * if(tx_timeout.wait_for(10ms)) {
+ *     // timed out
+ * }
+ * @endcode
+ *
+ * @tparam Flag Flag backend
+ */
+template<typename Flag = ep::VolatileBoolFlag>
+class BasicTimeoutFlag : private mbed::NonCopyable<BasicTimeoutFlag<Flag>>
 {
 public:
 
-    TimeoutFlag() {
+    BasicTimeoutFlag() : BasicTimeoutFlag(ep::default_timer_wheel()) {
+    }
+
+    /**
+     * @param[in] wheel Timer wheel running the timeout
+     * @param[in] args Arguments of the flag backend's constructor, if any
+     */
+    template<typename... Args>
+    BasicTimeoutFlag(ep::TimerWheel &wheel, Args &&... args) :
+        _flag(std::forward<Args>(args)...), _wheel(wheel),
+        _timer(mbed::callback(this, &BasicTimeoutFlag::on_timeout)) {
     }
 
     /**
@@ -42,38 +182,59 @@ public:
      * @param[in] timeout Chrono duration of timeout
      */
     void start(std::chrono::microseconds timeout) {
-        _flag = false;
-        _timeout.detach();
-        _timeout.attach(mbed::callback(this, &TimeoutFlag::on_timeout), timeout);
+        /** The previous timeout must not fire between clear() and the restart */
+        _wheel.stop(_timer);
+        _flag.clear();
+        _wheel.start(_timer, timeout);
     }
 
     /**
-     * Stop the timeout. The internal flag will be unchanged if the timeout has not yet occurred
+     * Stop the timeout. The internal flag will be unchanged if the timeout has not yet occurred.
+     * Threads blocked in wait_for() return.
      */
     void stop() {
-        _timeout.detach();
+        _wheel.stop(_timer);
+        _flag.cancel();
     }
 
     /**
      * Returns true if the internal flag is set. ie: the timeout has occurred.
      */
     bool is_set() const {
+        return _flag.is_set();
+    }
+
+    /**
+     * Block until the timeout occurs or is stopped, or for at most the given time
+     * @param[in] limit Longest time to wait
+     * @retval true if the timeout occurred
+     */
+    bool wait_for(std::chrono::milliseconds limit) {
+        return _flag.wait(limit);
+    }
+
+    /** Backend of the flag */
+    Flag &flag() {
         return _flag;
     }
 
 protected:
 
     void on_timeout() {
-        _flag = true;
+        _flag.set();
     }
 
 protected:
 
-    volatile bool _flag = false;
-    mbed::Timeout _timeout;
+    Flag _flag;
+    ep::TimerWheel &_wheel;
+    ep::SoftTimer _timer;
 
 };
 
+/** TimeoutFlag backed by a volatile bool, as it always was */
+typedef BasicTimeoutFlag<> TimeoutFlag;
+
 
 
 #endif /* EP_OC_MCU_EXTENSIONS_TIMEOUTFLAG_H_ */
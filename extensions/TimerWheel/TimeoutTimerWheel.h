@@ -0,0 +1,100 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_TIMEOUTTIMERWHEEL_H_
+#define EP_OC_MCU_EXTENSIONS_TIMEOUTTIMERWHEEL_H_
+
+#include "TimerWheel.h"
+
+#include "drivers/Timeout.h"
+#include "drivers/HighResClock.h"
+
+#include <chrono>
+#include <stdint.h>
+
+#ifndef MBED_CONF_TIMERWHEEL_TICK_US
+#define MBED_CONF_TIMERWHEEL_TICK_US  1000
+#endif
+
+namespace ep {
+
+/**
+ * TimerWheel driven by one hardware timeout, eg:
+ * - TimeoutTimerWheel<> uses an mbed::Timeout and the HighResClock
+ * - TimeoutTimerWheel<mbed::LowPowerTimeout, mbed::LowPowerClock> keeps
+ *   running in deep sleep
+ *
+ * @tparam Timeout Hardware timeout type
+ * @tparam Clock Clock of the ticker the timeout runs on
+ */
+template<typename Timeout = mbed::Timeout, typename Clock = mbed::HighResClock>
+class TimeoutTimerWheel : public TimerWheel
+{
+
+public:
+
+    /** @param[in] tick Duration of one tick */
+    TimeoutTimerWheel(std::chrono::microseconds tick = std::chrono::microseconds(MBED_CONF_TIMERWHEEL_TICK_US)) :
+        TimerWheel(tick) {
+    }
+
+    virtual ~TimeoutTimerWheel() {
+        _timeout.detach();
+    }
+
+protected:
+
+    virtual uint32_t now(void) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                Clock::now().time_since_epoch()).count() / this->_tick_us;
+    }
+
+    virtual void schedule(uint32_t ticks) {
+        _timeout.detach();
+        _timeout.attach(mbed::callback(this, &TimeoutTimerWheel::on_timeout),
+                std::chrono::microseconds((uint64_t) ticks * this->_tick_us));
+    }
+
+    virtual void cancel(void) {
+        _timeout.detach();
+    }
+
+    void on_timeout(void) {
+        this->process();
+    }
+
+protected:
+
+    Timeout _timeout;
+
+};
+
+/**
+ * Timer wheel shared by every TimeoutFlag that is not given its own,
+ * a TimeoutTimerWheel<> with MBED_CONF_TIMERWHEEL_TICK_US ticks
+ */
+TimerWheel &default_timer_wheel(void);
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_TIMEOUTTIMERWHEEL_H_ */
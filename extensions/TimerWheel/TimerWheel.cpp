@@ -0,0 +1,318 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "TimerWheel.h"
+
+#include "platform/mbed_critical.h"
+#include "platform/mbed_assert.h"
+
+#include <cstring>
+
+using namespace ep;
+
+static const uint32_t SLOT_MASK = TimerWheel::SLOTS - 1;
+
+static inline uint64_t rotate_right(uint64_t bits, uint32_t n) {
+    return n ? ((bits >> n) | (bits << (64 - n))) : bits;
+}
+
+/** Number of zero bits below the lowest set bit, bits must not be 0 */
+static inline uint32_t count_trailing_zeros(uint64_t bits) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    /** Portable fallback (eg: IAR) */
+    uint32_t count = 0;
+    if(!(uint32_t) bits) {
+        bits >>= 32;
+        count = 32;
+    }
+    while(!(bits & 1)) {
+        bits >>= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+SoftTimer::~SoftTimer() {
+    if(_wheel) {
+        _wheel->stop(*this);
+    }
+}
+
+TimerWheel::TimerWheel(std::chrono::microseconds tick) :
+        _tick_us(tick.count()), _next_tick(0), _scheduled_tick(0), _scheduled(false),
+        _active_count(0), _process_count(0), _expired_count(0), _cascade_count(0) {
+    MBED_ASSERT(_tick_us > 0);
+    memset(_slots, 0, sizeof(_slots));
+    memset(_occupied, 0, sizeof(_occupied));
+}
+
+uint32_t TimerWheel::to_ticks(std::chrono::microseconds timeout) const {
+    /** Starting part way through a tick, one more tick makes sure it never expires early */
+    uint64_t ticks = ((uint64_t) timeout.count() + _tick_us - 1) / _tick_us + 1;
+    return (ticks > MAX_TICKS)? MAX_TICKS : (uint32_t) ticks;
+}
+
+void TimerWheel::start(SoftTimer &timer, uint32_t ticks) {
+    if(ticks == 0) {
+        ticks = 1;
+    } else if(ticks > MAX_TICKS) {
+        ticks = MAX_TICKS;
+    }
+
+    core_util_critical_section_enter();
+
+    /** Restarting on the same wheel leaves the hardware timeout alone */
+    if(timer.active()) {
+        if(timer._wheel == this) {
+            this->unlink(timer);
+            _active_count--;
+        } else {
+            timer._wheel->stop(timer);
+        }
+    }
+
+    uint32_t now = this->now();
+    if(_active_count == 0) {
+        _next_tick = now;
+    } else {
+        this->skip_idle(now);
+    }
+
+    timer._wheel = this;
+    timer._expires = now + ticks;
+    this->insert(timer);
+    _active_count++;
+
+    /** Only touch the hardware if the next event moved earlier */
+    uint32_t next = _next_tick + this->ticks_to_next_event();
+    if(!_scheduled || (int32_t) (next - _scheduled_tick) < 0) {
+        this->reschedule(now);
+    }
+
+    core_util_critical_section_exit();
+}
+
+void TimerWheel::stop(SoftTimer &timer) {
+    core_util_critical_section_enter();
+    if(timer.active()) {
+        this->unlink(timer);
+        _active_count--;
+        if(_active_count == 0 && _scheduled) {
+            _scheduled = false;
+            this->cancel();
+        }
+    }
+    core_util_critical_section_exit();
+}
+
+void TimerWheel::process(void) {
+
+    core_util_critical_section_enter();
+    _process_count++;
+    _scheduled = false;
+
+    uint32_t now = this->now();
+    while((int32_t) (now - _next_tick) >= 0) {
+        this->skip_idle(now);
+        if((int32_t) (now - _next_tick) < 0) {
+            break;
+        }
+        this->run_tick();
+    }
+    core_util_critical_section_exit();
+
+    /**
+     * Run the callbacks outside of the critical section, one at a time, so
+     * a callback can stop or restart any timer, including expired ones
+     */
+    while(true) {
+        core_util_critical_section_enter();
+        SoftTimer *timer = _slots[EXPIRED_SLOT];
+        if(!timer) {
+            core_util_critical_section_exit();
+            break;
+        }
+        this->unlink(*timer);
+        _active_count--;
+        _expired_count++;
+        mbed::Callback<void()> cb = timer->_callback;
+        core_util_critical_section_exit();
+
+        if(cb) {
+            cb();
+        }
+    }
+
+    core_util_critical_section_enter();
+    if(!_scheduled) {
+        this->reschedule(this->now());
+    }
+    core_util_critical_section_exit();
+}
+
+uint32_t TimerWheel::ticks_to_next_event(void) const {
+    uint32_t best = UINT32_MAX;
+    for(uint32_t level = 0; level < LEVELS; level++) {
+        uint64_t occupied = _occupied[level];
+        if(!occupied) {
+            continue;
+        }
+
+        /** Level n slots are processed on ticks that are multiples of 64^n */
+        uint32_t shift = level * LEVEL_BITS;
+        uint32_t mask = (1UL << shift) - 1;
+        uint32_t boundary = (_next_tick + mask) & ~mask;
+        uint32_t index = (boundary >> shift) & SLOT_MASK;
+        uint32_t slots = count_trailing_zeros(rotate_right(occupied, index));
+
+        uint32_t ticks = (boundary - _next_tick) + (slots << shift);
+        if(ticks < best) {
+            best = ticks;
+        }
+    }
+    return best;
+}
+
+void TimerWheel::skip_idle(uint32_t now) {
+    uint32_t behind = now - _next_tick;
+    if((int32_t) behind <= 0) {
+        return;
+    }
+    uint32_t idle = this->ticks_to_next_event();
+    _next_tick += (idle < behind)? idle : behind;
+}
+
+void TimerWheel::run_tick(void) {
+    uint32_t tick = _next_tick;
+
+    /** Cascade the next slot of level n + 1 each time level n wraps */
+    if((tick & SLOT_MASK) == 0) {
+        for(uint32_t level = 1; level < LEVELS; level++) {
+            uint32_t index = (tick >> (level * LEVEL_BITS)) & SLOT_MASK;
+            uint16_t slot = level * SLOTS + index;
+
+            SoftTimer *timer = _slots[slot];
+            _slots[slot] = NULL;
+            _occupied[level] &= ~(1ULL << index);
+            while(timer) {
+                SoftTimer *next = timer->_next;
+                this->insert(*timer);
+                _cascade_count++;
+                timer = next;
+            }
+
+            if(index != 0) {
+                break;
+            }
+        }
+    }
+
+    /** Move the expired timers to the list their callbacks are run from */
+    uint32_t index = tick & SLOT_MASK;
+    SoftTimer *timer = _slots[index];
+    _slots[index] = NULL;
+    _occupied[0] &= ~(1ULL << index);
+    while(timer) {
+        SoftTimer *next = timer->_next;
+        this->link(*timer, EXPIRED_SLOT);
+        timer = next;
+    }
+
+    _next_tick++;
+}
+
+void TimerWheel::insert(SoftTimer &timer) {
+    int32_t delta = timer._expires - _next_tick;
+
+    /** Overdue timers expire on the next tick processed */
+    if(delta < 0) {
+        this->link(timer, _next_tick & SLOT_MASK);
+        return;
+    }
+
+    /** Beyond the wheel's range (only if it fell far behind), cascaded again later */
+    uint32_t expires = timer._expires;
+    if((uint32_t) delta > MAX_TICKS) {
+        delta = MAX_TICKS;
+        expires = _next_tick + MAX_TICKS;
+    }
+
+    uint32_t level = 0;
+    while(level < (LEVELS - 1) && (uint32_t) delta >= (1UL << ((level + 1) * LEVEL_BITS))) {
+        level++;
+    }
+    uint32_t index = (expires >> (level * LEVEL_BITS)) & SLOT_MASK;
+    this->link(timer, level * SLOTS + index);
+}
+
+void TimerWheel::link(SoftTimer &timer, uint16_t slot) {
+    SoftTimer **head = &_slots[slot];
+    timer._slot = slot;
+    timer._next = *head;
+    if(timer._next) {
+        timer._next->_pprev = &timer._next;
+    }
+    timer._pprev = head;
+    *head = &timer;
+    if(slot < EXPIRED_SLOT) {
+        _occupied[slot / SLOTS] |= (1ULL << (slot & SLOT_MASK));
+    }
+}
+
+void TimerWheel::unlink(SoftTimer &timer) {
+    *timer._pprev = timer._next;
+    if(timer._next) {
+        timer._next->_pprev = timer._pprev;
+    }
+    if(timer._slot < EXPIRED_SLOT && !_slots[timer._slot]) {
+        _occupied[timer._slot / SLOTS] &= ~(1ULL << (timer._slot & SLOT_MASK));
+    }
+    timer._next = NULL;
+    timer._pprev = NULL;
+}
+
+void TimerWheel::reschedule(uint32_t now) {
+    uint32_t ticks = this->ticks_to_next_event();
+    if(ticks == UINT32_MAX) {
+        if(_scheduled) {
+            _scheduled = false;
+            this->cancel();
+        }
+        return;
+    }
+
+    /** An overdue event is processed on the next tick */
+    uint32_t target = _next_tick + ticks;
+    int32_t delay = target - now;
+    if(delay <= 0) {
+        delay = 1;
+        target = now + 1;
+    }
+
+    _scheduled = true;
+    _scheduled_tick = target;
+    this->schedule(delay);
+}
@@ -0,0 +1,246 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_TIMERWHEEL_H_
+#define EP_OC_MCU_EXTENSIONS_TIMERWHEEL_H_
+
+#include "platform/Callback.h"
+#include "platform/NonCopyable.h"
+
+#include <chrono>
+#include <stdint.h>
+
+namespace ep {
+
+class TimerWheel;
+
+/**
+ * A software timer run by a TimerWheel. Starting, restarting and stopping
+ * it are O(1) and never touch the hardware ticker queue.
+ */
+class SoftTimer : private mbed::NonCopyable<SoftTimer>
+{
+
+public:
+
+    SoftTimer() : _wheel(NULL), _next(NULL), _pprev(NULL), _expires(0), _slot(0) {
+    }
+
+    /** @param[in] cb Callback to execute when the timer expires */
+    SoftTimer(const mbed::Callback<void()> &cb) : _callback(cb), _wheel(NULL), _next(NULL),
+        _pprev(NULL), _expires(0), _slot(0) {
+    }
+
+    /** Stops the timer if it is running */
+    ~SoftTimer();
+
+    /**
+     * Set the callback executed when the timer expires
+     * @note Not interrupt safe, set it while the timer is stopped
+     */
+    void attach(const mbed::Callback<void()> &cb) {
+        _callback = cb;
+    }
+
+    /** True if the timer is running or has expired and its callback is about to run */
+    bool active(void) const {
+        return (_pprev != NULL);
+    }
+
+protected:
+
+    friend class TimerWheel;
+
+    mbed::Callback<void()> _callback;
+
+    /** Wheel the timer was last started on */
+    TimerWheel *_wheel;
+
+    /** Links in the list of a wheel slot, _pprev is NULL while stopped */
+    SoftTimer *_next;
+    SoftTimer **_pprev;
+
+    /** Tick at which the timer expires */
+    uint32_t _expires;
+
+    /** Slot the timer is in */
+    uint16_t _slot;
+
+};
+
+/**
+ * Hierarchical timing wheel multiplexing any number of SoftTimers onto a
+ * single hardware timeout.
+ *
+ * Time is counted in ticks. The wheel has 4 levels of 64 slots: level 0
+ * holds the timers expiring in the next 64 ticks, one slot per tick, level 1
+ * the ones expiring in the next 4096 ticks, one slot per 64 ticks, and so
+ * on, for a maximum timeout of 2^24 - 1 ticks (4.6 hours with 1 ms ticks).
+ * When the level 0 index wraps, the next level 1 slot is cascaded, ie its
+ * timers are redistributed over level 0, and so on up the levels.
+ *
+ * Starting and stopping a timer is an O(1) list operation. Each level keeps
+ * a bitmap of its occupied slots, so the next tick that has work to do is
+ * found in O(1) too. The hardware timeout is only programmed for that tick,
+ * and empty ticks are skipped, so an idle wheel takes no interrupts and
+ * hundreds of pending timers cost one ticker queue entry.
+ *
+ * Derived classes provide the clock and the hardware timeout, see
+ * TimeoutTimerWheel. Callbacks run in the context process() is called from,
+ * usually an interrupt.
+ */
+class TimerWheel : private mbed::NonCopyable<TimerWheel>
+{
+
+public:
+
+    /** Number of levels, and of slots per level */
+    static const uint32_t LEVELS = 4;
+    static const uint32_t LEVEL_BITS = 6;
+    static const uint32_t SLOTS = (1 << LEVEL_BITS);
+
+    /** Longest timeout in ticks, longer ones are clamped */
+    static const uint32_t MAX_TICKS = (1UL << (LEVELS * LEVEL_BITS)) - 1;
+
+    virtual ~TimerWheel() {
+    }
+
+    /**
+     * Start a timer, or restart it if it is running
+     * @param[in] timer Timer to start
+     * @param[in] ticks Ticks from now until it expires, at least 1
+     * @note Interrupt safe
+     */
+    void start(SoftTimer &timer, uint32_t ticks);
+
+    /**
+     * Start a timer, or restart it if it is running. The timeout is rounded
+     * up to whole ticks plus one, so the timer never expires early.
+     * @param[in] timer Timer to start
+     * @param[in] timeout Time until it expires
+     * @note Interrupt safe
+     */
+    void start(SoftTimer &timer, std::chrono::microseconds timeout) {
+        this->start(timer, this->to_ticks(timeout));
+    }
+
+    /**
+     * Stop a timer. Does nothing if it is not running.
+     * @note Interrupt safe
+     */
+    void stop(SoftTimer &timer);
+
+    /** Duration of one tick */
+    std::chrono::microseconds tick(void) const {
+        return std::chrono::microseconds(_tick_us);
+    }
+
+    /** Number of running timers */
+    uint32_t active_count(void) const {
+        return _active_count;
+    }
+
+    /** Number of times process() ran, ie hardware timeout interrupts */
+    uint32_t process_count(void) const {
+        return _process_count;
+    }
+
+    /** Number of timers that expired */
+    uint32_t expired_count(void) const {
+        return _expired_count;
+    }
+
+    /** Number of times a timer was moved down a level */
+    uint32_t cascade_count(void) const {
+        return _cascade_count;
+    }
+
+protected:
+
+    /** @param[in] tick Duration of one tick */
+    TimerWheel(std::chrono::microseconds tick);
+
+    /** Current tick count of the clock, wrapping at 2^32 */
+    virtual uint32_t now(void) = 0;
+
+    /** Call process() once the clock reaches now() + ticks, replacing any previous schedule */
+    virtual void schedule(uint32_t ticks) = 0;
+
+    /** Cancel the scheduled process() call */
+    virtual void cancel(void) = 0;
+
+    /**
+     * Expire the timers due by now(), run their callbacks and schedule the
+     * next call. Called when the hardware timeout fires.
+     */
+    void process(void);
+
+    uint32_t to_ticks(std::chrono::microseconds timeout) const;
+
+    /** Ticks from _next_tick to the next tick with timers to expire or cascade, UINT32_MAX if none */
+    uint32_t ticks_to_next_event(void) const;
+
+    /** Move _next_tick forward, at most to now, over ticks with nothing to do */
+    void skip_idle(uint32_t now);
+
+    /** Process _next_tick: cascade the higher levels and queue the expired timers */
+    void run_tick(void);
+
+    /** Put a timer in the slot matching its expiry */
+    void insert(SoftTimer &timer);
+
+    void link(SoftTimer &timer, uint16_t slot);
+    void unlink(SoftTimer &timer);
+
+    /** Program the hardware timeout for the next event, or cancel it */
+    void reschedule(uint32_t now);
+
+protected:
+
+    /** Slot holding the expired timers whose callbacks have not run yet */
+    static const uint16_t EXPIRED_SLOT = LEVELS * SLOTS;
+
+    uint32_t _tick_us;
+
+    /** Next tick to process */
+    uint32_t _next_tick;
+
+    SoftTimer *_slots[LEVELS * SLOTS + 1];
+
+    /** Bitmap of the non-empty slots of each level */
+    uint64_t _occupied[LEVELS];
+
+    /** Tick the hardware timeout is programmed for, if _scheduled */
+    uint32_t _scheduled_tick;
+    bool _scheduled;
+
+    uint32_t _active_count;
+    uint32_t _process_count;
+    uint32_t _expired_count;
+    uint32_t _cascade_count;
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_TIMERWHEEL_H_ */
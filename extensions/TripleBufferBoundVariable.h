@@ -0,0 +1,187 @@
+/**
+ * ep-oc-mcu
+ * Embedded Planet Open Core for Microcontrollers
+ *
+ * Built with ARM Mbed-OS
+ *
+ * Copyright (c) 2021 Embedded Planet, Inc.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EP_OC_MCU_EXTENSIONS_TRIPLEBUFFERBOUNDVARIABLE_H_
+#define EP_OC_MCU_EXTENSIONS_TRIPLEBUFFERBOUNDVARIABLE_H_
+
+#include "extensions/BoundVariable.h"
+
+#include "platform/mbed_atomic.h"
+
+#include <stdint.h>
+
+namespace ep {
+
+/**
+ * A BoundVariable that decouples one fast producer from one slow consumer
+ * with a triple buffer.
+ *
+ * The producer writes into its own back buffer and swaps it with the shared
+ * middle buffer. The consumer swaps the middle buffer into its front buffer
+ * when a new frame is available. Neither side ever waits for the other, and
+ * the consumer always reads the most recent complete frame.
+ *
+ * Unlike BoundVariable, set() does not run any callbacks. Subscribers are
+ * called from the consumer's context by update(), so a slow subscriber can
+ * never delay the producer.
+ *
+ * @note Exactly one producer (set) and one consumer (get/update/has_new) are supported
+ */
+template<typename T>
+class TripleBufferBoundVariable : public BoundVariable<T>
+{
+
+public:
+
+    TripleBufferBoundVariable() : BoundVariable<T>() {
+        this->init();
+    }
+
+    TripleBufferBoundVariable(const T &value) : BoundVariable<T>(value) {
+        _extra[0] = value;
+        _extra[1] = value;
+        this->init();
+    }
+
+    /**
+     * Producer: publish a new frame
+     * @retval Copy of the published frame. Unlike BoundVariable, no reference
+     * is returned: the buffers rotate between the producer and the consumer.
+     */
+    T operator=(const T &rhs) {
+        this->publish(rhs);
+        return rhs;
+    }
+
+    /**
+     * Producer: publish a new frame. Never waits for the consumer.
+     * @param[in] new_value Frame to publish
+     */
+    virtual void set(T new_value) {
+        this->publish(new_value);
+    }
+
+    /**
+     * Producer: publish a new frame
+     * @param[in] new_value Frame to publish
+     * @retval true if the consumer had read the previous frame,
+     * false if it was overwritten unread
+     */
+    bool publish(const T &new_value) {
+        *_buffers[_back] = new_value;
+        uint8_t previous = core_util_atomic_exchange_u8(&_middle, _back | NEW_FRAME);
+        _back = previous & INDEX_MASK;
+
+        if(previous & NEW_FRAME) {
+            _dropped_count++;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Producer: returns true if the consumer has read the last published frame
+     */
+    bool consumed(void) const {
+        return !(core_util_atomic_load_u8(&_middle) & NEW_FRAME);
+    }
+
+    /**
+     * Consumer: returns true if a frame was published since the last read
+     */
+    bool has_new(void) const {
+        return (core_util_atomic_load_u8(&_middle) & NEW_FRAME);
+    }
+
+    /**
+     * Consumer: returns the freshest complete frame
+     */
+    virtual T get(void) {
+        this->swap_in();
+        return *_buffers[_front];
+    }
+
+    /**
+     * Consumer: take the freshest frame and, if it is new, call the
+     * subscribers with it in the caller's context
+     * @retval true if a new frame was dispatched
+     */
+    bool update(void) {
+        if(!this->swap_in()) {
+            return false;
+        }
+        this->_callchain.call(*_buffers[_front]);
+        return true;
+    }
+
+    /** Number of frames overwritten before the consumer read them */
+    uint32_t dropped_count(void) const {
+        return _dropped_count;
+    }
+
+protected:
+
+    static const uint8_t INDEX_MASK = 0x03;
+    static const uint8_t NEW_FRAME = 0x04;
+
+    void init(void) {
+        _buffers[0] = &this->_value;
+        _buffers[1] = &_extra[0];
+        _buffers[2] = &_extra[1];
+        _front = 0;
+        _middle = 1;
+        _back = 2;
+        _dropped_count = 0;
+    }
+
+    /** Consumer: swap the middle buffer in if it holds a new frame */
+    bool swap_in(void) {
+        if(!(core_util_atomic_load_u8(&_middle) & NEW_FRAME)) {
+            return false;
+        }
+        _front = core_util_atomic_exchange_u8(&_middle, _front) & INDEX_MASK;
+        return true;
+    }
+
+protected:
+
+    /** Two more buffers, the first one is BoundVariable::_value */
+    T _extra[2];
+    T *_buffers[3];
+
+    /** Buffer owned by the consumer */
+    uint8_t _front;
+
+    /** Shared buffer index, with NEW_FRAME set if it has not been read */
+    volatile uint8_t _middle;
+
+    /** Buffer owned by the producer */
+    uint8_t _back;
+
+    uint32_t _dropped_count;
+
+};
+
+}
+
+#endif /* EP_OC_MCU_EXTENSIONS_TRIPLEBUFFERBOUNDVARIABLE_H_ */